@@ -41,6 +41,20 @@ struct MultiDiffExpr
       return static_cast<const IMPL *>( this )->getDiffValues( i );
    }
 
+   /**
+    * The derivatives can only be nonzero in the directions [activeBegin(), activeEnd()).
+    * The range consists of whole packs and is empty if activeBegin() >= activeEnd().
+    */
+   std::size_t activeBegin() const
+   {
+      return static_cast<const IMPL *>( this )->activeBegin();
+   }
+
+   std::size_t activeEnd() const
+   {
+      return static_cast<const IMPL *>( this )->activeEnd();
+   }
+
 };
 
 /**
@@ -2,28 +2,47 @@
 #define _CPPLSQ_BLAS_HPP_
 
 #include <cblas.h>
+#include "small_blas.hpp"
+
 namespace cpplsq
 {
 /**
  * Wrapper for blas functions with float and double overloads
- * using same storage orders for each call.
+ * using same storage orders for each call. The level 1 and 2 routines
+ * used by the solvers call inline kernels instead of cblas for vectors
+ * of size up to internal::small_blas_size.
  */
 template<CBLAS_UPLO Uplo, CBLAS_ORDER Order>
 struct Blas
 {
+   /**
+    * The inline kernels for symmetric and triangular matrices assume the row major lower triangle.
+    * The inline kernels for vectors only step forward, so negative increments are left to cblas.
+    */
+   static constexpr bool small_kernels = Order == CblasRowMajor && Uplo == CblasLower;
+
    static void axpy( const int N, const double alpha, const double *X, const int INCX, double *Y, const int INCY )
    {
+      if( INCX > 0 && INCY > 0 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallAxpy>::call( N, alpha, X, INCX, Y, INCY );
+
       cblas_daxpy( N, alpha, X, INCX, Y, INCY );
    }
 
    static void axpy( const int N, const float alpha, const float *X, const int INCX, float *Y, const int INCY )
    {
+      if( INCX > 0 && INCY > 0 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallAxpy>::call( N, alpha, X, INCX, Y, INCY );
+
       cblas_saxpy( N, alpha, X, INCX, Y, INCY );
    }
 
    static void syr( const int N, const double alpha, const double *X,
                     const int incX, double *A, const int lda )
    {
+      if( small_kernels && incX == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallSyr>::call( N, alpha, X, A, lda );
+
       cblas_dsyr( Order, Uplo, N, alpha, X, incX, A, lda );
    }
 
@@ -31,13 +50,73 @@ struct Blas
    static void syr( const int N, const float alpha, const float *X,
                     const int incX, float *A, const int lda )
    {
+      if( small_kernels && incX == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallSyr>::call( N, alpha, X, A, lda );
+
       cblas_ssyr( Order, Uplo, N, alpha, X, incX, A, lda );
    }
 
+   static void syr2( const int N, const double alpha, const double *X,
+                     const int incX, const double *Y, const int incY,
+                     double *A, const int lda )
+   {
+      cblas_dsyr2( Order, Uplo, N, alpha, X, incX, Y, incY, A, lda );
+   }
+
+
+   static void syr2( const int N, const float alpha, const float *X,
+                     const int incX, const float *Y, const int incY,
+                     float *A, const int lda )
+   {
+      cblas_ssyr2( Order, Uplo, N, alpha, X, incX, Y, incY, A, lda );
+   }
+
+   static void spr( const int N, const double alpha, const double *X,
+                    const int incX, double *Ap )
+   {
+      if( small_kernels && incX == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallSpr>::call( N, alpha, X, Ap );
+
+      cblas_dspr( Order, Uplo, N, alpha, X, incX, Ap );
+   }
+
+
+   static void spr( const int N, const float alpha, const float *X,
+                    const int incX, float *Ap )
+   {
+      if( small_kernels && incX == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallSpr>::call( N, alpha, X, Ap );
+
+      cblas_sspr( Order, Uplo, N, alpha, X, incX, Ap );
+   }
+
+   static void spmv( const int N, const double alpha, const double *Ap,
+                     const double *X, const int incX, const double beta,
+                     double *Y, const int incY )
+   {
+      if( small_kernels && incX == 1 && incY == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallSpmv>::call( N, alpha, Ap, X, beta, Y );
+
+      cblas_dspmv( Order, Uplo, N, alpha, Ap, X, incX, beta, Y, incY );
+   }
+
+   static void spmv( const int N, const float alpha, const float *Ap,
+                     const float *X, const int incX, const float beta,
+                     float *Y, const int incY )
+   {
+      if( small_kernels && incX == 1 && incY == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallSpmv>::call( N, alpha, Ap, X, beta, Y );
+
+      cblas_sspmv( Order, Uplo, N, alpha, Ap, X, incX, beta, Y, incY );
+   }
+
    static void symv( const int N, const double alpha, const double *A,
                      const int lda, const double *X, const int incX,
                      const double beta, double *Y, const int incY )
    {
+      if( small_kernels && incX == 1 && incY == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallSymv>::call( N, alpha, A, lda, X, beta, Y );
+
       cblas_dsymv( Order, Uplo, N, alpha, A, lda, X, incX, beta, Y, incY );
    }
 
@@ -45,18 +124,35 @@ struct Blas
                      const int lda, const float *X, const int incX,
                      const float beta, float *Y, const int incY )
    {
+      if( small_kernels && incX == 1 && incY == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallSymv>::call( N, alpha, A, lda, X, beta, Y );
+
       cblas_ssymv( Order, Uplo, N, alpha, A, lda, X, incX, beta, Y, incY );
    }
 
    static double dot( const int N, const double *X, const int incX,
                       const double *Y, const int incY )
    {
+      if( incX > 0 && incY > 0 && internal::is_small( N ) )
+      {
+         double result;
+         internal::SmallDispatch<internal::SmallDot>::call( N, X, incX, Y, incY, &result );
+         return result;
+      }
+
       return cblas_ddot( N, X, incX, Y, incY );
    }
 
    static float dot( const int N, const float *X, const int incX,
                      const float *Y, const int incY )
    {
+      if( incX > 0 && incY > 0 && internal::is_small( N ) )
+      {
+         float result;
+         internal::SmallDispatch<internal::SmallDot>::call( N, X, incX, Y, incY, &result );
+         return result;
+      }
+
       return cblas_sdot( N, X, incX, Y, incY );
    }
 
@@ -65,6 +161,9 @@ struct Blas
                      const double *X, const int incX, const double beta,
                      double *Y, const int incY )
    {
+      if( Order == CblasRowMajor && incX > 0 && incY > 0 && internal::is_small( M ) && internal::is_small( N ) )
+         return internal::small_gemv( TransA != CblasNoTrans, M, N, alpha, A, lda, X, incX, beta, Y, incY );
+
       cblas_dgemv( Order, TransA, M, N, alpha, A, lda, X, incX, beta, Y, incY );
    }
 
@@ -74,16 +173,25 @@ struct Blas
                      const float *X, const int incX, const float beta,
                      float *Y, const int incY )
    {
+      if( Order == CblasRowMajor && incX > 0 && incY > 0 && internal::is_small( M ) && internal::is_small( N ) )
+         return internal::small_gemv( TransA != CblasNoTrans, M, N, alpha, A, lda, X, incX, beta, Y, incY );
+
       cblas_sgemv( Order, TransA, M, N, alpha, A, lda, X, incX, beta, Y, incY );
    }
 
    static void scal( const int N, const double alpha, double *X, const int incX )
    {
+      if( incX > 0 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallScal>::call( N, alpha, X, incX );
+
       cblas_dscal( N, alpha, X, incX );
    }
 
    static void scal( const int N, const float alpha, float *X, const int incX )
    {
+      if( incX > 0 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallScal>::call( N, alpha, X, incX );
+
       cblas_sscal( N, alpha, X, incX );
    }
 
@@ -101,6 +209,24 @@ struct Blas
       cblas_ssyrk( Order, Uplo, Trans, N, K, alpha, A, lda, beta, C, ldc );
    }
 
+   static void gemm( const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+                     const int M, const int N, const int K,
+                     const double alpha, const double *A, const int lda,
+                     const double *B, const int ldb, const double beta,
+                     double *C, const int ldc )
+   {
+      cblas_dgemm( Order, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc );
+   }
+
+   static void gemm( const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+                     const int M, const int N, const int K,
+                     const float alpha, const float *A, const int lda,
+                     const float *B, const int ldb, const float beta,
+                     float *C, const int ldc )
+   {
+      cblas_sgemm( Order, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc );
+   }
+
    static void symm( const CBLAS_SIDE Side, const int M, const int N,
                      const double alpha, const double *A, const int lda,
                      const double *B, const int ldb, const double beta,
@@ -121,6 +247,9 @@ struct Blas
                      const int N, const double *A, const int lda, double *X,
                      const int incX )
    {
+      if( small_kernels && incX == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallTrsv>::call( N, TransA != CblasNoTrans, Diag == CblasUnit, A, lda, X );
+
       cblas_dtrsv( Order, Uplo, TransA, Diag, N, A, lda, X, incX );
    }
 
@@ -129,10 +258,32 @@ struct Blas
                      const int N, const float *A, const int lda, float *X,
                      const int incX )
    {
+      if( small_kernels && incX == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallTrsv>::call( N, TransA != CblasNoTrans, Diag == CblasUnit, A, lda, X );
+
       cblas_strsv( Order, Uplo, TransA, Diag, N, A, lda, X, incX );
 
    }
 
+   static void tpsv( const CBLAS_TRANSPOSE TransA, const CBLAS_DIAG Diag,
+                     const int N, const double *Ap, double *X, const int incX )
+   {
+      if( small_kernels && incX == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallTpsv>::call( N, TransA != CblasNoTrans, Diag == CblasUnit, Ap, X );
+
+      cblas_dtpsv( Order, Uplo, TransA, Diag, N, Ap, X, incX );
+   }
+
+
+   static void tpsv( const CBLAS_TRANSPOSE TransA, const CBLAS_DIAG Diag,
+                     const int N, const float *Ap, float *X, const int incX )
+   {
+      if( small_kernels && incX == 1 && internal::is_small( N ) )
+         return internal::SmallDispatch<internal::SmallTpsv>::call( N, TransA != CblasNoTrans, Diag == CblasUnit, Ap, X );
+
+      cblas_stpsv( Order, Uplo, TransA, Diag, N, Ap, X, incX );
+   }
+
    static void trmm( const CBLAS_SIDE Side, const CBLAS_TRANSPOSE TransA,
                      const CBLAS_DIAG Diag, const int M, const int N,
                      const double alpha, const double *A, const int lda,
@@ -149,6 +300,22 @@ struct Blas
       cblas_strmm( Order, Side, Uplo, TransA, Diag, M, N, alpha, A, lda, B, ldb );
    }
 
+   static void trsm( const CBLAS_SIDE Side, const CBLAS_TRANSPOSE TransA,
+                     const CBLAS_DIAG Diag, const int M, const int N,
+                     const double alpha, const double *A, const int lda,
+                     double *B, const int ldb )
+   {
+      cblas_dtrsm( Order, Side, Uplo, TransA, Diag, M, N, alpha, A, lda, B, ldb );
+   }
+
+   static void trsm( const CBLAS_SIDE Side, const CBLAS_TRANSPOSE TransA,
+                     const CBLAS_DIAG Diag, const int M, const int N,
+                     const float alpha, const float *A, const int lda,
+                     float *B, const int ldb )
+   {
+      cblas_strsm( Order, Side, Uplo, TransA, Diag, M, N, alpha, A, lda, B, ldb );
+   }
+
    static double nrm2( const int N, const double *X, const int incX )
    {
       return cblas_dnrm2( N, X, incX );
@@ -161,11 +328,17 @@ struct Blas
 
    static double iamax( const int N, const double *X, const int incX )
    {
+      if( incX > 0 && internal::is_small( N ) )
+         return internal::small_iamax( N, X, incX );
+
       return cblas_idamax( N, X, incX );
    }
 
    static float iamax( const int N, const float *X, const int incX )
    {
+      if( incX > 0 && internal::is_small( N ) )
+         return internal::small_iamax( N, X, incX );
+
       return cblas_isamax( N, X, incX );
    }
 
@@ -0,0 +1,382 @@
+#ifndef _CPPLSQ_FIXED_DIFF_HPP_
+#define _CPPLSQ_FIXED_DIFF_HPP_
+
+#include <array>
+#include <cmath>
+#include <ostream>
+#include "AutoDiff.hpp"
+
+namespace cpplsq
+{
+
+/**
+ * Type for computing derivatives in a number of independent variables that is known at
+ * compile time using operator overloading and forward differentiation. Unlike MultiDiff
+ * the derivatives are stored in the object itself, so no MultiDiff::Context is required
+ * and no memory is allocated. The loops over the N derivatives have a fixed trip count
+ * and are unrolled by the compiler, which makes this type suitable for small N.
+ */
+template<typename REAL, std::size_t N>
+class FixedDiff
+{
+public:
+   FixedDiff() = default;
+
+   FixedDiff( REAL val ) : val( val )
+   {
+      diffval.fill( 0 );
+   }
+
+   /**
+    * Set the value and make this the i-th independent variable.
+    */
+   void setIndependent( REAL x, std::size_t i )
+   {
+      val = x;
+      diffval.fill( 0 );
+      diffval[i] = 1;
+   }
+
+   REAL getValue() const
+   {
+      return val;
+   }
+
+   const REAL *getDiffValues() const
+   {
+      return diffval.data();
+   }
+
+   FixedDiff<REAL, N> &operator=( REAL x )
+   {
+      val = x;
+      diffval.fill( 0 );
+      return *this;
+   }
+
+   FixedDiff<REAL, N> &operator +=( const FixedDiff<REAL, N> &x )
+   {
+      val += x.val;
+
+      for( std::size_t i = 0; i < N; ++i )
+         diffval[i] += x.diffval[i];
+
+      return *this;
+   }
+
+   FixedDiff<REAL, N> &operator -=( const FixedDiff<REAL, N> &x )
+   {
+      val -= x.val;
+
+      for( std::size_t i = 0; i < N; ++i )
+         diffval[i] -= x.diffval[i];
+
+      return *this;
+   }
+
+   FixedDiff<REAL, N> &operator *=( const FixedDiff<REAL, N> &x )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+         diffval[i] = x.val * diffval[i] + val * x.diffval[i];
+
+      val *= x.val;
+      return *this;
+   }
+
+   FixedDiff<REAL, N> &operator /=( const FixedDiff<REAL, N> &x )
+   {
+      const REAL inv = 1 / x.val;
+      val *= inv;
+
+      for( std::size_t i = 0; i < N; ++i )
+         diffval[i] = ( diffval[i] - val * x.diffval[i] ) * inv;
+
+      return *this;
+   }
+
+   FixedDiff<REAL, N> &operator +=( REAL x )
+   {
+      val += x;
+      return *this;
+   }
+
+   FixedDiff<REAL, N> &operator -=( REAL x )
+   {
+      val -= x;
+      return *this;
+   }
+
+   FixedDiff<REAL, N> &operator *=( REAL x )
+   {
+      val *= x;
+
+      for( std::size_t i = 0; i < N; ++i )
+         diffval[i] *= x;
+
+      return *this;
+   }
+
+   FixedDiff<REAL, N> &operator /=( REAL x )
+   {
+      return *this *= 1 / x;
+   }
+
+   /**
+    * Returns exp( this ).
+    */
+   FixedDiff<REAL, N> exp() const
+   {
+      FixedDiff<REAL, N> result;
+      result.val = std::exp( val );
+
+      for( std::size_t i = 0; i < N; ++i )
+         result.diffval[i] = result.val * diffval[i];
+
+      return result;
+   }
+
+   /**
+    * Returns -this.
+    */
+   FixedDiff<REAL, N> neg() const
+   {
+      FixedDiff<REAL, N> result;
+      result.val = -val;
+
+      for( std::size_t i = 0; i < N; ++i )
+         result.diffval[i] = -diffval[i];
+
+      return result;
+   }
+
+   /**
+    * Returns x / this.
+    */
+   FixedDiff<REAL, N> rdiv( REAL x ) const
+   {
+      FixedDiff<REAL, N> result;
+      result.val = x / val;
+      const REAL d = -result.val / val;
+
+      for( std::size_t i = 0; i < N; ++i )
+         result.diffval[i] = d * diffval[i];
+
+      return result;
+   }
+
+private:
+   REAL val;
+   std::array<REAL, N> diffval;
+};
+
+template<typename REAL, std::size_t N>
+struct NumTypeTraits<FixedDiff<REAL, N>>
+{
+   using type = REAL;
+};
+
+//Outstream "<<" operator
+template<typename REAL, std::size_t N>
+std::ostream &operator<<( std::ostream &os, const FixedDiff<REAL, N> &x )
+{
+   os << x.getValue();
+   return os;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> exp( const FixedDiff<REAL, N> &x )
+{
+   return x.exp();
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator-( const FixedDiff<REAL, N> &x )
+{
+   return x.neg();
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator+( FixedDiff<REAL, N> a, const FixedDiff<REAL, N> &b )
+{
+   return a += b;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator-( FixedDiff<REAL, N> a, const FixedDiff<REAL, N> &b )
+{
+   return a -= b;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator*( FixedDiff<REAL, N> a, const FixedDiff<REAL, N> &b )
+{
+   return a *= b;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator/( FixedDiff<REAL, N> a, const FixedDiff<REAL, N> &b )
+{
+   return a /= b;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator+( FixedDiff<REAL, N> a, NumType<FixedDiff<REAL, N>> b )
+{
+   return a += b;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator-( FixedDiff<REAL, N> a, NumType<FixedDiff<REAL, N>> b )
+{
+   return a -= b;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator*( FixedDiff<REAL, N> a, NumType<FixedDiff<REAL, N>> b )
+{
+   return a *= b;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator/( FixedDiff<REAL, N> a, NumType<FixedDiff<REAL, N>> b )
+{
+   return a /= b;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator+( NumType<FixedDiff<REAL, N>> a, FixedDiff<REAL, N> b )
+{
+   return b += a;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator-( NumType<FixedDiff<REAL, N>> a, const FixedDiff<REAL, N> &b )
+{
+   return b.neg() += a;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator*( NumType<FixedDiff<REAL, N>> a, FixedDiff<REAL, N> b )
+{
+   return b *= a;
+}
+
+template<typename REAL, std::size_t N>
+FixedDiff<REAL, N> operator/( NumType<FixedDiff<REAL, N>> a, const FixedDiff<REAL, N> &b )
+{
+   return b.rdiv( a );
+}
+
+//RELATIONAL =======================================================
+
+template<typename REAL, std::size_t N>
+bool operator<( const FixedDiff<REAL, N> &a, const FixedDiff<REAL, N> &b )
+{
+   return a.getValue() < b.getValue();
+}
+
+template<typename REAL, std::size_t N>
+bool operator>( const FixedDiff<REAL, N> &a, const FixedDiff<REAL, N> &b )
+{
+   return a.getValue() > b.getValue();
+}
+
+template<typename REAL, std::size_t N>
+bool operator<=( const FixedDiff<REAL, N> &a, const FixedDiff<REAL, N> &b )
+{
+   return a.getValue() <= b.getValue();
+}
+
+template<typename REAL, std::size_t N>
+bool operator>=( const FixedDiff<REAL, N> &a, const FixedDiff<REAL, N> &b )
+{
+   return a.getValue() >= b.getValue();
+}
+
+template<typename REAL, std::size_t N>
+bool operator==( const FixedDiff<REAL, N> &a, const FixedDiff<REAL, N> &b )
+{
+   return a.getValue() == b.getValue();
+}
+
+template<typename REAL, std::size_t N>
+bool operator!=( const FixedDiff<REAL, N> &a, const FixedDiff<REAL, N> &b )
+{
+   return a.getValue() != b.getValue();
+}
+
+template<typename REAL, std::size_t N>
+bool operator<( const FixedDiff<REAL, N> &a, NumType<FixedDiff<REAL, N>> b )
+{
+   return a.getValue() < b;
+}
+
+template<typename REAL, std::size_t N>
+bool operator>( const FixedDiff<REAL, N> &a, NumType<FixedDiff<REAL, N>> b )
+{
+   return a.getValue() > b;
+}
+
+template<typename REAL, std::size_t N>
+bool operator<=( const FixedDiff<REAL, N> &a, NumType<FixedDiff<REAL, N>> b )
+{
+   return a.getValue() <= b;
+}
+
+template<typename REAL, std::size_t N>
+bool operator>=( const FixedDiff<REAL, N> &a, NumType<FixedDiff<REAL, N>> b )
+{
+   return a.getValue() >= b;
+}
+
+template<typename REAL, std::size_t N>
+bool operator==( const FixedDiff<REAL, N> &a, NumType<FixedDiff<REAL, N>> b )
+{
+   return a.getValue() == b;
+}
+
+template<typename REAL, std::size_t N>
+bool operator!=( const FixedDiff<REAL, N> &a, NumType<FixedDiff<REAL, N>> b )
+{
+   return a.getValue() != b;
+}
+
+template<typename REAL, std::size_t N>
+bool operator<( NumType<FixedDiff<REAL, N>> a, const FixedDiff<REAL, N> &b )
+{
+   return a < b.getValue();
+}
+
+template<typename REAL, std::size_t N>
+bool operator>( NumType<FixedDiff<REAL, N>> a, const FixedDiff<REAL, N> &b )
+{
+   return a > b.getValue();
+}
+
+template<typename REAL, std::size_t N>
+bool operator<=( NumType<FixedDiff<REAL, N>> a, const FixedDiff<REAL, N> &b )
+{
+   return a <= b.getValue();
+}
+
+template<typename REAL, std::size_t N>
+bool operator>=( NumType<FixedDiff<REAL, N>> a, const FixedDiff<REAL, N> &b )
+{
+   return a >= b.getValue();
+}
+
+template<typename REAL, std::size_t N>
+bool operator==( NumType<FixedDiff<REAL, N>> a, const FixedDiff<REAL, N> &b )
+{
+   return a == b.getValue();
+}
+
+template<typename REAL, std::size_t N>
+bool operator!=( NumType<FixedDiff<REAL, N>> a, const FixedDiff<REAL, N> &b )
+{
+   return a != b.getValue();
+}
+
+} //cpplsq
+
+#endif
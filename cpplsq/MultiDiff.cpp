@@ -1,5 +1,10 @@
 #include "MultiDiff.hpp"
 #include <simd/alloc.hpp>
+#include <simd/pack.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 
 #ifndef PARALLEL
 #define PARALLEL 1
@@ -16,7 +21,7 @@
 using std::size_t;
 using std::ptrdiff_t;
 
-constexpr static size_t block_size()
+constexpr static size_t min_block_size()
 {
    return 4096;
 }
@@ -25,6 +30,8 @@ struct Block
 {
    Block *next;
    size_t countdown;
+   //number of bytes including the header
+   size_t size;
 
    static constexpr size_t offset()
    {
@@ -121,13 +128,23 @@ public:
       }
    }
 
-   Block *get_new_block()
+   Block *get_new_block( size_t size )
    {
       Block *new_block = free_blocks.pop();
 
+      //blocks released while a context with smaller buffers was active can be too small
+      if( new_block && new_block->size < size )
+      {
+         simd::cache_aligned_free( new_block );
+         new_block = nullptr;
+      }
+
       if( !new_block )
       {
-         new_block = ( Block * ) simd::cache_aligned_alloc( block_size() );
+         //the buffers are zero while they are not used
+         new_block = ( Block * ) simd::cache_aligned_alloc( size );
+         new_block->size = size;
+         std::memset( new_block->as_char_ptr() + Block::offset(), 0, size - Block::offset() );
       }
 
       new_block->next = list;
@@ -170,6 +187,10 @@ FreeList BlockList::free_blocks;
 THREAD_LOCAL static BlockList used_blocks;
 THREAD_LOCAL static char *next_buffer = nullptr;
 THREAD_LOCAL static char *block_end = nullptr;
+THREAD_LOCAL static BlockList scratch_blocks;
+THREAD_LOCAL static char *next_scratch = nullptr;
+THREAD_LOCAL static char *scratch_end = nullptr;
+THREAD_LOCAL static size_t scratch_in_use = 0;
 
 namespace cpplsq
 {
@@ -178,22 +199,36 @@ namespace internal
 
 size_t buffer_size;
 size_t num_directions;
+void *seed_buffers = nullptr;
 
 void free_all()
 {
    used_blocks.free_all();
+   scratch_blocks.free_all();
    next_buffer = block_end = nullptr;
+   next_scratch = scratch_end = nullptr;
+   scratch_in_use = 0;
    buffer_size = 0;
    num_directions = 0;
+   seed_buffers = nullptr;
+}
+
+/**
+ * Size of the blocks the buffers are carved from. Holds at least one buffer
+ * if the buffers are larger than the minimum block size.
+ */
+static size_t block_size()
+{
+   return std::max( min_block_size(), Block::offset() + buffer_size );
 }
 
 void *new_buffer()
 {
    if( next_buffer == block_end )
    {
-      Block *new_block = used_blocks.get_new_block();
+      Block *new_block = used_blocks.get_new_block( block_size() );
       next_buffer = new_block->as_char_ptr() + Block::offset();
-      new_block->countdown = ( block_size() - Block::offset() ) / buffer_size;
+      new_block->countdown = ( new_block->size - Block::offset() ) / buffer_size;
       block_end = next_buffer + new_block->countdown * buffer_size;
    }
 
@@ -216,7 +251,7 @@ void release_buffer( void *buf )
          ptrdiff_t distance = reinterpret_cast<char *>( buf ) - blk->as_char_ptr();
 
          //if the buffer belongs to the block
-         if( distance >= 0 && size_t( distance ) < block_size() )
+         if( distance >= 0 && size_t( distance ) < blk->size )
          {
             //decrement countdown and check if it is zero
             if( --( blk->countdown ) == 0 )
@@ -235,5 +270,50 @@ void release_buffer( void *buf )
    }
 }
 
+void *new_scratch_buffer()
+{
+   if( next_scratch == scratch_end )
+   {
+      Block *new_block = scratch_blocks.get_new_block( block_size() );
+      next_scratch = new_block->as_char_ptr() + Block::offset();
+      scratch_end = next_scratch + ( new_block->size - Block::offset() ) / buffer_size * buffer_size;
+   }
+
+   ++scratch_in_use;
+   char *buf = next_scratch;
+   next_scratch += buffer_size;
+   return buf;
+}
+
+void release_scratch_buffer( void *buf )
+{
+   if( buf && --scratch_in_use == 0 )
+   {
+      //no temporary is alive anymore -> keep only the newest block and start over
+      Block *head = scratch_blocks.head();
+
+      while( head->next )
+         scratch_blocks.release_after( head );
+
+      next_scratch = head->as_char_ptr() + Block::offset();
+   }
+}
+
+std::size_t simd_width()
+{
+   return sizeof( pack<double> );
+}
+
+void check_simd_width( std::size_t width )
+{
+   if( width != simd_width() )
+   {
+      std::fprintf( stderr, "cpplsq: the library was compiled for %s with %zu byte simd vectors but is used with %zu byte vectors\n",
+                    cpplsq::simd_arch(), simd_width(), width );
+      std::abort();
+   }
+}
+
 }//internal
+
 }//cpplsq
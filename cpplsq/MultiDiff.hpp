@@ -4,7 +4,9 @@
 #include <simd/alloc.hpp>
 #include <cmath>
 #include <iterator>
+#include <algorithm>
 #include "AutoDiff.hpp"
+#include "simd_arch.hpp"
 
 namespace cpplsq
 {
@@ -21,11 +23,45 @@ namespace internal
 extern std::size_t buffer_size;
 extern std::size_t num_directions;
 
+/**
+ * Read only derivatives of the constants and independent variables, which are shared by all
+ * MultiDiff objects instead of using a buffer of their own. For each position l within a pack
+ * it contains 2 * num_directions zeros, except for a one at num_directions + l.
+ */
+extern void *seed_buffers;
+
+/**
+ * Returns a buffer for the derivatives of a MultiDiff. The buffers are zero when they are
+ * returned and must be zero again when they are released.
+ */
 void *new_buffer();
 
 void release_buffer( void * );
 
 void free_all();
+
+/**
+ * Buffers for subexpressions that are stored in a temporary. They are taken from a
+ * separate scratch arena with a bump pointer that is reset once no temporary is alive
+ * anymore, which is usually at the end of every full expression. As for new_buffer()
+ * the buffers are zero when they are returned and released.
+ */
+void *new_scratch_buffer();
+
+void release_scratch_buffer( void * );
+
+/**
+ * Size in bytes of the simd vectors the library was compiled with. The buffers of the
+ * derivatives are aligned to it, so it must match the code using the library.
+ */
+std::size_t simd_width();
+
+/**
+ * Stops the program with a message if the given width of the simd vectors of the code
+ * using the library differs from simd_width(), i.e. if it was compiled with a different
+ * CPPLSQ_ARCH. The buffers would be misaligned and too short otherwise.
+ */
+void check_simd_width( std::size_t width );
 }
 
 /**
@@ -35,6 +71,102 @@ void free_all();
 template<typename T>
 struct SimdTemps;
 
+/**
+ * Number of simd registers of the instruction set the code is compiled for.
+ */
+constexpr int simd_registers()
+{
+#if defined(__AVX512F__) || defined(__aarch64__)
+   return 32;
+#else
+   return 16;
+#endif
+}
+
+/**
+ * Maximum number of simd temporaries of an expression before a subexpression is stored in
+ * a temporary. Half of the registers are left for evaluating the operands of the expression.
+ */
+constexpr int max_simd_temps()
+{
+   return simd_registers() / 2;
+}
+
+namespace internal
+{
+
+/**
+ * Number of packs of the derivatives of an expression of type T that are evaluated per
+ * iteration. The broadcast values of the expression are shared by all packs and each
+ * additional pack needs about three registers for its operands and result.
+ */
+template<typename T>
+constexpr int unroll_packs()
+{
+   return simd_registers() - SimdTemps<T>::value >= 12 ? 4 :
+          simd_registers() - SimdTemps<T>::value >= 6 ? 2 : 1;
+}
+
+/**
+ * Set the derivatives in the range [begin, end) of the buffer dval to zero.
+ */
+template<typename REAL>
+void zero_diff_values( REAL *dval, std::size_t begin, std::size_t end )
+{
+   const pack<REAL> z = zero<REAL>();
+
+   for( std::size_t i = begin; i < end; i += pack_size<REAL>() )
+      z.aligned_store( dval + i );
+}
+
+/**
+ * Evaluate the derivatives of the expression x into the buffer dval. Only the packs in the
+ * active range of x are evaluated and of the previous content only the part of the previous
+ * active range [begin, end) outside of it is set to zero. On return [begin, end) is the active
+ * range of x. Several packs are computed before any of them is stored, so that their
+ * independent instruction chains overlap in the cpu and the expression may read from dval itself.
+ */
+template<typename T, typename REAL>
+void store_diff_values( const MultiDiffExpr<T> &x, REAL *dval, std::size_t &begin, std::size_t &end )
+{
+   constexpr std::size_t P = pack_size<REAL>();
+   constexpr int U = unroll_packs<T>();
+   const std::size_t xbegin = x.activeBegin();
+   const std::size_t xend = x.activeEnd();
+   std::size_t i = xbegin;
+
+   for( ; i + U * P <= xend; i += U * P )
+   {
+      pack<REAL> d[U];
+
+      for( int u = 0; u < U; ++u )
+         d[u] = x.getDiffValues( i + u * P );
+
+      for( int u = 0; u < U; ++u )
+         d[u].aligned_store( dval + i + u * P );
+   }
+
+   for( ; i < xend; i += P )
+      x.getDiffValues( i ).aligned_store( dval + i );
+
+   if( xbegin < xend )
+   {
+      zero_diff_values( dval, begin, std::min( end, xbegin ) );
+      zero_diff_values( dval, std::max( begin, xend ), end );
+      begin = xbegin;
+      end = xend;
+   }
+   else
+   {
+      zero_diff_values( dval, begin, end );
+      begin = num_directions;
+      end = 0;
+   }
+}
+
+}
+
+
 template<typename REAL>
 class MultiDiff : public MultiDiffExpr<MultiDiff<REAL>>
 {
@@ -45,8 +177,18 @@ public:
       {
          assert( internal::buffer_size == 0 );
          assert( internal::num_directions == 0 );
+         internal::check_simd_width( sizeof( pack<REAL> ) );
          internal::num_directions = next_size<REAL>( num_dir );
          internal::buffer_size = sizeof( REAL ) * internal::num_directions;
+
+         const std::size_t n = 2 * internal::num_directions;
+         seeds = alloc_aligned_array<REAL>( pack_size<REAL>() * n );
+         std::fill( seeds.get(), seeds.get() + pack_size<REAL>() * n, REAL( 0 ) );
+
+         for( std::size_t l = 0; l < pack_size<REAL>(); ++l )
+            seeds[l * n + internal::num_directions + l] = 1;
+
+         internal::seed_buffers = seeds.get();
       }
 
       Context( const Context & ) = delete;
@@ -59,46 +201,51 @@ public:
          internal::free_all();
       }
 
+   private:
+      simd::aligned_array<REAL> seeds;
    };
 
+   /**
+    * Constants and independent variables use the shared seed buffers and only
+    * get a buffer of their own when an expression is assigned to them.
+    */
    MultiDiff()
    {
-      dval = ( REAL * ) internal::new_buffer();
+      shareZero();
    }
 
    MultiDiff( REAL x ) : val( x )
    {
-      dval = ( REAL * ) internal::new_buffer();
-      setDiffValsZero();
+      shareZero();
    }
 
    MultiDiff( REAL x, std::size_t i ) : val( x )
    {
-      dval = ( REAL * ) internal::new_buffer();
-      setDiffValsZero();
-      dval[i] = 1;
+      shareUnit( i );
    }
 
-   MultiDiff( const MultiDiff<REAL> &x ) : val( x.val )
+   MultiDiff( const MultiDiff<REAL> &x ) : val( x.val ), dval( x.dval ), begin( x.begin ), end( x.end ), shared( x.shared )
    {
-      dval = ( REAL * )  internal::new_buffer();
-
-      for( std::size_t i = 0; i < internal::num_directions; i += pack_size<REAL>() )
-         x.getDiffValues( i ).aligned_store( dval + i );
+      if( !shared )
+      {
+         dval = ( REAL * ) internal::new_buffer();
+         begin = internal::num_directions;
+         end = 0;
+         internal::store_diff_values( x, dval, begin, end );
+      }
    }
 
-   MultiDiff( MultiDiff<REAL> && x ) : val( x.val ), dval( x.dval )
+   MultiDiff( MultiDiff<REAL> && x ) : val( x.val ), dval( x.dval ), begin( x.begin ), end( x.end ), shared( x.shared )
    {
       x.dval = nullptr;
    }
 
    template<typename T>
-   MultiDiff( const MultiDiffExpr<T> &x ) : val( x.getValue() )
+   MultiDiff( const MultiDiffExpr<T> &x ) : val( x.getValue() ), begin( internal::num_directions ), end( 0 ), shared( false )
    {
       dval = ( REAL * )internal::new_buffer();
 
-      for( std::size_t i = 0; i < internal::num_directions; i += pack_size<REAL>() )
-         x.getDiffValues( i ).aligned_store( dval + i );
+      internal::store_diff_values( x, dval, begin, end );
    }
 
    //assignment
@@ -111,10 +258,20 @@ public:
 
    MultiDiff<REAL> &operator=( const MultiDiff<REAL> &x )
    {
-      val = x.val;
-
-      for( std::size_t i = 0; i < internal::num_directions; i += pack_size<REAL>() )
-         x.getDiffValues( i ).aligned_store( dval + i );
+      if( x.shared )
+      {
+         releaseBuffer();
+         val = x.val;
+         dval = x.dval;
+         begin = x.begin;
+         end = x.end;
+         shared = true;
+      }
+      else
+      {
+         storeDiffValues( x );
+         val = x.val;
+      }
 
       return *this;
    }
@@ -122,6 +279,9 @@ public:
    MultiDiff<REAL> &operator=( MultiDiff<REAL> && x )
    {
       std::swap( dval, x.dval );
+      std::swap( begin, x.begin );
+      std::swap( end, x.end );
+      std::swap( shared, x.shared );
       val = x.val;
       return *this;
    }
@@ -129,18 +289,15 @@ public:
    template<typename T>
    MultiDiff<REAL> &operator=( const MultiDiffExpr<T> &x )
    {
+      storeDiffValues( x );
       val = x.getValue();
-
-      for( std::size_t i = 0; i < internal::num_directions; i += pack_size<REAL>() )
-         x.getDiffValues( i ).aligned_store( dval + i );
-
       return *this;
    }
 
    //destruct
    ~MultiDiff()
    {
-      internal::release_buffer( dval );
+      releaseBuffer();
    }
 
    //access values / diff values
@@ -166,17 +323,41 @@ public:
       return dval;
    }
 
-
+   /**
+    * Pointer to the derivatives. Entries outside of the active range must not be set to
+    * nonzero values. If the shared seed buffers are used they are copied first.
+    */
    REAL *getDiffValues()
    {
+      if( shared )
+      {
+         REAL *buf = ( REAL * ) internal::new_buffer();
+
+         if( begin < end )
+            std::copy( dval + begin, dval + end, buf + begin );
+
+         dval = buf;
+         shared = false;
+      }
+
       return dval;
    }
 
+   std::size_t activeBegin() const
+   {
+      return begin;
+   }
+
+   std::size_t activeEnd() const
+   {
+      return end;
+   }
+
    void setIndependent( REAL v, std::size_t i )
    {
       val = v;
-      setDiffValsZero();
-      dval[i] = 1;
+      releaseBuffer();
+      shareUnit( i );
    }
 
    //arithmetic modifiers
@@ -196,16 +377,79 @@ public:
 private:
    void setDiffValsZero()
    {
-      pack<REAL> z = zero<REAL>();
+      if( shared )
+      {
+         shareZero();
+      }
+      else
+      {
+         internal::zero_diff_values( dval, begin, end );
+         begin = internal::num_directions;
+         end = 0;
+      }
+   }
 
-      REAL *const end = dval + internal::num_directions;
+   void shareZero()
+   {
+      dval = ( REAL * ) internal::seed_buffers;
+      begin = internal::num_directions;
+      end = 0;
+      shared = true;
+   }
 
-      for( REAL *i = dval; i != end; i += pack_size<REAL>() )
-         z.aligned_store( i );
+   /**
+    * Use the seed buffer of the given position within a pack, shifted such that its
+    * one is at direction i.
+    */
+   void shareUnit( std::size_t i )
+   {
+      const std::size_t l = i % pack_size<REAL>();
+      begin = i - l;
+      end = begin + pack_size<REAL>();
+      dval = ( REAL * ) internal::seed_buffers + 2 * internal::num_directions * l + internal::num_directions - begin;
+      shared = true;
+   }
+
+   void releaseBuffer()
+   {
+      if( dval && !shared )
+      {
+         internal::zero_diff_values( dval, begin, end );
+         internal::release_buffer( dval );
+      }
+   }
+
+   /**
+    * Evaluate the expression x into a buffer of its own. The expression may refer to this
+    * object, so the shared seed buffer is only replaced after the evaluation.
+    */
+   template<typename T>
+   void storeDiffValues( const MultiDiffExpr<T> &x )
+   {
+      if( shared )
+      {
+         REAL *buf = ( REAL * ) internal::new_buffer();
+         std::size_t bufbegin = internal::num_directions;
+         std::size_t bufend = 0;
+         internal::store_diff_values( x, buf, bufbegin, bufend );
+         dval = buf;
+         begin = bufbegin;
+         end = bufend;
+         shared = false;
+      }
+      else
+      {
+         internal::store_diff_values( x, dval, begin, end );
+      }
    }
 
    REAL val;
    REAL *dval;
+   //range of the directions that can be nonzero, all other entries of dval are zero
+   std::size_t begin;
+   std::size_t end;
+   //whether dval points into the seed buffers
+   bool shared;
 };
 
 //Outstream "<<" operator
@@ -284,6 +528,16 @@ public:
       return a.getDiffValues( i ) + b.getDiffValues( i );
    }
 
+   std::size_t activeBegin() const
+   {
+      return std::min( a.activeBegin(), b.activeBegin() );
+   }
+
+   std::size_t activeEnd() const
+   {
+      return std::max( a.activeEnd(), b.activeEnd() );
+   }
+
 private:
    const MultiDiffExpr<A> &a;
    const MultiDiffExpr<B> &b;
@@ -323,6 +577,16 @@ public:
       return b.getDiffValues( i );
    }
 
+   std::size_t activeBegin() const
+   {
+      return b.activeBegin();
+   }
+
+   std::size_t activeEnd() const
+   {
+      return b.activeEnd();
+   }
+
 private:
    REAL a;
    const MultiDiffExpr<T> &b;
@@ -361,6 +625,16 @@ public:
       return a.getDiffValues( i ) - b.getDiffValues( i );
    }
 
+   std::size_t activeBegin() const
+   {
+      return std::min( a.activeBegin(), b.activeBegin() );
+   }
+
+   std::size_t activeEnd() const
+   {
+      return std::max( a.activeEnd(), b.activeEnd() );
+   }
+
 private:
    const MultiDiffExpr<A> &a;
    const MultiDiffExpr<B> &b;
@@ -399,6 +673,16 @@ public:
       return -b.getDiffValues( i );
    }
 
+   std::size_t activeBegin() const
+   {
+      return b.activeBegin();
+   }
+
+   std::size_t activeEnd() const
+   {
+      return b.activeEnd();
+   }
+
 private:
    REAL a;
    const MultiDiffExpr<T> &b;
@@ -437,6 +721,16 @@ public:
       return bval * a.getDiffValues( i ) + aval * b.getDiffValues( i );
    }
 
+   std::size_t activeBegin() const
+   {
+      return std::min( a.activeBegin(), b.activeBegin() );
+   }
+
+   std::size_t activeEnd() const
+   {
+      return std::max( a.activeEnd(), b.activeEnd() );
+   }
+
 private:
    pack<REAL> aval;
    pack<REAL> bval;
@@ -478,6 +772,16 @@ public:
       return aval * b.getDiffValues( i );
    }
 
+   std::size_t activeBegin() const
+   {
+      return b.activeBegin();
+   }
+
+   std::size_t activeEnd() const
+   {
+      return b.activeEnd();
+   }
+
 private:
    pack<REAL> aval;
    const MultiDiffExpr<T> &b;
@@ -519,6 +823,16 @@ public:
       return ( bval * a.getDiffValues( i ) - aval * b.getDiffValues( i ) ) / b2val;
    }
 
+   std::size_t activeBegin() const
+   {
+      return std::min( a.activeBegin(), b.activeBegin() );
+   }
+
+   std::size_t activeEnd() const
+   {
+      return std::max( a.activeEnd(), b.activeEnd() );
+   }
+
 private:
    pack<REAL> aval;
    pack<REAL> bval;
@@ -560,6 +874,16 @@ public:
       return - aval * b.getDiffValues( i ) / b2val;
    }
 
+   std::size_t activeBegin() const
+   {
+      return b.activeBegin();
+   }
+
+   std::size_t activeEnd() const
+   {
+      return b.activeEnd();
+   }
+
 private:
    REAL bval;
    pack<REAL> aval;
@@ -601,6 +925,16 @@ public:
       return a.getDiffValues( i ) / bval;
    }
 
+   std::size_t activeBegin() const
+   {
+      return a.activeBegin();
+   }
+
+   std::size_t activeEnd() const
+   {
+      return a.activeEnd();
+   }
+
 private:
    const MultiDiffExpr<T> &a;
    pack<REAL> bval;
@@ -642,6 +976,16 @@ public:
       return val * x.getDiffValues( i );
    }
 
+   std::size_t activeBegin() const
+   {
+      return x.activeBegin();
+   }
+
+   std::size_t activeEnd() const
+   {
+      return x.activeEnd();
+   }
+
 private:
    pack<REAL> val;
    const MultiDiffExpr<T> &x;
@@ -680,6 +1024,16 @@ public:
       return -x.getDiffValues( i );
    }
 
+   std::size_t activeBegin() const
+   {
+      return x.activeBegin();
+   }
+
+   std::size_t activeEnd() const
+   {
+      return x.activeEnd();
+   }
+
 private:
    const MultiDiffExpr<T> &x;
 };
@@ -697,6 +1051,86 @@ struct NumTypeTraits<MultiDiffNeg<T>>
 };
 
 
+/**
+ * Subexpression that is stored in a temporary because it requires too many simd registers.
+ * Unlike MultiDiff the derivatives are stored in the scratch arena, so that the temporaries
+ * of a full expression do not go through the pool of the MultiDiff buffers.
+ */
+template<typename REAL>
+class MultiDiffTemp : public MultiDiffExpr<MultiDiffTemp<REAL>>
+{
+public:
+   template<typename T>
+   MultiDiffTemp( const MultiDiffExpr<T> &x ) : val( x.getValue() ), begin( internal::num_directions ), end( 0 )
+   {
+      dval = ( REAL * ) internal::new_scratch_buffer();
+
+      internal::store_diff_values( x, dval, begin, end );
+   }
+
+   MultiDiffTemp( const MultiDiffTemp<REAL> &x ) : val( x.val ), begin( internal::num_directions ), end( 0 )
+   {
+      dval = ( REAL * ) internal::new_scratch_buffer();
+
+      internal::store_diff_values( x, dval, begin, end );
+   }
+
+   MultiDiffTemp( MultiDiffTemp<REAL> && x ) : val( x.val ), dval( x.dval ), begin( x.begin ), end( x.end )
+   {
+      x.dval = nullptr;
+   }
+
+   MultiDiffTemp<REAL> &operator=( const MultiDiffTemp<REAL> & ) = delete;
+   MultiDiffTemp<REAL> &operator=( MultiDiffTemp<REAL> && ) = delete;
+
+   ~MultiDiffTemp()
+   {
+      if( dval )
+         internal::zero_diff_values( dval, begin, end );
+
+      internal::release_scratch_buffer( dval );
+   }
+
+   REAL getValue() const
+   {
+      return val;
+   }
+
+   pack<REAL> getDiffValues( std::size_t i ) const
+   {
+      assert( i < internal::num_directions );
+      return aligned_load( dval + i );
+   }
+
+   std::size_t activeBegin() const
+   {
+      return begin;
+   }
+
+   std::size_t activeEnd() const
+   {
+      return end;
+   }
+
+private:
+   REAL val;
+   REAL *dval;
+   std::size_t begin;
+   std::size_t end;
+};
+
+template<typename REAL>
+struct NumTypeTraits<MultiDiffTemp<REAL>>
+{
+   using type = REAL;
+};
+
+template<typename REAL>
+struct SimdTemps<MultiDiffTemp<REAL>>
+{
+   constexpr static int value = 0;
+};
+
 /**
  * Decide if a proxy object is used or if the current subexpression is stored in a temporary
  * to reduce register pressure based on the simd temporaries that are required for the expression.
@@ -707,7 +1141,7 @@ struct ReturnTypeTraits;
 template<typename T, int MAX_TMPS>
 struct ReturnTypeTraits<T, MAX_TMPS, true>
 {
-   using type = MultiDiff<NumType<T>>;
+   using type = MultiDiffTemp<NumType<T>>;
 };
 
 template<typename T, int MAX_TMPS>
@@ -717,7 +1151,7 @@ struct ReturnTypeTraits<T, MAX_TMPS, false>
 };
 
 template<typename T>
-using ReturnType = typename ReturnTypeTraits<T, 8>::type;
+using ReturnType = typename ReturnTypeTraits<T, max_simd_temps()>::type;
 
 template<typename T>
 ReturnType<MultiDiffExp<T>> exp( const MultiDiffExpr<T> &x )
@@ -0,0 +1,83 @@
+// Check of the instruction set of the library against the cpu. This file is compiled for the
+// baseline instruction set, the extensions selected with CPPLSQ_ARCH are passed as the
+// definitions CPPLSQ_HAS_<EXTENSION>, so the check itself can run on any x86 cpu.
+#include "simd_arch.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+namespace cpplsq
+{
+
+const char *simd_arch()
+{
+#if defined(CPPLSQ_HAS_AVX512F)
+   return "avx512f";
+#elif defined(CPPLSQ_HAS_AVX2)
+   return "avx2";
+#elif defined(CPPLSQ_HAS_AVX)
+   return "avx";
+#elif defined(CPPLSQ_HAS_SSE4_1)
+   return "sse4.1";
+#else
+   return "";
+#endif
+}
+
+bool simd_arch_supported()
+{
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+   __builtin_cpu_init();
+   //every extension that the compiler may use, e.g. the avx512 build also uses avx512dq and avx512vl
+   bool supported = true;
+#if defined(CPPLSQ_HAS_AVX512F)
+   supported = supported && __builtin_cpu_supports( "avx512f" );
+#endif
+#if defined(CPPLSQ_HAS_AVX512DQ)
+   supported = supported && __builtin_cpu_supports( "avx512dq" );
+#endif
+#if defined(CPPLSQ_HAS_AVX512VL)
+   supported = supported && __builtin_cpu_supports( "avx512vl" );
+#endif
+#if defined(CPPLSQ_HAS_AVX2)
+   supported = supported && __builtin_cpu_supports( "avx2" );
+#endif
+#if defined(CPPLSQ_HAS_FMA)
+   supported = supported && __builtin_cpu_supports( "fma" );
+#endif
+#if defined(CPPLSQ_HAS_AVX)
+   supported = supported && __builtin_cpu_supports( "avx" );
+#endif
+#if defined(CPPLSQ_HAS_SSE4_1)
+   supported = supported && __builtin_cpu_supports( "sse4.1" );
+#endif
+   return supported;
+#endif
+   return true;
+}
+
+}//cpplsq
+
+#if defined(__GNUC__)
+
+namespace
+{
+
+/**
+ * Checks at startup that the cpu supports the instruction set the library was compiled
+ * for and stops with a message instead of an illegal instruction later on. Runs before
+ * the static initializers of the program, which may already be compiled for the wider
+ * instruction set. The object is linked whenever MultiDiff.cpp is, since that refers
+ * to simd_arch().
+ */
+__attribute__( ( constructor( 101 ) ) ) void check_arch()
+{
+   if( !cpplsq::simd_arch_supported() )
+   {
+      std::fprintf( stderr, "cpplsq: compiled for %s which is not supported by this cpu\n", cpplsq::simd_arch() );
+      std::abort();
+   }
+}
+
+}
+
+#endif
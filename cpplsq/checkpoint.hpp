@@ -0,0 +1,176 @@
+#ifndef _CPPLSQ_CHECKPOINT_HPP_
+#define _CPPLSQ_CHECKPOINT_HPP_
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unistd.h>
+#include <simd/alloc.hpp>
+#include "gn_sbfgs_min.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+constexpr const char *checkpoint_magic()
+{
+   return "CPLSQCP";
+}
+
+struct CheckpointHeader
+{
+   char magic[8];
+   std::uint32_t version;
+   std::uint32_t element_size;
+   std::uint64_t num_parameters;
+   std::int32_t iteration;
+   std::int32_t small_progress;
+   std::uint32_t secant;
+   std::uint32_t reserved;
+};
+
+/**
+ * Return true if the file has at least n items of the given size after the current position.
+ */
+inline bool has_items( std::FILE *f, std::uint64_t n, std::size_t size )
+{
+   const long pos = std::ftell( f );
+
+   if( pos < 0 || std::fseek( f, 0, SEEK_END ) != 0 )
+      return false;
+
+   const long end = std::ftell( f );
+   return end >= pos && std::fseek( f, pos, SEEK_SET ) == 0 && n <= std::uint64_t( end - pos ) / size;
+}
+
+template<typename REAL>
+void read_checkpoint( const std::string &path, simd::aligned_vector<REAL> &params, SbfgsState<REAL> &state )
+{
+   std::FILE *f = std::fopen( path.c_str(), "rb" );
+
+   if( !f )
+      throw std::runtime_error( "cannot open checkpoint " + path );
+
+   CheckpointHeader header;
+   bool ok = std::fread( &header, sizeof( header ), 1, f ) == 1 &&
+             std::strncmp( header.magic, checkpoint_magic(), sizeof( header.magic ) ) == 0 &&
+             header.version == 1 && header.element_size == sizeof( REAL );
+
+   //the parameters and the packed matrix follow the header, check that the file holds them
+   //before allocating, so a corrupted header can not request an arbitrarily large allocation
+   //or make the packed size overflow
+   const std::uint64_t N = ok ? header.num_parameters : 0;
+   ok = ok && N < std::uint64_t( 1 ) << 31 && has_items( f, N + N * ( N + 1 ) / 2, sizeof( REAL ) );
+
+   if( ok )
+   {
+      params.resize( N );
+      state.A.resize( N * ( N + 1 ) / 2 );
+      state.iteration = header.iteration;
+      state.small_progress = header.small_progress;
+      state.secant = header.secant != 0;
+      ok = std::fread( params.data(), sizeof( REAL ), N, f ) == N &&
+           std::fread( state.A.data(), sizeof( REAL ), state.A.size(), f ) == state.A.size();
+   }
+
+   std::fclose( f );
+
+   if( !ok )
+      throw std::runtime_error( path + " is not a valid checkpoint" );
+}
+
+} //internal
+
+/**
+ * \brief Monitor for gn_sbfgs_min that writes a checkpoint every k iterations.
+ *
+ * The checkpoint contains the parameters, the structured secant matrix, the counter of
+ * iterations with small progress and the iteration count. The residuals are evaluated again
+ * when the solve is continued, so their sum of squares is not stored. It is first
+ * written to a temporary file next to the given path which is then renamed, so the file at the
+ * given path is always a complete checkpoint even if the process is killed while writing.
+ * A solve can be continued from the checkpoint with gn_sbfgs_restore().
+ */
+template<typename REAL>
+class Checkpointer
+{
+public:
+   /**
+    * \param path    Name of the checkpoint file.
+    * \param every   Number of iterations between two checkpoints.
+    */
+   Checkpointer( std::string path, int every ) : path( std::move( path ) ), every( every ) {}
+
+   void operator()( const IterationInfo<REAL> &info )
+   {
+      if( info.finished || info.iteration % every != 0 )
+         return;
+
+      internal::CheckpointHeader header;
+      std::memset( &header, 0, sizeof( header ) );
+      std::strncpy( header.magic, internal::checkpoint_magic(), sizeof( header.magic ) );
+      header.version = 1;
+      header.element_size = sizeof( REAL );
+      header.num_parameters = info.N;
+      header.iteration = info.iteration;
+      header.small_progress = info.small_progress;
+      header.secant = info.secant;
+
+      const std::string tmp = path + ".tmp";
+      std::FILE *f = std::fopen( tmp.c_str(), "wb" );
+
+      if( !f )
+         throw std::runtime_error( "cannot write checkpoint " + tmp );
+
+      bool ok = std::fwrite( &header, sizeof( header ), 1, f ) == 1 &&
+                std::fwrite( info.params, sizeof( REAL ), info.N, f ) == info.N;
+
+      //write the lower triangle of A row by row
+      const std::size_t packed = info.N * ( info.N + 1 ) / 2;
+      ok = ok && std::fwrite( info.A, sizeof( REAL ), packed, f ) == packed;
+
+      //make sure the data is on disk before the rename makes it visible
+      ok = ok && std::fflush( f ) == 0 && ::fsync( fileno( f ) ) == 0;
+      ok = std::fclose( f ) == 0 && ok;
+
+      if( !ok || std::rename( tmp.c_str(), path.c_str() ) != 0 )
+      {
+         std::remove( tmp.c_str() );
+         throw std::runtime_error( "cannot write checkpoint " + path );
+      }
+   }
+
+private:
+   std::string path;
+   int every;
+};
+
+/**
+ * \brief Continue gn_sbfgs_min from a checkpoint written by a Checkpointer.
+ *
+ * The residuals and the parameter transform must be the same as in the solve that wrote the
+ * checkpoint. Then the iterations after the restore are the same as the iterations the original
+ * solve performed after writing the checkpoint. The iteration count is restored as well, so MAXITER
+ * limits the total number of iterations of both runs.
+ *
+ * \param checkpoint            Name of the checkpoint file.
+ * \param params                On output the parameters that minimize the sum of squares of the residuals. The input value is ignored.
+ * \param tolerance, residuals, parameterTransform, monitor
+ *                              Same as for gn_sbfgs_min.
+ */
+template<typename VERBOSITY = Verbose , int MAXITER = 1000, typename REAL, typename Residuals, typename ParameterTransform = internal::IdentityTransform, typename Monitor = internal::NoMonitor>
+void gn_sbfgs_restore( const std::string &checkpoint, REAL tolerance, simd::aligned_vector<REAL> &params, Residuals residuals, ParameterTransform parameterTransform = ParameterTransform(), Monitor monitor = Monitor() )
+{
+   internal::SbfgsState<REAL> state;
+   internal::read_checkpoint( checkpoint, params, state );
+   internal::gn_sbfgs_min_impl<VERBOSITY, MAXITER>( tolerance, params, residuals, parameterTransform, monitor, &state );
+}
+
+} //cpplsq
+
+#endif
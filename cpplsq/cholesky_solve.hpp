@@ -5,31 +5,31 @@
 #include <simd/alloc.hpp>
 #include <simd/pack.hpp>
 #include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
 #include "Blas.hpp"
 
 namespace cpplsq
 {
 
 /**
- * \brief Solve Ax = b for symmetric positive definite matrix A using cholesky decomposition.
+ * \brief Compute the cholesky decomposition A = LL^T of a symmetric positive definite matrix A.
  *
- * \param A_         On input a symmetric positive definite matrix.
+ * \param A_         On input the lower triangle of a symmetric positive definite matrix and on output L.
  * \param LDA        leading dimension of A_ must be greater or equal to N.
- * \param b          On input the right hand side of linear system on output the solution.
- * \param N          Size of A and b, i.e. A is a NxN matrix and b is a vector of size N.
+ * \param N          Size of A, i.e. A is a NxN matrix.
  *
- * \return           If matrix is symmetric positive definite then returns 0 else returns the index
- *                   of the diagonal entry k for which the submatrix A(k:N,k:N) was not symmetric
- *                   positive definite.
+ * \return           Same as for cholesky_solve.
  */
 template<typename REAL>
-int cholesky_solve( const simd::aligned_array<REAL> &A_, std::size_t LDA, const simd::aligned_array<REAL> &b, std::size_t N )
+int cholesky_factor( REAL *A_, std::size_t LDA, std::size_t N )
 {
    using namespace simd;
    using std::size_t;
    using std::sqrt;
 
-   auto A = [LDA, &A_]( size_t i, size_t j )-> REAL &
+   auto A = [LDA, A_]( size_t i, size_t j )-> REAL &
    {
       return A_[i * LDA + j];
    };
@@ -61,13 +61,199 @@ int cholesky_solve( const simd::aligned_array<REAL> &A_, std::size_t LDA, const
       blas::scal( N - k - 1, 1 / A( k, k ), &A( k + 1, k ), LDA );
    }
 
+   return 0;
+}
+
+/**
+ * \brief Complete a cholesky decomposition with the modified cholesky decomposition of Gill, Murray and Wright.
+ *
+ * Computes L such that LL^T = A + E with a nonnegative diagonal matrix E that is zero if A is sufficiently positive
+ * definite. The diagonal entries are chosen as max( |d_k|, theta_k^2 / beta^2, delta ) where d_k is the updated diagonal
+ * entry, theta_k the largest updated entry below it, beta^2 = max( gamma, xi / sqrt( N^2 - 1 ), eps ) for the largest
+ * diagonal and off-diagonal entries gamma and xi of the remaining matrix and delta = eps max( gamma + xi, 1 ). This
+ * bounds the entries of L and the size of E.
+ *
+ * The factorization can be continued where cholesky_factor() stopped: if cholesky_factor() returned k > 0 the columns
+ * before k - 1 already contain L and column k - 1 contains the updated entries, so that calling this function with start
+ * k - 1 reuses the work done so far. With start 0 the whole matrix is factorized.
+ *
+ * \param A_         On input the lower triangle of a symmetric matrix, or the partial factor as described above,
+ *                   and on output L.
+ * \param LDA        leading dimension of A_ must be greater or equal to N.
+ * \param N          Size of A, i.e. A is a NxN matrix.
+ * \param start      First column that is not yet factorized. Its entries must already be updated.
+ *
+ * \return           The largest entry of E.
+ */
+template<typename REAL>
+REAL cholesky_factor_modified( REAL *A_, std::size_t LDA, std::size_t N, std::size_t start = 0 )
+{
+   using std::size_t;
+   using std::sqrt;
+   using std::abs;
+
+   auto A = [LDA, A_]( size_t i, size_t j )-> REAL &
+   {
+      return A_[i * LDA + j];
+   };
+
+   const REAL eps = std::numeric_limits<REAL>::epsilon();
+   REAL gamma = 0;
+   REAL xi = 0;
+
+   for( size_t j = start; j < N; ++j )
+   {
+      gamma = std::max( gamma, abs( A( j, j ) ) );
+
+      for( size_t i = j + 1; i < N; ++i )
+         xi = std::max( xi, abs( A( i, j ) ) );
+   }
+
+   const REAL beta2 = std::max( std::max( gamma, N > 1 ? xi / sqrt( REAL( N * N - 1 ) ) : REAL( 0 ) ), eps );
+   const REAL delta = eps * std::max( gamma + xi, REAL( 1 ) );
+   REAL emax = 0;
+
+   for( size_t k = start; k < N; ++k )
+   {
+      if( k > start )
+         blas::gemv( CblasNoTrans, N - k, k, REAL( -1 ), &A( k, 0 ), LDA, &A( k, 0 ), 1, REAL( 1 ), &A( k, k ), LDA );
+
+      REAL theta = 0;
+
+      for( size_t i = k + 1; i < N; ++i )
+         theta = std::max( theta, abs( A( i, k ) ) );
+
+      const REAL d = std::max( std::max( abs( A( k, k ) ), theta * theta / beta2 ), delta );
+      emax = std::max( emax, d - A( k, k ) );
+      A( k, k ) = sqrt( d );
+      blas::scal( N - k - 1, 1 / A( k, k ), &A( k + 1, k ), LDA );
+   }
+
+   return emax;
+}
+
+/**
+ * \brief Solve Ax = b for symmetric positive definite matrix A using cholesky decomposition.
+ *
+ * \param A_         On input a symmetric positive definite matrix.
+ * \param LDA        leading dimension of A_ must be greater or equal to N.
+ * \param b          On input the right hand side of linear system on output the solution.
+ * \param N          Size of A and b, i.e. A is a NxN matrix and b is a vector of size N.
+ *
+ * \return           If matrix is symmetric positive definite then returns 0 else returns the index
+ *                   of the diagonal entry k for which the submatrix A(k:N,k:N) was not symmetric
+ *                   positive definite.
+ */
+template<typename REAL>
+int cholesky_solve( REAL *A_, std::size_t LDA, REAL *b, std::size_t N )
+{
+   int pos = cholesky_factor( A_, LDA, N );
+
+   if( pos )
+      return pos;
+
    //backward substitution
-   blas::trsv( CblasNoTrans, CblasNonUnit, N, A_.get(), LDA, b.get(), 1 );
+   blas::trsv( CblasNoTrans, CblasNonUnit, N, A_, LDA, b, 1 );
    //forward substitution
-   blas::trsv( CblasTrans, CblasNonUnit, N, A_.get(), LDA, b.get(), 1 );
+   blas::trsv( CblasTrans, CblasNonUnit, N, A_, LDA, b, 1 );
    return 0;
 }
 
+template<typename REAL>
+int cholesky_solve( const simd::aligned_array<REAL> &A_, std::size_t LDA, const simd::aligned_array<REAL> &b, std::size_t N )
+{
+   return cholesky_solve( A_.get(), LDA, b.get(), N );
+}
+
+/**
+ * \brief Solve Ax = b for symmetric positive definite matrix A using a cholesky decomposition in the lower
+ *        precision FACTOR and iterative refinement in the precision REAL.
+ *
+ * The correction for the residual b - Ax, which is computed in precision REAL, is solved with the
+ * lower precision factor until the residual is at the level of the rounding errors of REAL, i.e.
+ * |b - Ax| <= |x| |A| eps sqrt(N) in the infinity norm, which is the stopping test of LAPACK's dsposv.
+ * This gives a solution with the accuracy of a factorization in precision REAL for matrices that are
+ * not too badly conditioned.
+ *
+ * \param A_         The lower triangle of a symmetric positive definite matrix. Is not modified.
+ * \param LDA        leading dimension of A_ must be greater or equal to N.
+ * \param b          On input the right hand side of linear system on output the solution. Is only
+ *                   modified if 0 is returned.
+ * \param N          Size of A and b, i.e. A is a NxN matrix and b is a vector of size N.
+ * \param maxiter    Maximum number of refinement steps.
+ *
+ * \return           0 on success, the same as cholesky_solve if the factorization in precision FACTOR failed
+ *                   and -1 if the refinement did not converge within maxiter steps.
+ */
+template<typename FACTOR, typename REAL>
+int cholesky_solve_mixed( const REAL *A_, std::size_t LDA, REAL *b, std::size_t N, int maxiter = 30 )
+{
+   using std::size_t;
+   const size_t LDL = simd::next_size<FACTOR>( N );
+   std::vector<FACTOR> L( N * LDL );
+   std::vector<FACTOR> d( N );
+   std::vector<REAL> x( N, REAL( 0 ) );
+   std::vector<REAL> res( b, b + N );
+   //absolute row sums of the symmetric matrix for its infinity norm
+   std::vector<REAL> rowsum( N, REAL( 0 ) );
+
+   for( size_t i = 0; i < N; ++i )
+   {
+      for( size_t j = 0; j <= i; ++j )
+      {
+         L[i * LDL + j] = FACTOR( A_[i * LDA + j] );
+         rowsum[i] += std::abs( A_[i * LDA + j] );
+
+         if( j < i )
+            rowsum[j] += std::abs( A_[i * LDA + j] );
+      }
+   }
+
+   const REAL anorm = N ? *std::max_element( rowsum.begin(), rowsum.end() ) : REAL( 0 );
+
+   int pos = cholesky_factor( L.data(), LDL, N );
+
+   if( pos )
+      return pos;
+
+   const REAL tol = anorm * std::numeric_limits<REAL>::epsilon() * std::sqrt( REAL( N ) );
+
+   for( int k = 0; k < maxiter; ++k )
+   {
+      //solve for the correction in precision FACTOR
+      std::copy( res.begin(), res.end(), d.begin() );
+      blas::trsv( CblasNoTrans, CblasNonUnit, N, L.data(), LDL, d.data(), 1 );
+      blas::trsv( CblasTrans, CblasNonUnit, N, L.data(), LDL, d.data(), 1 );
+
+      for( size_t i = 0; i < N; ++i )
+         x[i] += d[i];
+
+      //res = b - Ax
+      std::copy( b, b + N, res.begin() );
+      blas::symv( N, REAL( -1 ), A_, LDA, x.data(), 1, REAL( 1 ), res.data(), 1 );
+
+      REAL rmax = 0;
+      REAL xmax = 0;
+
+      for( size_t i = 0; i < N; ++i )
+      {
+         rmax = std::max( rmax, std::abs( res[i] ) );
+         xmax = std::max( xmax, std::abs( x[i] ) );
+      }
+
+      if( !std::isfinite( rmax ) )
+         return -1;
+
+      if( rmax <= xmax * tol )
+      {
+         std::copy( x.begin(), x.end(), b );
+         return 0;
+      }
+   }
+
+   return -1;
+}
+
 } //cpplsq
 
 
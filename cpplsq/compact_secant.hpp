@@ -0,0 +1,248 @@
+#ifndef _CPPLSQ_COMPACT_SECANT_HPP_
+#define _CPPLSQ_COMPACT_SECANT_HPP_
+
+#include <cmath>
+#include <array>
+#include <algorithm>
+#include <simd/alloc.hpp>
+#include "Blas.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Invert the dense n x n matrix A stored row major using Gauß-Jordan elimination
+ * with partial pivoting. A is overwritten. Returns false if A is singular.
+ */
+template<typename REAL>
+bool invert_small( REAL *A, REAL *Ainv, std::size_t n )
+{
+   for( std::size_t i = 0; i < n; ++i )
+      for( std::size_t j = 0; j < n; ++j )
+         Ainv[i * n + j] = i == j ? 1 : 0;
+
+   for( std::size_t k = 0; k < n; ++k )
+   {
+      std::size_t p = k;
+
+      for( std::size_t i = k + 1; i < n; ++i )
+         if( std::abs( A[i * n + k] ) > std::abs( A[p * n + k] ) )
+            p = i;
+
+      if( A[p * n + k] == 0 )
+         return false;
+
+      if( p != k )
+      {
+         std::swap_ranges( A + k * n, A + ( k + 1 ) * n, A + p * n );
+         std::swap_ranges( Ainv + k * n, Ainv + ( k + 1 ) * n, Ainv + p * n );
+      }
+
+      const REAL pivot = 1 / A[k * n + k];
+
+      for( std::size_t j = 0; j < n; ++j )
+      {
+         A[k * n + j] *= pivot;
+         Ainv[k * n + j] *= pivot;
+      }
+
+      for( std::size_t i = 0; i < n; ++i )
+      {
+         const REAL f = A[i * n + k];
+
+         if( i == k || f == 0 )
+            continue;
+
+         for( std::size_t j = 0; j < n; ++j )
+         {
+            A[i * n + j] -= f * A[k * n + j];
+            Ainv[i * n + j] -= f * Ainv[k * n + j];
+         }
+      }
+   }
+
+   return true;
+}
+
+/**
+ * Limited memory representation of the structured secant matrix A. Stores the last MEMORY
+ * pairs (s, z) of steps and structured secant vectors and represents the BFGS matrix obtained
+ * by applying their updates to sigma I in the compact form
+ *
+ *    A = sigma I - W K^-1 W^T,   W = [sigma S  Z],   K = [ sigma S^T S   L ]
+ *                                                        [ L^T          -D ]
+ *
+ * where L is the strictly lower triangle of S^T Z and D its diagonal. Products with A cost
+ * O(MEMORY N) and the storage is O(MEMORY N).
+ */
+template<typename REAL, int MEMORY>
+class CompactSecant
+{
+public:
+   explicit CompactSecant( std::size_t N ) : N( N ), CN( simd::next_size<REAL>( N ) ), count( 0 ), head( 0 ), sigma( 0 )
+   {
+      if( MEMORY > 0 )
+      {
+         //one slot more than pairs for the pair that is added
+         S_ = simd::alloc_aligned_array<REAL>( ( MEMORY + 1 ) * CN );
+         Z_ = simd::alloc_aligned_array<REAL>( ( MEMORY + 1 ) * CN );
+      }
+   }
+
+   /**
+    * Discard all pairs and set A = sigma I.
+    */
+   void init( REAL sigma )
+   {
+      this->sigma = sigma;
+      count = 0;
+      head = 0;
+   }
+
+   /**
+    * Number of stored pairs.
+    */
+   std::size_t size() const
+   {
+      return count;
+   }
+
+   /**
+    * Compute out += A v.
+    */
+   void apply( const REAL *v, REAL *out ) const
+   {
+      blas::axpy( N, sigma, v, 1, out, 1 );
+
+      if( count == 0 )
+         return;
+
+      std::array<REAL, 2 * MEMORY> t;
+      std::array<REAL, 2 * MEMORY> u;
+      const std::size_t n = 2 * count;
+
+      for( std::size_t k = 0; k < count; ++k )
+      {
+         t[k] = sigma * blas::dot( N, s( k ), 1, v, 1 );
+         t[count + k] = blas::dot( N, z( k ), 1, v, 1 );
+      }
+
+      for( std::size_t a = 0; a < n; ++a )
+      {
+         u[a] = 0;
+
+         for( std::size_t b = 0; b < n; ++b )
+            u[a] += Kinv[a * n + b] * t[b];
+      }
+
+      for( std::size_t k = 0; k < count; ++k )
+      {
+         blas::axpy( N, -sigma * u[k], s( k ), 1, out, 1 );
+         blas::axpy( N, -u[count + k], z( k ), 1, out, 1 );
+      }
+   }
+
+   /**
+    * Store the diagonal of A in d.
+    */
+   void diagonal( REAL *d ) const
+   {
+      const std::size_t n = 2 * count;
+      std::array<REAL, 2 * MEMORY> w;
+
+      for( std::size_t j = 0; j < N; ++j )
+      {
+         for( std::size_t k = 0; k < count; ++k )
+         {
+            w[k] = sigma * s( k )[j];
+            w[count + k] = z( k )[j];
+         }
+
+         REAL q = 0;
+
+         for( std::size_t a = 0; a < n; ++a )
+            for( std::size_t b = 0; b < n; ++b )
+               q += w[a] * Kinv[a * n + b] * w[b];
+
+         d[j] = sigma - q;
+      }
+   }
+
+   /**
+    * Add the pair (s, z) which must satisfy s^T z > 0, dropping the oldest pair
+    * if MEMORY pairs are stored. If the middle matrix K of the new pairs is singular
+    * the new pair is dropped instead, A stays unchanged and false is returned.
+    */
+   bool push( const REAL *s_new, const REAL *z_new )
+   {
+      //the new pair goes to the spare slot so the stored pairs survive a failure
+      const std::size_t old_head = head;
+      const std::size_t old_count = count;
+      const std::size_t slot = ( head + count ) % ( MEMORY + 1 );
+
+      std::copy( s_new, s_new + N, S_.get() + slot * CN );
+      std::copy( z_new, z_new + N, Z_.get() + slot * CN );
+
+      if( count == std::size_t( MEMORY ) )
+         head = ( head + 1 ) % ( MEMORY + 1 );
+      else
+         ++count;
+
+      //assemble K for the pairs ordered from oldest to newest and invert it
+      const std::size_t n = 2 * count;
+      std::array<REAL, 4 * MEMORY * MEMORY> K;
+      std::array<REAL, 4 * MEMORY * MEMORY> Kinv_new;
+
+      for( std::size_t i = 0; i < count; ++i )
+      {
+         for( std::size_t j = 0; j < count; ++j )
+         {
+            K[i * n + j] = sigma * blas::dot( N, s( i ), 1, s( j ), 1 );
+            REAL sz = blas::dot( N, s( i ), 1, z( j ), 1 );
+            REAL L = i > j ? sz : 0;
+            K[i * n + count + j] = L;
+            K[( count + j ) * n + i] = L;
+            K[( count + i ) * n + count + j] = i == j ? -sz : 0;
+         }
+      }
+
+      if( !invert_small( K.data(), Kinv_new.data(), n ) )
+      {
+         head = old_head;
+         count = old_count;
+         return false;
+      }
+
+      Kinv = Kinv_new;
+      return true;
+   }
+
+private:
+   const REAL *s( std::size_t k ) const
+   {
+      return S_.get() + ( ( head + k ) % ( MEMORY + 1 ) ) * CN;
+   }
+
+   const REAL *z( std::size_t k ) const
+   {
+      return Z_.get() + ( ( head + k ) % ( MEMORY + 1 ) ) * CN;
+   }
+
+   const std::size_t N;
+   const std::size_t CN;
+   std::size_t count;
+   std::size_t head;
+   REAL sigma;
+   simd::aligned_array<REAL> S_;
+   simd::aligned_array<REAL> Z_;
+   std::array<REAL, 4 * MEMORY * MEMORY> Kinv;
+};
+
+} //internal
+
+} //cpplsq
+
+#endif
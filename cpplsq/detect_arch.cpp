@@ -0,0 +1,21 @@
+// Prints the widest instruction set supported by the cpu that CPPLSQ_ARCH=auto selects.
+// Run by cmake at configure time.
+#include <cstdio>
+
+int main()
+{
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+   __builtin_cpu_init();
+
+   if( __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512dq" ) && __builtin_cpu_supports( "avx512vl" ) )
+      std::printf( "avx512" );
+   else if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+      std::printf( "avx2" );
+   else
+      std::printf( "sse4.1" );
+
+#else
+   std::printf( "sse4.1" );
+#endif
+   return 0;
+}
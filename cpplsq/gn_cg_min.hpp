@@ -0,0 +1,363 @@
+#ifndef _CPPLSQ_GN_CG_MIN_HPP_
+#define _CPPLSQ_GN_CG_MIN_HPP_
+
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <algorithm>
+#include "gn_sbfgs_min.hpp"
+#include "compact_secant.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Number of directions of the MultiDiff objects used by the matrix free
+ * model to accumulate products with the transposed Jacobian.
+ */
+template<typename REAL>
+constexpr std::size_t jacobian_chunk_size()
+{
+   return simd::next_size<REAL>( 32 );
+}
+
+/**
+ * Gauß-Newton model of the sum of squares that never forms the Jacobian or the Gram matrix.
+ * Products J v are computed with one SingleDiff sweep over the residuals in direction v and
+ * products J^T u are accumulated with MultiDiff sweeps over chunks of jacobian_chunk_size()
+ * parameters, so the memory is O(N + M). The step solves (J^T J + A) s = -g using
+ * conjugate gradients preconditioned with the diagonal of J^T J + A.
+ *
+ * For MEMORY = 0 the matrix A is the regularization sigma I with sigma = 1e-4 |r| at the current
+ * parameters. Otherwise A is the structured
+ * secant matrix of gn_sbfgs_min in the limited memory form of CompactSecant built from the last
+ * MEMORY steps, and the memory is O(MEMORY N + M). Like in gn_sbfgs_min the regularized Gauß-Newton
+ * matrix J^T J + |r| I is used after a step that does not satisfy the curvature condition.
+ */
+template<typename VERBOSITY, typename REAL, typename Residuals, typename ParameterTransform, int MEMORY = 0>
+class MatrixFreeModel
+{
+public:
+   using MD = MultiDiff<REAL>;
+   using SD = SingleDiff<REAL>;
+   using array = simd::aligned_array<REAL>;
+
+   /**
+    * Must be constructed after the MultiDiff::Context for num_directions( N ) directions.
+    */
+   MatrixFreeModel( std::size_t N, Residuals &residuals, ParameterTransform &pt ) :
+      N( N ), CN( simd::next_size<REAL>( N ) ), M( residuals.size() ), C( num_directions( N ) ), residuals( residuals ), pt( pt ),
+      ad_params( new MD[N] ), directed_ad_params( new SD[N] ), u( new REAL[M] ), r( new REAL[M] ), A_( N ),
+      normr( 0 ), have_point( false ), secant( true ), cg_iterations( 0 )
+   {
+      x = simd::alloc_aligned_array<REAL>( CN );
+      x_prev = simd::alloc_aligned_array<REAL>( CN );
+      z = simd::alloc_aligned_array<REAL>( CN );
+      a = simd::alloc_aligned_array<REAL>( CN );
+      g = simd::alloc_aligned_array<REAL>( CN );
+      d = simd::alloc_aligned_array<REAL>( CN );
+      res = simd::alloc_aligned_array<REAL>( CN );
+      w = simd::alloc_aligned_array<REAL>( CN );
+      p = simd::alloc_aligned_array<REAL>( CN );
+      q = simd::alloc_aligned_array<REAL>( CN );
+   }
+
+   /**
+    * Number of directions for the MultiDiff::Context.
+    */
+   static std::size_t num_directions( std::size_t N )
+   {
+      return std::min( N, jacobian_chunk_size<REAL>() );
+   }
+
+   /**
+    * Evaluate the residuals at the given parameters, compute the gradient g and the
+    * diagonal of J^T J and return the sum of squared residuals.
+    */
+   REAL evaluate( const REAL *params )
+   {
+      if( MEMORY > 0 && have_point )
+         std::copy( x.get(), x.get() + N, x_prev.get() );
+
+      std::copy( params, params + N, x.get() );
+      have_point = true;
+      return accumulate( x.get(), nullptr, g.get(), d.get() );
+   }
+
+   void init( REAL normr2, const SbfgsState<REAL> *restart )
+   {
+      assert( !restart );
+      A_.init( 1e-4 * std::sqrt( normr2 ) );
+      A_.diagonal( a.get() );
+      secant = true;
+   }
+
+   const REAL *gradient() const
+   {
+      return g.get();
+   }
+
+   /**
+    * Approximately solve (J^T J + A) s = -g with preconditioned conjugate gradients.
+    * The iteration stops when the residual is reduced by the factor min(0.5, sqrt(|g|))
+    * so that the steps become more accurate close to the solution. Falls back to the
+    * steepest descent direction and returns false if no descent direction was found.
+    */
+   bool direction( REAL *s )
+   {
+      const pack<REAL> zp = zero<REAL>();
+      aligned_fill( zp, s, s + CN );
+      aligned_fill( zp, w.get(), w.get() + CN );
+      aligned_fill( zp, p.get(), p.get() + CN );
+
+      for( std::size_t j = 0; j < N; ++j )
+      {
+         res[j] = -g[j];
+         w[j] = res[j] / ( d[j] + regularization( j ) );
+         p[j] = w[j];
+      }
+
+      REAL rw = blas::dot( N, res.get(), 1, w.get(), 1 );
+      const REAL normg = blas::nrm2( N, g.get(), 1 );
+      const REAL target = std::min( REAL( 0.5 ), std::sqrt( normg ) ) * normg;
+
+      for( cg_iterations = 0; cg_iterations < N; )
+      {
+         apply( p.get(), q.get() );
+         REAL pq = blas::dot( N, p.get(), 1, q.get(), 1 );
+
+         if( !( pq > 0 ) )
+            break;
+
+         REAL a = rw / pq;
+         blas::axpy( N, a, p.get(), 1, s, 1 );
+         blas::axpy( N, -a, q.get(), 1, res.get(), 1 );
+         ++cg_iterations;
+
+         if( blas::nrm2( N, res.get(), 1 ) <= target )
+            break;
+
+         for( std::size_t j = 0; j < N; ++j )
+            w[j] = res[j] / ( d[j] + regularization( j ) );
+
+         REAL rw_new = blas::dot( N, res.get(), 1, w.get(), 1 );
+         REAL beta = rw_new / rw;
+         rw = rw_new;
+
+         for( std::size_t j = 0; j < N; ++j )
+            p[j] = w[j] + beta * p[j];
+      }
+
+      if( cg_iterations == 0 )
+      {
+         aligned_transform( []( const pack<REAL> &g )
+         {
+            return -g;
+         }, s, s + CN, g.get() );
+         return false;
+      }
+
+      return true;
+   }
+
+   /**
+    * Update A for the given step s which changed the sum of squared residuals from
+    * normr2 to new_normr2. Must be called after evaluating the residuals at the new
+    * parameters. Computes z = (J1 - J0)^T r1 with one sweep at the previous parameters.
+    */
+   void update( REAL *s, REAL normr2, REAL new_normr2 )
+   {
+      if( MEMORY == 0 )
+      {
+         //the regularization shrinks with the residual as in the Gauß-Newton model of gn_sbfgs_min
+         A_.init( 1e-4 * std::sqrt( new_normr2 ) );
+         A_.diagonal( a.get() );
+         internal::Stream<VERBOSITY>() << "H: GN    " << "cg: " << cg_iterations << "\n";
+         return;
+      }
+
+      //z = J1^T r1 - J0^T r1
+      accumulate( x_prev.get(), r.get(), z.get(), nullptr );
+
+      for( std::size_t j = 0; j < N; ++j )
+         z[j] = g[j] - z[j];
+
+      blas::scal( N, std::sqrt( new_normr2 / normr2 ), z.get(), 1 );
+
+      REAL zs = blas::dot( N, z.get(), 1, s, 1 );
+
+      //the pair is dropped if it makes the compact form singular
+      if( zs / blas::dot( N, s, 1, s, 1 ) >= 1e-6 && A_.push( s, z.get() ) )
+      {
+         internal::Stream<VERBOSITY>() << "H: SBFGS " << "cg: " << cg_iterations << "\n";
+         A_.diagonal( a.get() );
+         secant = true;
+      }
+      else
+      {
+         internal::Stream<VERBOSITY>() << "H: GN    " << "cg: " << cg_iterations << "\n";
+         normr = std::sqrt( new_normr2 );
+         secant = false;
+      }
+   }
+
+   void describe( IterationInfo<REAL> &info ) const
+   {
+      info.A = nullptr;
+      info.secant = MEMORY > 0 && secant;
+   }
+
+   /**
+    * Compute out = (J^T J + A) v at the parameters of the last evaluation.
+    */
+   void apply( const REAL *v, REAL *out )
+   {
+      //u = J v using one sweep in direction v
+      for( std::size_t j = 0; j < N; ++j )
+         directed_ad_params[j] = x[j], v[j];
+
+      {
+         auto tp = pt( directed_ad_params.get() );
+
+         for( std::size_t i = 0; i < M; ++i )
+         {
+            SD residual = residuals[i]( tp );
+            u[i] = residual.getDiffValue();
+         }
+      }
+
+      //out = J^T u + A v
+      accumulate( x.get(), u.get(), out, nullptr );
+
+      if( secant )
+         A_.apply( v, out );
+      else
+         blas::axpy( N, normr, v, 1, out, 1 );
+   }
+
+private:
+   REAL regularization( std::size_t j ) const
+   {
+      return secant ? a[j] : normr;
+   }
+
+   /**
+    * Compute out = J^T u, or out = J^T r if u is null, at the given point by sweeping over the
+    * residuals once for each chunk of C parameters. If u is null the residual values are stored
+    * in r and if diag is not null the diagonal of J^T J is stored in it. Returns the sum of squared
+    * residuals.
+    */
+   REAL accumulate( const REAL *point, const REAL *weights, REAL *out, REAL *diag )
+   {
+      const pack<REAL> zp = zero<REAL>();
+      aligned_fill( zp, out, out + CN );
+
+      if( diag )
+         aligned_fill( zp, diag, diag + CN );
+
+      REAL normr2 = 0;
+
+      for( std::size_t c0 = 0; c0 < N; c0 += C )
+      {
+         const std::size_t nc = std::min( C, N - c0 );
+
+         for( std::size_t j = 0; j < N; ++j )
+         {
+            if( j >= c0 && j < c0 + nc )
+               ad_params[j].setIndependent( point[j], j - c0 );
+            else
+               ad_params[j] = point[j];
+         }
+
+         auto tp = pt( ad_params.get() );
+
+         for( std::size_t i = 0; i < M; ++i )
+         {
+            MD residual = residuals[i]( tp );
+            const REAL *dr = residual.getDiffValues();
+
+            if( c0 == 0 )
+            {
+               normr2 += residual.getValue() * residual.getValue();
+
+               if( !weights )
+                  r[i] = residual.getValue();
+            }
+
+            blas::axpy( nc, weights ? weights[i] : residual.getValue(), dr, 1, out + c0, 1 );
+
+            if( diag )
+            {
+               for( std::size_t j = 0; j < nc; ++j )
+                  diag[c0 + j] += dr[j] * dr[j];
+            }
+         }
+      }
+
+      return normr2;
+   }
+
+   const std::size_t N;
+   const std::size_t CN;
+   const std::size_t M;
+   const std::size_t C;
+   Residuals &residuals;
+   ParameterTransform &pt;
+   std::unique_ptr<MD[]> ad_params;
+   std::unique_ptr<SD[]> directed_ad_params;
+   std::unique_ptr<REAL[]> u;
+   std::unique_ptr<REAL[]> r;
+   CompactSecant<REAL, MEMORY> A_;
+   array x;
+   array x_prev;
+   array z;
+   array a;
+   array g;
+   array d;
+   array res;
+   array w;
+   array p;
+   array q;
+   REAL normr;
+   bool have_point;
+   bool secant;
+   std::size_t cg_iterations;
+};
+
+} //internal
+
+/**
+ * \brief Compute parameters such that the sum of squares of the (nonlinear) residuals is minimized using
+ *        a matrix free Gauß-Newton method.
+ *
+ * The Gauß-Newton steps are computed with preconditioned conjugate gradients that only require products
+ * of the Jacobian with vectors, so neither the Jacobian nor the NxN Gram matrix is formed and no cholesky
+ * decomposition is needed. The memory is O(N + M) which makes this suitable for problems with many parameters.
+ * Each conjugate gradient iteration costs one SingleDiff sweep and N / jacobian_chunk_size() MultiDiff sweeps
+ * over the residuals. The line search and the termination criteria are the same as for gn_sbfgs_min.
+ *
+ * The arguments are the same as for gn_sbfgs_min.
+ */
+template<typename VERBOSITY = Verbose , int MAXITER = 1000, typename REAL, typename Residuals, typename ParameterTransform = internal::IdentityTransform, typename Monitor = internal::NoMonitor>
+void gn_cg_min( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals residuals, ParameterTransform parameterTransform = ParameterTransform(), Monitor monitor = Monitor() )
+{
+   using Model = internal::MatrixFreeModel<VERBOSITY, REAL, Residuals, ParameterTransform>;
+   const std::size_t N = params.size();
+   typename MultiDiff<REAL>::Context ctx( Model::num_directions( N ) );
+   {
+      //move into scope that gets destroyed before the MultiDiff::Context
+      ParameterTransform pt = std::move( parameterTransform );
+      //now call init function of tranformator
+      pt.num_parameters( N );
+
+      Model model( N, residuals, pt );
+      internal::line_search_min<VERBOSITY, MAXITER>( tolerance, params, residuals, pt, model, monitor, static_cast<const internal::SbfgsState<REAL> *>( nullptr ) );
+   } //ctx gets destroyed
+} //end of gn_cg_min
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _CPPLSQ_GN_LSBFGS_MIN_HPP_
+#define _CPPLSQ_GN_LSBFGS_MIN_HPP_
+
+#include "gn_cg_min.hpp"
+
+namespace cpplsq
+{
+
+/**
+ * \brief Compute parameters such that the sum of squares of the (nonlinear) residuals is minimized using
+ *        a limited memory structured BFGS method.
+ *
+ * Uses the same structured secant update as gn_sbfgs_min but only stores the last MEMORY pairs of steps and
+ * secant vectors and applies the update in compact form. The steps are computed matrix free like in gn_cg_min,
+ * so neither the NxN secant matrix nor the Gram matrix is stored and the memory is O(MEMORY N + M) instead of
+ * O(N^2). Each iteration costs one additional sweep over the residuals at the previous parameters to compute
+ * the secant vector.
+ *
+ * The arguments are the same as for gn_sbfgs_min.
+ *
+ * \tparam MEMORY   Number of stored pairs.
+ */
+template<typename VERBOSITY = Verbose , int MAXITER = 1000, int MEMORY = 8, typename REAL, typename Residuals, typename ParameterTransform = internal::IdentityTransform, typename Monitor = internal::NoMonitor>
+void gn_lsbfgs_min( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals residuals, ParameterTransform parameterTransform = ParameterTransform(), Monitor monitor = Monitor() )
+{
+   static_assert( MEMORY > 0, "MEMORY must be positive" );
+   using Model = internal::MatrixFreeModel<VERBOSITY, REAL, Residuals, ParameterTransform, MEMORY>;
+   const std::size_t N = params.size();
+   typename MultiDiff<REAL>::Context ctx( Model::num_directions( N ) );
+   {
+      //move into scope that gets destroyed before the MultiDiff::Context
+      ParameterTransform pt = std::move( parameterTransform );
+      //now call init function of tranformator
+      pt.num_parameters( N );
+
+      Model model( N, residuals, pt );
+      internal::line_search_min<VERBOSITY, MAXITER>( tolerance, params, residuals, pt, model, monitor, static_cast<const internal::SbfgsState<REAL> *>( nullptr ) );
+   } //ctx gets destroyed
+} //end of gn_lsbfgs_min
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef _CPPLSQ_GN_QR_MIN_HPP_
+#define _CPPLSQ_GN_QR_MIN_HPP_
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include "regularized_gn.hpp"
+#include "tsqr.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Gauß-Newton model of the sum of squares that computes the steps from a QR decomposition of
+ * the Jacobian instead of the Gram matrix. The step minimizes |J s + r|^2 + sigma |s|^2, which
+ * is the R factor of the matrix [J r] stacked on top of [sqrt(sigma) I 0]: for R = [R1 c] the
+ * step is s = -R1^-1 c. The condition number of R1 is the one of J instead of its square.
+ */
+template<typename VERBOSITY, typename REAL, typename Residuals, typename ParameterTransform>
+class QrModel : public RegularizedGnModel<QrModel<VERBOSITY, REAL, Residuals, ParameterTransform>, VERBOSITY, REAL>
+{
+   using Base = RegularizedGnModel<QrModel, VERBOSITY, REAL>;
+   using Base::CN;
+   using Base::g;
+   using Base::sigma;
+
+public:
+   using MD = MultiDiff<REAL>;
+   using array = simd::aligned_array<REAL>;
+
+   /**
+    * Must be constructed after the MultiDiff::Context for N directions.
+    */
+   QrModel( std::size_t N, Residuals &residuals, ParameterTransform &pt, std::size_t num_threads ) :
+      Base( N ), N( N ), LD( simd::next_size<REAL>( N + 1 ) ), M( residuals.size() ),
+      residuals( residuals ), pt( pt ), ad_params( new MD[N] ), pool( num_threads ), tsqr( pool )
+   {
+      Jr_ = simd::alloc_aligned_array<REAL>( M * LD );
+      R_ = simd::alloc_aligned_array<REAL>( ( 2 * N + 1 ) * LD );
+   }
+
+   /**
+    * Evaluate the residuals at the given parameters, compute the gradient g and store the
+    * rows of [J r] and return the sum of squared residuals.
+    */
+   REAL evaluate( const REAL *params )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+         ad_params[i].setIndependent( params[i], i );
+
+      aligned_fill( zero<REAL>(), g.get(), g.get() + CN );
+      auto tp = pt( ad_params.get() );
+      REAL normr2 = 0;
+
+      for( std::size_t i = 0; i < M; ++i )
+      {
+         MD residual = residuals[i]( tp );
+         normr2 += residual.getValue() * residual.getValue();
+         blas::axpy( N, residual.getValue(), residual.getDiffValues(), 1, g.get(), 1 );
+
+         REAL *row = Jr_.get() + i * LD;
+         std::copy( residual.getDiffValues(), residual.getDiffValues() + N, row );
+         row[N] = residual.getValue();
+      }
+
+      return normr2;
+   }
+
+   /**
+    * Compute the step s = -(J^T J + sigma I)^-1 g from the QR decomposition. The rows of [J r]
+    * are overwritten. If R1 is singular the steepest descent direction -g is used and false is
+    * returned.
+    */
+   bool direction( REAL *s )
+   {
+      tsqr.factor( Jr_.get(), LD, M, N + 1, R_.get(), LD );
+
+      //append the rows of [sqrt(sigma) I 0] and factorize again
+      const REAL root = std::sqrt( sigma );
+
+      for( std::size_t j = 0; j < N; ++j )
+      {
+         REAL *row = R_.get() + ( N + 1 + j ) * LD;
+         std::fill( row, row + N + 1, REAL( 0 ) );
+         row[j] = root;
+      }
+
+      householder_qr( R_.get(), LD, 2 * N + 1, N + 1 );
+
+      //back substitution for R1 s = -c
+      bool ok = true;
+
+      for( std::size_t k = N; ok && k-- > 0; )
+      {
+         const REAL *row = R_.get() + k * LD;
+         REAL v = -row[N];
+
+         for( std::size_t j = k + 1; j < N; ++j )
+            v -= row[j] * s[j];
+
+         s[k] = v / row[k];
+         ok = row[k] != 0 && std::isfinite( s[k] );
+      }
+
+      if( !ok )
+         return this->steepest_descent( s );
+
+      std::fill( s + N, s + CN, REAL( 0 ) );
+      return true;
+   }
+
+   void report() const
+   {
+      internal::Stream<VERBOSITY>() << "panels: " << tsqr.panels();
+   }
+
+private:
+   const std::size_t N;
+   const std::size_t LD;
+   const std::size_t M;
+   Residuals &residuals;
+   ParameterTransform &pt;
+   std::unique_ptr<MD[]> ad_params;
+   ThreadPool pool;
+   Tsqr<REAL> tsqr;
+   array Jr_;
+   array R_;
+};
+
+} //internal
+
+/**
+ * \brief Compute parameters such that the sum of squares of the (nonlinear) residuals is minimized using
+ *        a Gauß-Newton method with a QR decomposition of the Jacobian.
+ *
+ * Suitable for tall Jacobians that are badly conditioned. Instead of forming J^T J, which squares the condition
+ * number, the step is computed from a communication avoiding QR decomposition (TSQR): the rows of the Jacobian
+ * are split into panels that are factorized on separate threads and their R factors are merged in a reduction tree.
+ * A structured secant update is not used since it would require J^T J, whose condition number is avoided.
+ *
+ * \param num_threads   Number of threads used for the decomposition. If zero the number of hardware threads is used.
+ *
+ * The other arguments are the same as for gn_sbfgs_min.
+ */
+template<typename VERBOSITY = Verbose , int MAXITER = 1000, typename REAL, typename Residuals, typename ParameterTransform = internal::IdentityTransform, typename Monitor = internal::NoMonitor>
+void gn_qr_min( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals residuals, ParameterTransform parameterTransform = ParameterTransform(), Monitor monitor = Monitor(), std::size_t num_threads = 0 )
+{
+   const std::size_t N = params.size();
+   typename MultiDiff<REAL>::Context ctx( N );
+   {
+      //move into scope that gets destroyed before the MultiDiff::Context
+      ParameterTransform pt = std::move( parameterTransform );
+      //now call init function of tranformator
+      pt.num_parameters( N );
+
+      internal::QrModel<VERBOSITY, REAL, Residuals, ParameterTransform> model( N, residuals, pt, num_threads );
+      internal::line_search_min<VERBOSITY, MAXITER>( tolerance, params, residuals, pt, model, monitor, static_cast<const internal::SbfgsState<REAL> *>( nullptr ) );
+   } //ctx gets destroyed
+} //end of gn_qr_min
+
+} //cpplsq
+
+#endif
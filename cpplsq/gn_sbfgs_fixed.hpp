@@ -0,0 +1,257 @@
+#ifndef _CPPLSQ_GN_SBFGS_FIXED_HPP_
+#define _CPPLSQ_GN_SBFGS_FIXED_HPP_
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include "gn_sbfgs_min.hpp"
+#include "FixedDiff.hpp"
+#include "small_blas.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Storage for the Jacobian rows of the previous evaluation. If the number of residuals is
+ * known at compile time, i.e. the residuals are given in a std::array, the rows are kept
+ * on the stack and otherwise they are allocated once.
+ */
+template<typename REAL, std::size_t N, typename Residuals>
+class FixedRows
+{
+public:
+   explicit FixedRows( std::size_t M ) : rows( M ) {}
+
+   std::array<REAL, N> &operator[]( std::size_t i )
+   {
+      return rows[i];
+   }
+
+private:
+   std::vector<std::array<REAL, N>> rows;
+};
+
+template<typename REAL, std::size_t N, typename F, std::size_t M>
+class FixedRows<REAL, N, std::array<F, M>>
+{
+public:
+   explicit FixedRows( std::size_t ) {}
+
+   std::array<REAL, N> &operator[]( std::size_t i )
+   {
+      return rows[i];
+   }
+
+private:
+   std::array<std::array<REAL, N>, M> rows;
+};
+
+/**
+ * Same as SbfgsModel for a number of parameters N that is known at compile time. The residuals
+ * are evaluated with FixedDiff and all vectors and the packed matrices A and B are stored in
+ * fixed size arrays. The cholesky decomposition and the triangular solves have fixed trip
+ * counts and call no blas routine.
+ */
+template<typename VERBOSITY, typename REAL, std::size_t N, typename Residuals, typename ParameterTransform>
+class FixedSbfgsModel
+{
+public:
+   using FD = FixedDiff<REAL, N>;
+   static constexpr std::size_t NP = packed_size( N );
+
+   FixedSbfgsModel( Residuals &residuals, ParameterTransform &pt ) :
+      M( residuals.size() ), residuals( residuals ), pt( pt ), rows( M ), have_rows( false ), secant( true )
+   {
+      A_.fill( 0 );
+   }
+
+   /**
+    * Same as SbfgsModel::evaluate().
+    */
+   REAL evaluate( const REAL *params )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+         ad_params[i].setIndependent( params[i], i );
+
+      B_.fill( 0 );
+      g.fill( 0 );
+      z.fill( 0 );
+
+      auto tp = pt( ad_params.data() );
+      REAL normr2 = 0;
+
+      for( std::size_t i = 0; i < M; ++i )
+      {
+         FD residual = residuals[i]( tp );
+         const REAL rval = residual.getValue();
+         const REAL *dr = residual.getDiffValues();
+         std::array<REAL, N> &row = rows[i];
+         normr2 += rval * rval;
+
+         for( std::size_t j = 0; j < N; ++j )
+         {
+            g[j] += rval * dr[j];
+
+            if( have_rows )
+               z[j] += rval * ( dr[j] - row[j] );
+
+            row[j] = dr[j];
+         }
+
+         SmallSpr<N>::run( REAL( 1 ), dr, B_.data() );
+      }
+
+      have_rows = true;
+      return normr2;
+   }
+
+   void init( REAL normr2, const SbfgsState<REAL> *restart )
+   {
+      if( restart )
+      {
+         secant = restart->secant;
+         std::copy( restart->A.begin(), restart->A.end(), A_.begin() );
+      }
+      else
+      {
+         REAL normr = 1e-4 * std::sqrt( normr2 );
+
+         for( std::size_t i = 0; i < N; ++i )
+            A_[packed_index( i, i )] = normr;
+      }
+
+      if( secant )
+         addA();
+      else
+         addIdentity( std::sqrt( normr2 ) );
+   }
+
+   const REAL *gradient() const
+   {
+      return g.data();
+   }
+
+   /**
+    * Same as SbfgsModel::direction().
+    */
+   bool direction( REAL *s )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+         s[i] = -g[i];
+
+      int pos = packed_cholesky_factor<N>( B_.data() );
+
+      if( pos )
+         packed_cholesky_factor_modified( B_.data(), N, pos - 1 );
+
+      SmallTpsv<N>::run( false, false, B_.data(), s );
+      SmallTpsv<N>::run( true, false, B_.data(), s );
+
+      if( !std::isfinite( dot( s, s ) ) )
+      {
+         for( std::size_t i = 0; i < N; ++i )
+            s[i] = -g[i];
+      }
+
+      return pos == 0;
+   }
+
+   /**
+    * Same as SbfgsModel::update().
+    */
+   void update( REAL *s, REAL normr2, REAL new_normr2 )
+   {
+      const REAL scale = std::sqrt( new_normr2 / normr2 );
+
+      for( std::size_t i = 0; i < N; ++i )
+         z[i] *= scale;
+
+      REAL zs = dot( z.data(), s );
+
+      if( zs / dot( s, s ) >= 1e-6 )
+      {
+         internal::Stream<VERBOSITY>() << "H: SBFGS\n";
+         SmallSpmv<N>::run( REAL( 1 ), A_.data(), s, REAL( 0 ), As.data() );
+         REAL sAs = dot( s, As.data() );
+         SmallSpr<N>::run( -1 / sAs, As.data(), A_.data() );
+         SmallSpr<N>::run( 1 / zs, z.data(), A_.data() );
+         addA();
+         secant = true;
+      }
+      else
+      {
+         internal::Stream<VERBOSITY>() << "H: GN\n";
+         addIdentity( std::sqrt( new_normr2 ) );
+         secant = false;
+      }
+   }
+
+   void describe( IterationInfo<REAL> &info ) const
+   {
+      info.A = A_.data();
+      info.secant = secant;
+   }
+
+private:
+   static REAL dot( const REAL *x, const REAL *y )
+   {
+      REAL result;
+      SmallDot<N>::run( x, 1, y, 1, &result );
+      return result;
+   }
+
+   void addA()
+   {
+      for( std::size_t i = 0; i < NP; ++i )
+         B_[i] += A_[i];
+   }
+
+   void addIdentity( REAL val )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+         B_[packed_index( i, i )] += val;
+   }
+
+   const std::size_t M;
+   Residuals &residuals;
+   ParameterTransform &pt;
+   std::array<FD, N> ad_params;
+   FixedRows<REAL, N, Residuals> rows;
+   std::array<REAL, N> g;
+   std::array<REAL, N> z;
+   std::array<REAL, N> As;
+   std::array<REAL, NP> B_;
+   std::array<REAL, NP> A_;
+   bool have_rows;
+   bool secant;
+};
+
+} //internal
+
+/**
+ * \brief Same as gn_sbfgs_min for a number of parameters N that is known at compile time.
+ *
+ * The derivatives are computed with FixedDiff instead of MultiDiff, so no MultiDiff::Context is created, and all
+ * vectors and matrices of the algorithm are fixed size arrays on the stack. The cholesky decomposition and the
+ * triangular solves are unrolled for the given N. If the residuals are given in a std::array no memory is
+ * allocated at all; otherwise only the storage for the previous Jacobian is allocated once. The residual functors
+ * and the parameter transform are called with pointers to FixedDiff<REAL, N> for the derivatives.
+ *
+ * The arguments are the same as for gn_sbfgs_min.
+ */
+template<std::size_t N, typename VERBOSITY = Verbose , int MAXITER = 1000, typename REAL, typename Residuals, typename ParameterTransform = internal::IdentityTransform, typename Monitor = internal::NoMonitor>
+void gn_sbfgs_min( REAL tolerance, std::array<REAL, N> &params, Residuals residuals, ParameterTransform parameterTransform = ParameterTransform(), Monitor monitor = Monitor() )
+{
+   ParameterTransform &pt = parameterTransform;
+   pt.num_parameters( N );
+
+   internal::FixedSbfgsModel<VERBOSITY, REAL, N, Residuals, ParameterTransform> model( residuals, pt );
+   internal::line_search_min<VERBOSITY, MAXITER>( tolerance, params, residuals, pt, model, monitor, static_cast<const internal::SbfgsState<REAL> *>( nullptr ) );
+} //end of gn_sbfgs_min
+
+} //cpplsq
+
+#endif
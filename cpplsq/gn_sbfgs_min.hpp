@@ -1,9 +1,14 @@
 #ifndef _CPPLSQ_GN_SBFGS_MIN_HPP_
 #define _CPPLSQ_GN_SBFGS_MIN_HPP_
 
+#include <array>
 #include <memory>
+#include <vector>
 #include <functional>
 #include <cmath>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
 #include <iostream>
 #include <iomanip>
 #include <simd/alloc.hpp>
@@ -12,6 +17,8 @@
 #include "MultiDiff.hpp"
 #include "SingleDiff.hpp"
 #include "cholesky_solve.hpp"
+#include "packed_cholesky.hpp"
+#include "tiled_cholesky.hpp"
 #include "line_search.hpp"
 
 
@@ -24,6 +31,17 @@ using namespace simd;
 struct Verbose {};
 struct Silent {};
 
+/**
+ * Flags for the parts of gn_sbfgs_min_mixed that use single precision.
+ */
+enum MixedPrecision
+{
+   /// store the Jacobian rows and accumulate the Gram matrix of panels of rows in float
+   MixedJacobian = 1,
+   /// factorize B in float and refine the step in double, falling back to a double factorization
+   MixedFactor = 2
+};
+
 namespace internal
 {
 struct IdentityTransform
@@ -42,6 +60,15 @@ struct IdentityTransform
    void num_parameters( std::size_t N ) const {}
 };
 
+/**
+ * Monitor that ignores all iterations.
+ */
+struct NoMonitor
+{
+   template<typename INFO>
+   void operator()( const INFO &info ) const {}
+};
+
 
 template<typename VERBOSITY>
 struct Stream;
@@ -70,270 +97,965 @@ struct Stream<Silent>
 }
 
 /**
- * \brief Compute parameters such that the sum of squares of the (nonlinear) residuals is minimized.
- *
- * \param tolerance             Value to use for tolerance. If the change in the function value (sum of squared residuals) is smaller than tolerance
- *                              for 15 consecutive iterations or if the max norm of the gradient is smaller than tolerance the algorithm terminates.
- * \param params                On input contains the initial parameters and on output the parameters that minimize the sum of squares of the residuals.
- * \param residuals             An array or vector of residual functors. The input of each functor is a pointer to parameters to use for the computation.
- *                              The type of parameters may is a SingleDiff or MultiDiff type to compute derivatives together with function values and thus
- *                              the functors must be templated to accept different types.
- * \param parameterTransform    An optional functor that may perform a transformation on the parameters. Defaults to identity function i.e. no transformation.
- *                              If a reference is returned a copy will be made so use a pointer if this is unwanted. If this parameter is used the input
- *                              of the residual functors will be the type of the transformed parameters as returned by this functor. The functor must not
- *                              preallocate any MultiDiff objects until its member function num_parameters(N) is called which happens after the MultiDiff
- *                              context is initialized.
- * \tparam VERBOSITY            If set to cpplsq::Verbose then there will be output to stdout in each iteration. If set to cpplsq::Silent then there is no output.
- *                              Default value is cpplsq::Verbose.
- * \tparam MAXITER              Maximum number of iterations that will be performed. Default value is 1000.
- *
+ * Information about the state of gn_sbfgs_min after an iteration
+ * that is passed to the monitor.
  */
-template<typename VERBOSITY = Verbose , int MAXITER = 1000, typename REAL, typename Residuals, typename ParameterTransform = internal::IdentityTransform>
-void gn_sbfgs_min( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals residuals, ParameterTransform parameterTransform = ParameterTransform() )
+template<typename REAL>
+struct IterationInfo
 {
-   internal::Stream<VERBOSITY>() << std::left << std::scientific;
-   using std::size_t;
-   using std::unique_ptr;
-   const size_t N = params.size();
-   const size_t CN = simd::next_size<REAL> ( N );
-   const size_t M = residuals.size();
-   const size_t NxCN = N * CN;
+   /// number of completed iterations
+   int iteration;
+   /// number of parameters
+   std::size_t N;
+   /// parameters after the iteration
+   const REAL *params;
+   /// sum of squared residuals at params
+   REAL normr2;
+   /// decrease of the function value in this iteration
+   REAL delta;
+   /// max norm of the gradient at params
+   REAL gmax;
+   /// lower triangle of the structured secant matrix, packed row by row
+   const REAL *A;
+   /// number of consecutive iterations in which the decrease was smaller than the tolerance
+   int small_progress;
+   /// true if the next iteration uses the structured secant matrix and false if it uses the regularized Gauss-Newton matrix
+   bool secant;
+   /// true if the algorithm terminates after this iteration
+   bool finished;
+};
 
-   using SD = SingleDiff<REAL>;
-   using MD = MultiDiff<REAL>;
-   using MDContext = typename MD::Context;
+namespace internal
+{
 
+/**
+ * State of gn_sbfgs_min after an iteration from which the algorithm
+ * can be continued. The matrices that depend on the Jacobian are not
+ * part of the state since they are recomputed from the parameters.
+ */
+template<typename REAL>
+struct SbfgsState
+{
+   int iteration;
+   int small_progress;
+   bool secant;
+   /// lower triangle of the structured secant matrix, row by row
+   std::vector<REAL> A;
+};
+
+/**
+ * Model of the sum of squares used by gn_sbfgs_min. Evaluates the residuals using MultiDiff
+ * to assemble the gradient g = J^T r and the Gram matrix J^T J and maintains the structured
+ * secant matrix A which approximates the second order terms of the Hessian. The matrix B of
+ * the model is J^T J + A, or J^T J + |r| I if the last step did not satisfy the curvature
+ * condition for the secant update. A and B are stored as lower triangles packed row by row.
+ *
+ * If MIXED contains MixedJacobian and REAL is double the Jacobian rows are stored in float and
+ * J^T J is accumulated in float for panels of rows and in double across the panels. If it contains
+ * MixedFactor the steps are computed with packed_cholesky_solve_mixed.
+ */
+template<typename VERBOSITY, typename REAL, typename Residuals, typename ParameterTransform, int MIXED = 0>
+class SbfgsModel
+{
+public:
+   using MD = MultiDiff<REAL>;
    using array = simd::aligned_array<REAL>;
-   auto new_array = []( size_t n )
+   using STORE = typename std::conditional<( MIXED & MixedJacobian ) != 0, float, REAL>::type;
+   static constexpr bool mixed_jacobian = !std::is_same<STORE, REAL>::value;
+   static constexpr bool mixed_factor = ( MIXED & MixedFactor ) != 0 && !std::is_same<REAL, float>::value;
+
+   /**
+    * Must be constructed after the MultiDiff::Context for N directions.
+    */
+   SbfgsModel( std::size_t N, Residuals &residuals, ParameterTransform &pt ) :
+      N( N ), CN( simd::next_size<REAL>( N ) ), M( residuals.size() ), residuals( residuals ), pt( pt ),
+      ad_params( new MD[N] ), r( mixed_jacobian ? nullptr : new MD[M] ), NP( simd::next_size<REAL>( packed_size( N ) ) ),
+      CNS( simd::next_size<STORE>( N ) ), have_rows( false ), secant( true )
    {
-      return  simd::alloc_aligned_array<REAL> ( n );
-   };
+      g = simd::alloc_aligned_array<REAL>( CN );
+      z = simd::alloc_aligned_array<REAL>( CN );
+      As = simd::alloc_aligned_array<REAL>( CN );
+      B_ = simd::alloc_aligned_array<REAL>( NP );
+      A_ = simd::alloc_aligned_array<REAL>( NP );
+      F_ = nullptr;
 
-   MDContext ctx( N );
+      if( mixed_jacobian )
+      {
+         J_ = simd::alloc_aligned_array<STORE>( M * CNS );
+         P_ = simd::alloc_aligned_array<STORE>( N * CNS );
+      }
+
+      aligned_fill( zero<REAL>(), A_.get(), A_.get() + NP );
+   }
+
+   /**
+    * Evaluate the residuals and their gradients at the given parameters and return the
+    * sum of squared residuals. Computes the gradient g, the Gram matrix B = J^T J and,
+    * if the residuals were evaluated before, z = (J1 - J0)^T r1 where J0 is the Jacobian
+    * at the previous parameters.
+    */
+   REAL evaluate( const REAL *params )
    {
-      //move into scope that gets destroyed before the MultiDiff::Context
-      ParameterTransform pt = std::move( parameterTransform );
-      //now call init function of tranformator
-      pt.num_parameters( N );
+      if( mixed_jacobian )
+         return evaluate_mixed( params );
 
-      unique_ptr<MD[]> ad_params( new MD[N] );
-      unique_ptr<SD[]> directed_ad_params( new SD[N] );
-      unique_ptr<MD[]> r( new MD[M] );
+      for( std::size_t i = 0; i < N; ++i )
+         ad_params[i].setIndependent( params[i], i );
 
-      array g = new_array( CN );
-      array s = new_array( CN );
-      array z = new_array( CN );
-      array As = new_array( CN );
+      //set B, g and z zero
+      {
+         const pack<REAL> zp = zero<REAL>();
+         aligned_fill( zp, B_.get(), B_.get() + NP );
+         aligned_fill( zp, g.get(), g.get() + CN );
+         aligned_fill( zp, z.get(), z.get() + CN );
+      }
 
-      //array J_ = new_array(2);
-      //auto J = [&](size_t i, size_t j) -> REAL& { return J_[i*CN+j]; };
+      auto tp = pt( ad_params.get() );
+      REAL normr2 = 0;
 
-      array B_ = new_array( NxCN );
-      auto B = [&]( size_t i, size_t j ) -> REAL& { return B_[i * CN + j]; };
+      for( std::size_t i = 0; i < M; ++i )
+      {
+         MD residual = residuals[i]( tp );
+         normr2 += residual.getValue() * residual.getValue();
 
-      array A_ = new_array( NxCN );
-      auto A = [&]( size_t i, size_t j ) -> REAL& { return A_[i * CN + j]; };
+         if( have_rows )
+         {
+            const pack<REAL> rval( residual.getValue() );
+            aligned_transform<2>(
+               [&rval]( std::array<pack<REAL>, 4> &p )
+            {
+               p[0] += rval * p[2];
+               p[1] += rval * ( p[2] - p[3] );
+            },
+            CN,
+            g.get(),  z.get(), residual.getDiffValues(), r[i].getDiffValues()
+            );
+         }
+         else
+         {
+            blas::axpy( N, residual.getValue(), residual.getDiffValues(), 1, g.get(), 1 );
+         }
 
-      aligned_fill( zero<REAL>(), A_.get(), A_.get() + NxCN );
-      aligned_fill( zero<REAL>(), g.get(), g.get() + CN );
+         blas::spr( N, 1.0, residual.getDiffValues(), 1, B_.get() );
+         r[i] = std::move( residual );
+      }
 
-      REAL normr2 = 0;
+      have_rows = true;
+      return normr2;
+   }
 
-      for( size_t i = 0; i < N; ++i )
+   /**
+    * Initialize A after the first evaluation, either with a multiple of the identity
+    * or from the given state, and add it to B.
+    */
+   void init( REAL normr2, const SbfgsState<REAL> *restart )
+   {
+      if( restart )
       {
-         ad_params[i].setIndependent( params[i], i );
+         secant = restart->secant;
+
+         std::copy( restart->A.begin(), restart->A.end(), A_.get() );
+      }
+      else
+      {
+         REAL normr = 1e-4 * std::sqrt( normr2 );
+
+         for( std::size_t i = 0; i < N; ++i )
+            A( i, i ) = normr;
       }
 
-      aligned_fill( zero<REAL>(), B_.get(), B_.get() + NxCN );
+      if( secant )
+         addA();
+      else
+         addIdentity( std::sqrt( normr2 ) );
+   }
+
+   const REAL *gradient() const
+   {
+      return g.get();
+   }
+
+   /**
+    * Compute the step s = -B^-1 g. If B is not positive definite the cholesky decomposition is
+    * completed with the modified cholesky decomposition, which gives a descent direction for
+    * B + E with a nonnegative diagonal E, and false is returned. Only if that step is not finite
+    * the steepest descent direction -g is used. With MixedFactor the step is first computed
+    * with a single precision factorization and iterative refinement and only if that fails
+    * B is factorized in double precision. From tiled_cholesky_min_size() parameters on a copy
+    * of B is factorized with the tiled cholesky decomposition on all hardware threads first.
+    */
+   bool direction( REAL *s )
+   {
+      // copyneg ( CN, s, g );
+      aligned_transform( []( const pack<REAL> &g )
+      {
+         return -g;
+      }, s, s + CN, g.get() );
 
+      if( mixed_factor && packed_cholesky_solve_mixed<float>( B_.get(), s, N ) == 0 )
+         return true;
+
+      if( N >= tiled_cholesky_min_size() )
       {
-         auto tp = pt( ad_params.get() );
+         if( !pool )
+            pool.reset( new ThreadPool() );
 
-         for( size_t i = 0; i < M; ++i )
+         if( packed_tiled_cholesky_solve( *pool, B_.get(), s, N, tiles ) == 0 )
+            return true;
+      }
+
+      int pos = packed_cholesky_factor( B_.get(), N );
+
+      //continue with the partial factor where the decomposition failed
+      if( pos )
+         packed_cholesky_factor_modified( B_.get(), N, pos - 1 );
+
+      blas::tpsv( CblasNoTrans, CblasNonUnit, N, B_.get(), s, 1 );
+      blas::tpsv( CblasTrans, CblasNonUnit, N, B_.get(), s, 1 );
+
+      if( !std::isfinite( blas::dot( N, s, 1, s, 1 ) ) )
+      {
+         //use gradient descent
+         aligned_transform( []( const pack<REAL> &g )
          {
-            MD residual = residuals[i]( tp );
-            normr2 += residual.getValue() * residual.getValue();
-            const pack<REAL> rval( residual.getValue() );
-            blas::axpy( N, residual.getValue(), residual.getDiffValues(), 1, g.get(), 1 );
-            blas::syr( N, 1.0, residual.getDiffValues(), 1, B_.get(), CN );
-            r[i] = std::move( residual );
-         }
+            return -g;
+         }, s, s + CN, g.get() );
       }
 
-      REAL normr = 1e-4 * std::sqrt( normr2 );
+      return pos == 0;
+   }
+
+   /**
+    * Compute the step s = -(B + mu D)^-1 g where D is the diagonal of B. Does not modify B
+    * and returns false if the damped matrix is not positive definite.
+    */
+   bool damped_direction( REAL mu, REAL *s )
+   {
+      if( !F_ )
+         F_ = simd::alloc_aligned_array<REAL>( NP );
+
+      std::copy( B_.get(), B_.get() + NP, F_.get() );
+      REAL dmax = 0;
+
+      for( std::size_t i = 0; i < N; ++i )
+         dmax = std::max( dmax, B( i, i ) );
+
+      const REAL dmin = std::numeric_limits<REAL>::epsilon() * std::max( dmax, REAL( 1 ) );
+
+      for( std::size_t i = 0; i < N; ++i )
+         F_[packed_index( i, i )] += mu * std::max( B( i, i ), dmin );
+
+      aligned_transform( []( const pack<REAL> &g )
+      {
+         return -g;
+      }, s, s + CN, g.get() );
+
+      return packed_cholesky_solve( F_.get(), s, N ) == 0;
+   }
+
+   /**
+    * Decrease of the quadratic model 1/2 |r|^2 + g^T s + 1/2 s^T B s for the given step.
+    */
+   REAL predicted_decrease( const REAL *s )
+   {
+      blas::spmv( N, REAL( 1 ), B_.get(), s, 1, REAL( 0 ), As.get(), 1 );
+      return -( blas::dot( N, g.get(), 1, s, 1 ) + 0.5 * blas::dot( N, s, 1, As.get(), 1 ) );
+   }
+
+   /**
+    * Update A and B for the given step s which changed the sum of squared
+    * residuals from normr2 to new_normr2. Must be called after evaluating
+    * the residuals at the new parameters.
+    */
+   void update( REAL *s, REAL normr2, REAL new_normr2 )
+   {
+      blas::scal( N, std::sqrt( new_normr2 / normr2 ), z.get(), 1 );
+
+      //compute next A and B
+      REAL zs = blas::dot( N, z.get(), 1, s, 1 );
 
-      for( size_t i = 0; i < N; ++i )
+      if( zs / blas::dot( N, s, 1, s, 1 ) >= 1e-6 )
       {
+         internal::Stream<VERBOSITY>() << "H: SBFGS\n";
+         //As = A*s
+         blas::spmv( N, REAL( 1 ), A_.get(), s, 1, REAL( 0 ), As.get(), 1 );
+         REAL sAs = blas::dot( N, s, 1, As.get(), 1 );
+         blas::spr( N, -1 / sAs, As.get(), 1, A_.get() );
+         blas::spr( N, 1 / zs, z.get(), 1, A_.get() );
+         addA();
+         secant = true;
+      }
+      else
+      {
+         internal::Stream<VERBOSITY>() << "H: GN\n";
+         addIdentity( std::sqrt( new_normr2 ) );
+         secant = false;
+      }
+   }
+
+   /**
+    * Store the state of the model in the given iteration info.
+    */
+   void describe( IterationInfo<REAL> &info ) const
+   {
+      info.A = A_.get();
+      info.secant = secant;
+   }
+
+private:
+   /**
+    * Number of rows whose Gram matrix is accumulated in single precision before it is added to B.
+    */
+   static constexpr std::size_t panel_rows()
+   {
+      return 64;
+   }
+
+   /**
+    * Same as evaluate() but stores the Jacobian rows in single precision and accumulates the Gram
+    * matrix of panels of rows with a single precision syrk. The residuals, the gradient, z and the
+    * sum of the panel Gram matrices are computed in double precision.
+    */
+   REAL evaluate_mixed( const REAL *params )
+   {
+      for( std::size_t i = 0; i < N; ++i )
          ad_params[i].setIndependent( params[i], i );
-         A( i, i ) = normr;
+
+      {
+         const pack<REAL> zp = zero<REAL>();
+         aligned_fill( zp, B_.get(), B_.get() + NP );
+         aligned_fill( zp, g.get(), g.get() + CN );
+         aligned_fill( zp, z.get(), z.get() + CN );
+      }
+
+      auto tp = pt( ad_params.get() );
+      REAL normr2 = 0;
+
+      for( std::size_t p = 0; p < M; p += panel_rows() )
+      {
+         const std::size_t rows = std::min( panel_rows(), M - p );
+
+         for( std::size_t i = p; i < p + rows; ++i )
+         {
+            MD residual = residuals[i]( tp );
+            const REAL rval = residual.getValue();
+            const REAL *dr = residual.getDiffValues();
+            STORE *row = J_.get() + i * CNS;
+            normr2 += rval * rval;
+
+            if( have_rows )
+            {
+               for( std::size_t j = 0; j < N; ++j )
+                  z[j] += rval * ( dr[j] - row[j] );
+            }
+
+            blas::axpy( N, rval, dr, 1, g.get(), 1 );
+            std::copy( dr, dr + N, row );
+         }
+
+         blas::syrk( CblasTrans, N, rows, STORE( 1 ), J_.get() + p * CNS, CNS, STORE( 0 ), P_.get(), CNS );
+
+         for( std::size_t i = 0; i < N; ++i )
+            for( std::size_t j = 0; j <= i; ++j )
+               B( i, j ) += P_[i * CNS + j];
       }
 
+      have_rows = true;
+      return normr2;
+   }
+
+   REAL &A( std::size_t i, std::size_t j )
+   {
+      return A_[packed_index( i, j )];
+   }
+
+   REAL &B( std::size_t i, std::size_t j )
+   {
+      return B_[packed_index( i, j )];
+   }
+
+   void addA()
+   {
       aligned_transform<1>(
          []( std::array<pack<REAL>, 2> &p )
       {
          p[0] += p[1];
       },
-      NxCN, B_.get(), A_.get()
+      NP, B_.get(), A_.get()
       );
+   }
+
+   void addIdentity( REAL val )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+         B( i, i ) += val;
+   }
 
-      int small_progress = 0;
+   const std::size_t N;
+   const std::size_t CN;
+   const std::size_t M;
+   Residuals &residuals;
+   ParameterTransform &pt;
+   std::unique_ptr<MD[]> ad_params;
+   std::unique_ptr<MD[]> r;
+   array g;
+   array z;
+   array As;
+   array B_;
+   array A_;
+   array F_;
+   std::unique_ptr<ThreadPool> pool;
+   std::vector<REAL> tiles;
+   const std::size_t NP;
+   const std::size_t CNS;
+   simd::aligned_array<STORE> J_;
+   simd::aligned_array<STORE> P_;
+   bool have_rows;
+   bool secant;
+};
 
-      for( int k = 0; k < MAXITER; ++k )
+/**
+ * Returns true if gn_sbfgs_min should solve for the step in the space of the M residuals
+ * instead of factorizing the NxN matrix B.
+ */
+inline bool use_residual_space( std::size_t M, std::size_t N )
+{
+   return 4 * M <= N;
+}
+
+/**
+ * Model of gn_sbfgs_min for problems with fewer residuals than parameters. It represents the
+ * same matrix B = J^T J + D as the SbfgsModel, where D is either the structured secant matrix A
+ * or |r| I, but never forms B. Instead it maintains the inverse H = A^-1 with the inverse BFGS
+ * update and computes the step with the Woodbury identity
+ *
+ *    B^-1 = D^-1 - D^-1 J^T ( I + J D^-1 J^T )^-1 J D^-1,
+ *
+ * so that only an MxM matrix is factorized and every iteration costs O(M N^2) instead of O(N^3).
+ */
+template<typename VERBOSITY, typename REAL, typename Residuals, typename ParameterTransform>
+class ResidualSpaceModel
+{
+public:
+   using MD = MultiDiff<REAL>;
+   using array = simd::aligned_array<REAL>;
+
+   /**
+    * Must be constructed after the MultiDiff::Context for N directions.
+    */
+   ResidualSpaceModel( std::size_t N, Residuals &residuals, ParameterTransform &pt ) :
+      N( N ), CN( simd::next_size<REAL>( N ) ), NP( simd::next_size<REAL>( packed_size( N ) ) ), M( residuals.size() ),
+      residuals( residuals ), pt( pt ), ad_params( new MD[N] ), have_rows( false ), secant( true ), lambda( 0 )
+   {
+      g = simd::alloc_aligned_array<REAL>( CN );
+      z = simd::alloc_aligned_array<REAL>( CN );
+      As = simd::alloc_aligned_array<REAL>( CN );
+      h = simd::alloc_aligned_array<REAL>( CN );
+      A_ = simd::alloc_aligned_array<REAL>( NP );
+      H_ = simd::alloc_aligned_array<REAL>( N * CN );
+      J_ = simd::alloc_aligned_array<REAL>( M * CN );
+      Y_ = simd::alloc_aligned_array<REAL>( M * CN );
+      K_ = simd::alloc_aligned_array<REAL>( M * M );
+      t = simd::alloc_aligned_array<REAL>( M );
+
+      aligned_fill( zero<REAL>(), A_.get(), A_.get() + NP );
+      aligned_fill( zero<REAL>(), H_.get(), H_.get() + N * CN );
+      aligned_fill( zero<REAL>(), J_.get(), J_.get() + M * CN );
+   }
+
+   /**
+    * Evaluate the residuals and their gradients at the given parameters and return the
+    * sum of squared residuals. Computes the gradient g, stores the Jacobian J and, if the
+    * residuals were evaluated before, computes z = (J1 - J0)^T r1.
+    */
+   REAL evaluate( const REAL *params )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+         ad_params[i].setIndependent( params[i], i );
+
+      aligned_fill( zero<REAL>(), g.get(), g.get() + CN );
+      aligned_fill( zero<REAL>(), z.get(), z.get() + CN );
+
+      auto tp = pt( ad_params.get() );
+      REAL normr2 = 0;
+
+      for( std::size_t i = 0; i < M; ++i )
       {
+         MD residual = residuals[i]( tp );
+         normr2 += residual.getValue() * residual.getValue();
+         REAL *row = J_.get() + i * CN;
 
-         // copyneg ( CN, s, g );
-         aligned_transform( []( const pack<REAL> &g )
+         if( have_rows )
          {
-            return -g;
-         }, s.get(), s.get() + CN, g.get() );
-         int pos = cholesky_solve( B_, CN, s, N );
+            const pack<REAL> rval( residual.getValue() );
+            aligned_transform<2>(
+               [&rval]( std::array<pack<REAL>, 4> &p )
+            {
+               p[0] += rval * p[2];
+               p[1] += rval * ( p[2] - p[3] );
+            },
+            CN,
+            g.get(),  z.get(), residual.getDiffValues(), row
+            );
+         }
+         else
+         {
+            blas::axpy( N, residual.getValue(), residual.getDiffValues(), 1, g.get(), 1 );
+         }
+
+         std::copy( residual.getDiffValues(), residual.getDiffValues() + N, row );
+      }
 
-         if( pos )
+      have_rows = true;
+      return normr2;
+   }
+
+   /**
+    * Initialize A and its inverse H after the first evaluation, either with a multiple
+    * of the identity or from the given state.
+    */
+   void init( REAL normr2, const SbfgsState<REAL> *restart )
+   {
+      if( restart )
+      {
+         secant = restart->secant;
+         std::copy( restart->A.begin(), restart->A.end(), A_.get() );
+         invertA();
+      }
+      else
+      {
+         REAL normr = 1e-4 * std::sqrt( normr2 );
+
+         for( std::size_t i = 0; i < N; ++i )
          {
-            //use gradient descent
-            aligned_transform( []( const pack<REAL> &g )
-            {
-               return -g;
-            }, s.get(), s.get() + CN, g.get() );
+            A_[packed_index( i, i )] = normr;
+            H_[i * CN + i] = 1 / normr;
          }
+      }
+
+      lambda = std::sqrt( normr2 );
+   }
+
+   const REAL *gradient() const
+   {
+      return g.get();
+   }
 
-         REAL alpha = 1;
-         SD f0;
-         f0 = 0.5 * normr2, blas::dot( N, g.get(), 1, s.get(), 1 );
-         auto eval_step_size = [&]( REAL a ) -> SD
+   /**
+    * Compute the step s = -B^-1 g with the Woodbury identity. If I + J D^-1 J^T cannot
+    * be factorized the steepest descent direction -g is used and false is returned.
+    */
+   bool direction( REAL *s )
+   {
+      //Y = J D^-1 and h = D^-1 g
+      if( secant )
+      {
+         blas::symm( CblasRight, M, N, REAL( 1 ), H_.get(), CN, J_.get(), CN, REAL( 0 ), Y_.get(), CN );
+         blas::symv( N, REAL( 1 ), H_.get(), CN, g.get(), 1, REAL( 0 ), h.get(), 1 );
+      }
+      else
+      {
+         const pack<REAL> scale( 1 / lambda );
+         aligned_transform( [&scale]( const pack<REAL> &x )
          {
-            for( size_t i = 0; i < N; ++i )
-            {
-               directed_ad_params[i] = params[i] + a * s[i], s[i];
-            }
+            return x * scale;
+         }, Y_.get(), Y_.get() + M * CN, J_.get() );
+         aligned_transform( [&scale]( const pack<REAL> &x )
+         {
+            return x * scale;
+         }, h.get(), h.get() + CN, g.get() );
+      }
 
-            auto tp = pt( directed_ad_params.get() );
-            SD f = 0;
+      //K = I + J D^-1 J^T and t = J h
+      for( std::size_t i = 0; i < M; ++i )
+      {
+         for( std::size_t j = 0; j <= i; ++j )
+            K_[i * M + j] = blas::dot( N, J_.get() + i * CN, 1, Y_.get() + j * CN, 1 );
 
-            for( size_t i = 0; i < M; ++i )
-            {
-               SD residual = residuals[i]( tp );
-               f += residual * residual;
+         K_[i * M + i] += 1;
+      }
 
-            }
+      blas::gemv( CblasNoTrans, M, N, REAL( 1 ), J_.get(), CN, h.get(), 1, REAL( 0 ), t.get(), 1 );
+      int pos = cholesky_solve( K_.get(), M, t.get(), M );
 
-            return f * 0.5;
-         };
+      //s = -h + Y^T K^-1 t
+      aligned_transform( []( const pack<REAL> &x )
+      {
+         return -x;
+      }, s, s + CN, pos ? g.get() : h.get() );
 
-         bool found_step_size = line_search( f0, eval_step_size, alpha );
+      if( pos == 0 )
+         blas::gemv( CblasTrans, M, N, REAL( 1 ), Y_.get(), CN, t.get(), 1, REAL( 1 ), s, 1 );
 
-         if( found_step_size )
-         {
-            //scale step by step size alpha
+      return pos == 0;
+   }
 
-            blas::scal( N, alpha, s.get(), 1 );
+   /**
+    * Update A and H for the given step s which changed the sum of squared
+    * residuals from normr2 to new_normr2. Must be called after evaluating
+    * the residuals at the new parameters.
+    */
+   void update( REAL *s, REAL normr2, REAL new_normr2 )
+   {
+      blas::scal( N, std::sqrt( new_normr2 / normr2 ), z.get(), 1 );
 
-            //set params = params + step
-            for( size_t i = 0; i < N; ++i )
-            {
-               REAL pi = params[i] + s[i];
-               params[i] = pi;
-               ad_params[i].setIndependent( pi, i );
-            }
+      REAL zs = blas::dot( N, z.get(), 1, s, 1 );
 
-            //evaluate residuals gradient and z = (J1 - J0)^T * r1 * norm(r1)/norm(r0)
-            auto tp = pt( ad_params.get() );
-            REAL new_normr2 = 0;
-            //set B, g and z zero
-            {
-               const pack<REAL> zp = zero<REAL>();
-               aligned_fill( zp, B_.get(), B_.get() + NxCN );
-               aligned_fill( zp, g.get(), g.get() + CN );
-               aligned_fill( zp, z.get(), z.get() + CN );
-            }
+      if( zs / blas::dot( N, s, 1, s, 1 ) >= 1e-6 )
+      {
+         internal::Stream<VERBOSITY>() << "H: SBFGS\n";
+         blas::spmv( N, REAL( 1 ), A_.get(), s, 1, REAL( 0 ), As.get(), 1 );
+         REAL sAs = blas::dot( N, s, 1, As.get(), 1 );
+         blas::spr( N, -1 / sAs, As.get(), 1, A_.get() );
+         blas::spr( N, 1 / zs, z.get(), 1, A_.get() );
 
-            for( size_t i = 0; i < M; ++i )
-            {
-               MD residual = residuals[i]( tp );
-               new_normr2 += residual.getValue() * residual.getValue();
-
-               const pack<REAL> rval( residual.getValue() );
-               aligned_transform<2>(
-                  [&rval]( std::array<pack<REAL>, 4> &p )
-               {
-                  p[0] += rval * p[2];
-                  p[1] += rval * ( p[2] - p[3] );
-               },
-               CN,
-               g.get(),  z.get(), residual.getDiffValues(), r[i].getDiffValues()
-               );
-
-               blas::syr( N, 1.0, residual.getDiffValues(), 1, B_.get(), CN );
-               r[i] = std::move( residual );
-            }
+         //H = H - ( H z s^T + s z^T H ) / zs + ( zs + z^T H z ) / zs^2 s s^T
+         blas::symv( N, REAL( 1 ), H_.get(), CN, z.get(), 1, REAL( 0 ), As.get(), 1 );
+         REAL zHz = blas::dot( N, z.get(), 1, As.get(), 1 );
+         blas::syr2( N, -1 / zs, As.get(), 1, s, 1, H_.get(), CN );
+         blas::syr( N, ( zs + zHz ) / ( zs * zs ), s, 1, H_.get(), CN );
+         secant = true;
+      }
+      else
+      {
+         internal::Stream<VERBOSITY>() << "H: GN\n";
+         lambda = std::sqrt( new_normr2 );
+         secant = false;
+      }
+   }
 
-            blas::scal( N, std::sqrt( new_normr2 / normr2 ), z.get(), 1 );
+   void describe( IterationInfo<REAL> &info ) const
+   {
+      info.A = A_.get();
+      info.secant = secant;
+   }
 
-            REAL delta = 0.5 * ( normr2 - new_normr2 );
+private:
+   /**
+    * Compute H = A^-1 column by column from the cholesky decomposition of A.
+    */
+   void invertA()
+   {
+      array L = simd::alloc_aligned_array<REAL>( NP );
+      std::copy( A_.get(), A_.get() + NP, L.get() );
 
-            if( delta < tolerance )
-               ++small_progress;
-            else
-               small_progress = 0;
+      if( packed_cholesky_factor( L.get(), N ) != 0 )
+      {
+         //not positive definite, continue with the inverse of the diagonal
+         aligned_fill( zero<REAL>(), H_.get(), H_.get() + N * CN );
 
-            int imax = blas::iamax( N, g.get(), 1 );
+         for( std::size_t i = 0; i < N; ++i )
+            H_[i * CN + i] = 1 / std::max( A_[packed_index( i, i )], std::numeric_limits<REAL>::min() );
 
-            internal::Stream<VERBOSITY>() << "itr: " <<  std::setw( 6 ) <<  k + 1  << "r: " << std::setw( 14 ) << 0.5 * normr2  <<   "d: "   << std::setw( 14 ) << delta   <<  "g: " << std::setw( 14 )  << std::abs( g[imax] );
+         return;
+      }
 
-            if( small_progress == 15 )
-            {
-               internal::Stream<VERBOSITY>() << "\nchange in function value was smaller than tolerance for 15 consecutive iterations\n";
-               break;
-            }
+      for( std::size_t j = 0; j < N; ++j )
+      {
+         std::fill( h.get(), h.get() + N, REAL( 0 ) );
+         h[j] = 1;
+         blas::tpsv( CblasNoTrans, CblasNonUnit, N, L.get(), h.get(), 1 );
+         blas::tpsv( CblasTrans, CblasNonUnit, N, L.get(), h.get(), 1 );
 
-            if( std::abs( g[imax] ) < tolerance )
-            {
-               internal::Stream<VERBOSITY>() << "\ngradient max norm smaller than tolerance.\n";
-               break;
-            }
+         for( std::size_t i = j; i < N; ++i )
+            H_[i * CN + j] = h[i];
+      }
+   }
 
-            normr2 = new_normr2;
-            //compute next A and B
-            REAL zs = blas::dot( N, z.get(), 1, s.get(), 1 );
+   const std::size_t N;
+   const std::size_t CN;
+   const std::size_t NP;
+   const std::size_t M;
+   Residuals &residuals;
+   ParameterTransform &pt;
+   std::unique_ptr<MD[]> ad_params;
+   array g;
+   array z;
+   array As;
+   array h;
+   array A_;
+   array H_;
+   array J_;
+   array Y_;
+   array K_;
+   array t;
+   bool have_rows;
+   bool secant;
+   REAL lambda;
+};
 
-            if( zs / blas::dot( N, s.get(), 1, s.get(), 1 ) >= 1e-6 )
-            {
-               internal::Stream<VERBOSITY>() << "H: SBFGS\n";
-               //As = A*s
-               blas::symv( N, REAL( 1 ), A_.get(), CN, s.get(), 1, REAL( 0 ), As.get(), 1 );
-               REAL sAs = blas::dot( N, s.get(), 1, As.get(), 1 );
-               blas::syr( N, -1 / sAs, As.get(), 1, A_.get(), CN );
-               blas::syr( N, 1 / zs, z.get(), 1, A_.get(), CN );
-               aligned_transform<1>(
-                  []( std::array<pack<REAL>, 2> &p )
-               {
-                  p[0] += p[1];
-               },
-               NxCN, B_.get(), A_.get()
-               );
-            }
-            else
-            {
-               internal::Stream<VERBOSITY>() << "H: GN\n";
-               REAL normr = std::sqrt( normr2 );
+/**
+ * Storage for the step and the parameters of the line search. The step is padded
+ * to the simd size since the models write whole packs.
+ */
+template<typename REAL, typename Params>
+class LineSearchStorage
+{
+public:
+   explicit LineSearchStorage( std::size_t N ) :
+      s( simd::alloc_aligned_array<REAL>( simd::next_size<REAL>( N ) ) ), directed_ad_params( new SingleDiff<REAL>[N] ) {}
 
-               for( size_t i = 0; i < N; ++i )
-                  B( i, i ) += normr;
-            }
+   REAL *step()
+   {
+      return s.get();
+   }
+
+   SingleDiff<REAL> *directed()
+   {
+      return directed_ad_params.get();
+   }
+
+private:
+   simd::aligned_array<REAL> s;
+   std::unique_ptr<SingleDiff<REAL>[]> directed_ad_params;
+};
+
+/**
+ * For a number of parameters known at compile time the storage is kept on the stack.
+ */
+template<typename REAL, std::size_t N>
+class LineSearchStorage<REAL, std::array<REAL, N>>
+{
+public:
+   explicit LineSearchStorage( std::size_t ) {}
+
+   REAL *step()
+   {
+      return s.data();
+   }
+
+   SingleDiff<REAL> *directed()
+   {
+      return directed_ad_params.data();
+   }
+
+private:
+   std::array<REAL, N> s;
+   std::array<SingleDiff<REAL>, N> directed_ad_params;
+};
+
+/**
+ * Finish iteration k of a minimization loop after the parameters were moved by the step s and the
+ * model was evaluated at them with the sum of squares new_normr2: counts the iterations with small
+ * progress, reports the iteration, tests for termination and otherwise updates the model and normr2.
+ * The callable report writes further columns of the line of the iteration.
+ *
+ * \return          true if the minimization terminates after this iteration.
+ */
+template<typename VERBOSITY, typename REAL, typename Model, typename Monitor, typename Report>
+bool finish_iteration( int k, REAL tolerance, const REAL *params, std::size_t N, const REAL *g, REAL *s, REAL &normr2, REAL new_normr2,
+                       int &small_progress, Model &model, Monitor &monitor, Report report )
+{
+   REAL delta = 0.5 * ( normr2 - new_normr2 );
 
+   if( delta < tolerance )
+      ++small_progress;
+   else
+      small_progress = 0;
+
+   int imax = blas::iamax( N, g, 1 );
+
+   internal::Stream<VERBOSITY>() << "itr: " <<  std::setw( 6 ) <<  k + 1  << "r: " << std::setw( 14 ) << 0.5 * normr2  <<   "d: "   << std::setw( 14 ) << delta   <<  "g: " << std::setw( 14 )  << std::abs( g[imax] );
+   report();
+
+   IterationInfo<REAL> info { k + 1, N, params, new_normr2, delta, std::abs( g[imax] ), nullptr, small_progress, false, true };
+   model.describe( info );
+
+   if( small_progress == 15 )
+   {
+      internal::Stream<VERBOSITY>() << "\nchange in function value was smaller than tolerance for 15 consecutive iterations\n";
+      monitor( info );
+      return true;
+   }
+
+   if( std::abs( g[imax] ) < tolerance )
+   {
+      internal::Stream<VERBOSITY>() << "\ngradient max norm smaller than tolerance.\n";
+      monitor( info );
+      return true;
+   }
+
+   model.update( s, normr2, new_normr2 );
+   normr2 = new_normr2;
+
+   model.describe( info );
+   info.finished = false;
+   monitor( info );
+   return false;
+}
+
+/**
+ * Minimize the sum of squared residuals using the steps of the given model and a line search
+ * for the step length. Starts from the given state if restart is not null.
+ */
+template<typename VERBOSITY, int MAXITER, typename REAL, typename Params, typename Residuals, typename ParameterTransform, typename Model, typename Monitor>
+void line_search_min( REAL tolerance, Params &params, Residuals &residuals, ParameterTransform &pt, Model &model, Monitor &monitor, const SbfgsState<REAL> *restart )
+{
+   internal::Stream<VERBOSITY>() << std::left << std::scientific;
+   using std::size_t;
+   const size_t N = params.size();
+   const size_t M = residuals.size();
+
+   using SD = SingleDiff<REAL>;
+
+   LineSearchStorage<REAL, Params> storage( N );
+   SD *directed_ad_params = storage.directed();
+   REAL *s = storage.step();
+
+   REAL normr2 = model.evaluate( params.data() );
+   const REAL *g = model.gradient();
+
+   int k0 = 0;
+   int small_progress = 0;
+
+   if( restart )
+   {
+      k0 = restart->iteration;
+      small_progress = restart->small_progress;
+   }
+
+   model.init( normr2, restart );
+
+   for( int k = k0; k < MAXITER; ++k )
+   {
+      model.direction( s );
+
+      REAL alpha = 1;
+      SD f0;
+      f0 = 0.5 * normr2, blas::dot( N, g, 1, s, 1 );
+      auto eval_step_size = [&]( REAL a ) -> SD
+      {
+         for( size_t i = 0; i < N; ++i )
+         {
+            directed_ad_params[i] = params[i] + a * s[i], s[i];
          }
-         else
+
+         auto tp = pt( directed_ad_params );
+         SD f = 0;
+
+         for( size_t i = 0; i < M; ++i )
          {
-            internal::Stream<VERBOSITY>() << "no step satisfying the weak wolfe conditions was found\n";
-            break;
+            SD residual = residuals[i]( tp );
+            f += residual * residual;
+
          }
+
+         return f * 0.5;
+      };
+
+      bool found_step_size = line_search( f0, eval_step_size, alpha );
+
+      if( found_step_size )
+      {
+         //scale step by step size alpha
+
+         blas::scal( N, alpha, s, 1 );
+
+         //set params = params + step
+         for( size_t i = 0; i < N; ++i )
+            params[i] += s[i];
+
+         //evaluate residuals gradient and z = (J1 - J0)^T * r1
+         REAL new_normr2 = model.evaluate( params.data() );
+
+         if( finish_iteration<VERBOSITY>( k, tolerance, params.data(), N, g, s, normr2, new_normr2, small_progress, model, monitor, []() {} ) )
+            break;
       }
+      else
+      {
+         internal::Stream<VERBOSITY>() << "no step satisfying the weak wolfe conditions was found\n";
+         break;
+      }
+   }
 
-      internal::Stream<VERBOSITY>() << std::resetiosflags( std::ios::floatfield | std::ios::adjustfield );
+   internal::Stream<VERBOSITY>() << std::resetiosflags( std::ios::floatfield | std::ios::adjustfield );
+}
+
+/**
+ * Implementation of gn_sbfgs_min that starts from the given state if
+ * restart is not null.
+ */
+template<typename VERBOSITY, int MAXITER, int MIXED = 0, typename REAL, typename Residuals, typename ParameterTransform, typename Monitor>
+void gn_sbfgs_min_impl( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals &residuals, ParameterTransform &parameterTransform, Monitor &monitor, const SbfgsState<REAL> *restart )
+{
+   const std::size_t N = params.size();
+   typename MultiDiff<REAL>::Context ctx( N );
+   {
+      //move into scope that gets destroyed before the MultiDiff::Context
+      ParameterTransform pt = std::move( parameterTransform );
+      //now call init function of tranformator
+      pt.num_parameters( N );
 
+      if( use_residual_space( residuals.size(), N ) )
+      {
+         ResidualSpaceModel<VERBOSITY, REAL, Residuals, ParameterTransform> model( N, residuals, pt );
+         line_search_min<VERBOSITY, MAXITER>( tolerance, params, residuals, pt, model, monitor, restart );
+      }
+      else
+      {
+         SbfgsModel<VERBOSITY, REAL, Residuals, ParameterTransform, MIXED> model( N, residuals, pt );
+         line_search_min<VERBOSITY, MAXITER>( tolerance, params, residuals, pt, model, monitor, restart );
+      }
    } //ctx gets destroyed
+} //end of gn_sbfgs_min_impl
+
+} //internal
+
+/**
+ * \brief Compute parameters such that the sum of squares of the (nonlinear) residuals is minimized.
+ *
+ * If there are at most a quarter as many residuals as parameters the step is computed in the space of the
+ * residuals with the Woodbury identity, which only requires the factorization of an MxM matrix.
+ *
+ * \param tolerance             Value to use for tolerance. If the change in the function value (sum of squared residuals) is smaller than tolerance
+ *                              for 15 consecutive iterations or if the max norm of the gradient is smaller than tolerance the algorithm terminates.
+ * \param params                On input contains the initial parameters and on output the parameters that minimize the sum of squares of the residuals.
+ * \param residuals             An array or vector of residual functors. The input of each functor is a pointer to parameters to use for the computation.
+ *                              The type of parameters may is a SingleDiff or MultiDiff type to compute derivatives together with function values and thus
+ *                              the functors must be templated to accept different types.
+ * \param parameterTransform    An optional functor that may perform a transformation on the parameters. Defaults to identity function i.e. no transformation.
+ *                              If a reference is returned a copy will be made so use a pointer if this is unwanted. If this parameter is used the input
+ *                              of the residual functors will be the type of the transformed parameters as returned by this functor. The functor must not
+ *                              preallocate any MultiDiff objects until its member function num_parameters(N) is called which happens after the MultiDiff
+ *                              context is initialized.
+ * \param monitor               An optional functor that is called with an IterationInfo object after each iteration, e.g. to record the
+ *                              trajectory of the solver. Defaults to a monitor that does nothing.
+ * \tparam VERBOSITY            If set to cpplsq::Verbose then there will be output to stdout in each iteration. If set to cpplsq::Silent then there is no output.
+ *                              Default value is cpplsq::Verbose.
+ * \tparam MAXITER              Maximum number of iterations that will be performed. Default value is 1000.
+ *
+ */
+template<typename VERBOSITY = Verbose , int MAXITER = 1000, typename REAL, typename Residuals, typename ParameterTransform = internal::IdentityTransform, typename Monitor = internal::NoMonitor>
+void gn_sbfgs_min( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals residuals, ParameterTransform parameterTransform = ParameterTransform(), Monitor monitor = Monitor() )
+{
+   internal::gn_sbfgs_min_impl<VERBOSITY, MAXITER>( tolerance, params, residuals, parameterTransform, monitor, static_cast<const internal::SbfgsState<REAL> *>( nullptr ) );
 } //end of gn_sbfgs_min
 
+/**
+ * \brief Same as gn_sbfgs_min but uses single precision for the parts selected by MIXED.
+ *
+ * With MixedJacobian the residuals are evaluated in double precision but the Jacobian rows are stored in float
+ * and the Gram matrix of each panel of rows is accumulated in float, which halves the memory traffic of the
+ * Gram assembly. The panel contributions are summed in double precision and the gradient, the line search and
+ * the convergence checks use double precision, so only the model matrix carries single precision rounding errors.
+ *
+ * With MixedFactor the matrix of the model is factorized in float and the step is refined against the double
+ * precision matrix until it has double precision accuracy. If the single precision factorization fails or the
+ * refinement does not converge, e.g. because the matrix is too badly conditioned, the step is computed with a
+ * double precision factorization instead.
+ *
+ * The flags have no effect if REAL is float or if the step is solved in residual space.
+ *
+ * \tparam MIXED  Combination of MixedPrecision flags. Default value is MixedJacobian.
+ *
+ * The other arguments are the same as for gn_sbfgs_min.
+ */
+template<typename VERBOSITY = Verbose , int MAXITER = 1000, int MIXED = MixedJacobian, typename REAL, typename Residuals, typename ParameterTransform = internal::IdentityTransform, typename Monitor = internal::NoMonitor>
+void gn_sbfgs_min_mixed( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals residuals, ParameterTransform parameterTransform = ParameterTransform(), Monitor monitor = Monitor() )
+{
+   internal::gn_sbfgs_min_impl<VERBOSITY, MAXITER, MIXED>( tolerance, params, residuals, parameterTransform, monitor, static_cast<const internal::SbfgsState<REAL> *>( nullptr ) );
+} //end of gn_sbfgs_min_mixed
+
 } //clsq
 
 #endif
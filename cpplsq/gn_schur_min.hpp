@@ -0,0 +1,319 @@
+#ifndef _CPPLSQ_GN_SCHUR_MIN_HPP_
+#define _CPPLSQ_GN_SCHUR_MIN_HPP_
+
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include "regularized_gn.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Residual i of a group as a residual functor on all parameters.
+ */
+template<typename Group>
+class GroupResidual
+{
+public:
+   GroupResidual( Group &group, std::size_t i, std::size_t offset ) : group( &group ), i( i ), offset( offset ) {}
+
+   template<typename T>
+   T operator()( const T *params ) const
+   {
+      return ( *group )( i, params, params + offset );
+   }
+
+private:
+   Group *group;
+   std::size_t i;
+   std::size_t offset;
+};
+
+/**
+ * The residuals of all groups as one range of residual functors on the parameters
+ * [global | local parameters of group 0 | local parameters of group 1 | ...].
+ */
+template<typename Groups>
+class GroupResiduals
+{
+public:
+   using Group = typename std::decay<decltype( std::declval<Groups &>()[0] )>::type;
+
+   GroupResiduals( Groups &groups, std::size_t num_global ) : groups( &groups )
+   {
+      std::size_t offset = num_global;
+
+      for( std::size_t g = 0; g < groups.size(); ++g )
+      {
+         for( std::size_t i = 0; i < groups[g].size(); ++i )
+            index.emplace_back( g, i );
+
+         offsets.push_back( offset );
+         offset += groups[g].num_local();
+      }
+
+      num_params = offset;
+   }
+
+   std::size_t size() const
+   {
+      return index.size();
+   }
+
+   GroupResidual<Group> operator[]( std::size_t k ) const
+   {
+      return GroupResidual<Group>( ( *groups ) [index[k].first], index[k].second, offsets[index[k].first] );
+   }
+
+   std::size_t num_parameters() const
+   {
+      return num_params;
+   }
+
+   std::size_t offset( std::size_t g ) const
+   {
+      return offsets[g];
+   }
+
+private:
+   Groups *groups;
+   std::vector<std::pair<std::size_t, std::size_t>> index;
+   std::vector<std::size_t> offsets;
+   std::size_t num_params;
+};
+
+/**
+ * Gauß-Newton model for residuals in groups with local and global parameters. Each group is evaluated
+ * with MultiDiff objects for its own local parameters and the global parameters only. The Gram matrix
+ * has the blocks U (global x global), W_g (local x global) and the block diagonal V with blocks V_g
+ * (local x local). The step solves (J^T J + sigma I) s = -g by eliminating the local steps with the
+ * cholesky decompositions of the V_g and solving the Schur complement S = U - sum W_g^T V_g^-1 W_g
+ * for the global step.
+ */
+template<typename VERBOSITY, typename REAL, typename Groups>
+class SchurModel : public RegularizedGnModel<SchurModel<VERBOSITY, REAL, Groups>, VERBOSITY, REAL>
+{
+   using Base = RegularizedGnModel<SchurModel, VERBOSITY, REAL>;
+   using Base::CN;
+   using Base::g;
+   using Base::sigma;
+
+public:
+   using MD = MultiDiff<REAL>;
+   using array = simd::aligned_array<REAL>;
+
+   /**
+    * Must be constructed after the MultiDiff::Context for num_directions( groups, G ) directions.
+    */
+   SchurModel( std::size_t G, Groups &groups, const GroupResiduals<Groups> &layout ) :
+      Base( layout.num_parameters() ), G( G ), N( layout.num_parameters() ), groups( groups ), layout( layout ),
+      ad_global( new MD[G] ), ad_local( new MD[max_local( groups )] ), V( groups.size() ), W( groups.size() )
+   {
+      U = simd::alloc_aligned_array<REAL>( G * G );
+      S = simd::alloc_aligned_array<REAL>( G * G );
+      rhs = simd::alloc_aligned_array<REAL>( G );
+      y = simd::alloc_aligned_array<REAL>( max_local( groups ) );
+
+      for( std::size_t k = 0; k < groups.size(); ++k )
+      {
+         const std::size_t n = groups[k].num_local();
+         V[k].resize( n * n );
+         W[k].resize( n * G );
+      }
+   }
+
+   static std::size_t max_local( Groups &groups )
+   {
+      std::size_t n = 0;
+
+      for( std::size_t k = 0; k < groups.size(); ++k )
+         n = std::max( n, groups[k].num_local() );
+
+      return n;
+   }
+
+   static std::size_t num_directions( Groups &groups, std::size_t G )
+   {
+      return G + max_local( groups );
+   }
+
+   /**
+    * Evaluate the residuals of all groups at the given parameters, compute the gradient
+    * and the blocks of the Gram matrix and return the sum of squared residuals.
+    */
+   REAL evaluate( const REAL *params )
+   {
+      for( std::size_t j = 0; j < G; ++j )
+         ad_global[j].setIndependent( params[j], j );
+
+      aligned_fill( zero<REAL>(), g.get(), g.get() + CN );
+      std::fill( U.get(), U.get() + G * G, REAL( 0 ) );
+      REAL normr2 = 0;
+
+      for( std::size_t k = 0; k < groups.size(); ++k )
+      {
+         const std::size_t n = groups[k].num_local();
+         const std::size_t off = layout.offset( k );
+         std::fill( V[k].begin(), V[k].end(), REAL( 0 ) );
+         std::fill( W[k].begin(), W[k].end(), REAL( 0 ) );
+
+         for( std::size_t l = 0; l < n; ++l )
+            ad_local[l].setIndependent( params[off + l], G + l );
+
+         for( std::size_t i = 0; i < groups[k].size(); ++i )
+         {
+            MD residual = groups[k]( i, ad_global.get(), ad_local.get() );
+            const REAL r = residual.getValue();
+            const REAL *dg = residual.getDiffValues();
+            const REAL *dl = dg + G;
+            normr2 += r * r;
+
+            blas::axpy( G, r, dg, 1, g.get(), 1 );
+            blas::axpy( n, r, dl, 1, g.get() + off, 1 );
+            blas::syr( G, REAL( 1 ), dg, 1, U.get(), G );
+            blas::syr( n, REAL( 1 ), dl, 1, V[k].data(), n );
+
+            for( std::size_t l = 0; l < n; ++l )
+               blas::axpy( G, dl[l], dg, 1, &W[k][l * G], 1 );
+         }
+      }
+
+      return normr2;
+   }
+
+   /**
+    * Compute the step s = -(J^T J + sigma I)^-1 g using the Schur complement of the local blocks.
+    * If a factorization fails the steepest descent direction -g is used and false is returned.
+    */
+   bool direction( REAL *s )
+   {
+      std::copy( U.get(), U.get() + G * G, S.get() );
+
+      for( std::size_t j = 0; j < G; ++j )
+      {
+         S[j * G + j] += sigma;
+         rhs[j] = -g[j];
+      }
+
+      bool ok = true;
+
+      for( std::size_t k = 0; ok && k < groups.size(); ++k )
+      {
+         const std::size_t n = groups[k].num_local();
+
+         if( n == 0 )
+            continue;
+
+         REAL *Vk = V[k].data();
+         REAL *Yk = W[k].data();
+
+         for( std::size_t l = 0; l < n; ++l )
+            Vk[l * n + l] += sigma;
+
+         //V_k = L_k L_k^T
+         ok = cholesky_factor( Vk, n, n ) == 0;
+
+         if( !ok )
+            break;
+
+         //Y_k = L_k^-1 W_k and y = L_k^-1 g_k
+         blas::trsm( CblasLeft, CblasNoTrans, CblasNonUnit, n, G, REAL( 1 ), Vk, n, Yk, G );
+         std::copy( g.get() + layout.offset( k ), g.get() + layout.offset( k ) + n, y.get() );
+         blas::trsv( CblasNoTrans, CblasNonUnit, n, Vk, n, y.get(), 1 );
+
+         //S -= Y_k^T Y_k and rhs += Y_k^T y
+         blas::syrk( CblasTrans, G, n, REAL( -1 ), Yk, G, REAL( 1 ), S.get(), G );
+         blas::gemv( CblasTrans, n, G, REAL( 1 ), Yk, G, y.get(), 1, REAL( 1 ), rhs.get(), 1 );
+      }
+
+      ok = ok && ( G == 0 || cholesky_solve( S.get(), G, rhs.get(), G ) == 0 );
+
+      if( !ok )
+         return this->steepest_descent( s );
+
+      std::copy( rhs.get(), rhs.get() + G, s );
+
+      //local steps s_k = -L_k^-T ( L_k^-1 g_k + Y_k s_global )
+      for( std::size_t k = 0; k < groups.size(); ++k )
+      {
+         const std::size_t n = groups[k].num_local();
+         const std::size_t off = layout.offset( k );
+
+         if( n == 0 )
+            continue;
+
+         REAL *sk = s + off;
+         std::copy( g.get() + off, g.get() + off + n, sk );
+         blas::trsv( CblasNoTrans, CblasNonUnit, n, V[k].data(), n, sk, 1 );
+         blas::gemv( CblasNoTrans, n, G, REAL( 1 ), W[k].data(), G, s, 1, REAL( 1 ), sk, 1 );
+         blas::trsv( CblasTrans, CblasNonUnit, n, V[k].data(), n, sk, 1 );
+         blas::scal( n, REAL( -1 ), sk, 1 );
+      }
+
+      return true;
+   }
+
+private:
+   const std::size_t G;
+   const std::size_t N;
+   Groups &groups;
+   const GroupResiduals<Groups> &layout;
+   std::unique_ptr<MD[]> ad_global;
+   std::unique_ptr<MD[]> ad_local;
+   std::vector<std::vector<REAL>> V;
+   std::vector<std::vector<REAL>> W;
+   array U;
+   array S;
+   array rhs;
+   array y;
+};
+
+} //internal
+
+/**
+ * \brief Compute parameters such that the sum of squares of residuals with local and global parameters is minimized.
+ *
+ * The residuals come in groups, e.g. the observations of one camera or one point in bundle adjustment. Each group
+ * has its own local parameters that no other group depends on, and all groups may depend on the global parameters.
+ * Every group is evaluated with MultiDiff objects of only num_global + num_local directions and the Gauß-Newton step
+ * is computed by eliminating the local parameters with the small cholesky decompositions of their blocks and solving
+ * the Schur complement for the global parameters. Instead of a dense NxN factorization this costs one small decomposition
+ * per group and one of size num_global. A structured secant update is not used since it would destroy the block structure.
+ *
+ * \param tolerance     Same as for gn_sbfgs_min.
+ * \param num_global    Number of global parameters.
+ * \param params        On input contains the initial parameters and on output the parameters that minimize the sum of squares
+ *                      of the residuals. The first num_global entries are the global parameters followed by the local parameters
+ *                      of each group in order.
+ * \param groups        An array or vector of residual groups. Each group must have the members num_local() returning the number of
+ *                      its local parameters, size() returning its number of residuals and a templated operator()( i, global, local )
+ *                      returning residual i for the given pointers to the global and its local parameters.
+ * \param monitor       Same as for gn_sbfgs_min.
+ */
+template<typename VERBOSITY = Verbose , int MAXITER = 1000, typename REAL, typename Groups, typename Monitor = internal::NoMonitor>
+void gn_schur_min( REAL tolerance, std::size_t num_global, simd::aligned_vector<REAL> &params, Groups groups, Monitor monitor = Monitor() )
+{
+   using Model = internal::SchurModel<VERBOSITY, REAL, Groups>;
+   internal::GroupResiduals<Groups> residuals( groups, num_global );
+
+   if( residuals.num_parameters() != params.size() )
+      throw std::invalid_argument( "number of parameters does not match the local parameters of the groups" );
+
+   typename MultiDiff<REAL>::Context ctx( Model::num_directions( groups, num_global ) );
+   {
+      internal::IdentityTransform pt;
+      Model model( num_global, groups, residuals );
+      internal::line_search_min<VERBOSITY, MAXITER>( tolerance, params, residuals, pt, model, monitor, static_cast<const internal::SbfgsState<REAL> *>( nullptr ) );
+   } //ctx gets destroyed
+} //end of gn_schur_min
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,371 @@
+#ifndef _CPPLSQ_GN_SPARSE_MIN_HPP_
+#define _CPPLSQ_GN_SPARSE_MIN_HPP_
+
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "regularized_gn.hpp"
+#include "sparse_cholesky.hpp"
+#include "sparsity.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Whether the residuals declare the parameters they depend on with a member function parameters()
+ * that returns a range of parameter indices.
+ */
+template<typename Residuals, typename = void>
+struct HasLocalParameters : std::false_type {};
+
+template<typename Residuals>
+struct HasLocalParameters<Residuals, decltype( ( void ) std::declval<Residuals &>()[0].parameters() )> : std::true_type {};
+
+/**
+ * Presents residuals with declared parameters like residuals of all parameters, so that they can be
+ * evaluated by the line search. Each call gathers the declared parameters, which were collected once
+ * before, into a buffer of the size of the largest number of declared parameters that is reused by
+ * all calls of the thread.
+ */
+template<typename Residuals>
+class GatherResiduals
+{
+public:
+   using Residual = typename std::remove_reference<decltype( std::declval<Residuals &>()[0] )>::type;
+
+   struct Gather
+   {
+      template<typename T>
+      T operator()( const T *params )
+      {
+         static thread_local std::vector<T> local;
+
+         if( local.size() < K )
+            local.resize( K );
+
+         for( std::size_t a = 0; a < cols.size(); ++a )
+            local[a] = params[cols[a]];
+
+         return residual( static_cast<const T *>( local.data() ) );
+      }
+
+      Residual &residual;
+      const std::vector<std::size_t> &cols;
+      const std::size_t K;
+   };
+
+   /**
+    * \param rows    The declared parameters of each residual in declared order.
+    * \param K       The largest number of declared parameters.
+    */
+   GatherResiduals( Residuals &residuals, const std::vector<std::vector<std::size_t>> &rows, std::size_t K ) :
+      residuals( residuals ), rows( rows ), K( K ) {}
+
+   std::size_t size() const
+   {
+      return residuals.size();
+   }
+
+   Gather operator[]( std::size_t i )
+   {
+      return Gather { residuals[i], rows[i], K };
+   }
+
+private:
+   Residuals &residuals;
+   const std::vector<std::vector<std::size_t>> &rows;
+   const std::size_t K;
+};
+
+/**
+ * Gauß-Newton model of the sum of squares with a sparse Gram matrix. The pattern of the Jacobian is
+ * given and its columns are colored such that columns of the same color never occur in the same row.
+ * The MultiDiff directions are the colors, so each residual gradient is computed in compressed form and
+ * its nonzeros are read from the direction of the color of their column. They are added directly into
+ * the sparse lower triangle of J^T J, whose pattern is fixed and analyzed once. The step solves
+ * (J^T J + sigma I) s = -g with a SparseCholesky.
+ *
+ * If the residuals declare their parameters (see HasLocalParameters) the colors are not used. Instead
+ * each residual is evaluated on its own k parameters, which are the first k MultiDiff directions, and its
+ * gradient and outer product are scattered into g and J^T J.
+ */
+template<typename VERBOSITY, typename REAL, typename Residuals, typename ParameterTransform>
+class SparseGramModel : public RegularizedGnModel<SparseGramModel<VERBOSITY, REAL, Residuals, ParameterTransform>, VERBOSITY, REAL>
+{
+   using Base = RegularizedGnModel<SparseGramModel, VERBOSITY, REAL>;
+   using Base::CN;
+   using Base::g;
+   using Base::sigma;
+
+public:
+   using MD = MultiDiff<REAL>;
+
+   /**
+    * Must be constructed after the MultiDiff::Context for as many directions as there are colors,
+    * or as the largest number of declared parameters of a residual.
+    *
+    * \param rows    Sorted column indices of the nonzeros of each row of the Jacobian. For residuals
+    *                with declared parameters the declared parameters in declared order.
+    * \param color   Color of each column as computed by color_columns(). Empty for residuals with
+    *                declared parameters.
+    */
+   SparseGramModel( std::size_t N, std::vector<std::vector<std::size_t>> rows, std::vector<std::size_t> color, Residuals &residuals, ParameterTransform &pt ) :
+      Base( N ), N( N ), M( residuals.size() ), residuals( residuals ), pt( pt ),
+      ad_params( new MD[N] ), rows( std::move( rows ) ), color( std::move( color ) ), pattern( N ), values( N )
+   {
+      for( std::size_t j = 0; j < N; ++j )
+         pattern[j].push_back( j );
+
+      for( const std::vector<std::size_t> &cols : this->rows )
+      {
+         for( std::size_t b = 0; b < cols.size(); ++b )
+         {
+            for( std::size_t a = b + 1; a < cols.size(); ++a )
+               pattern[std::min( cols[a], cols[b] )].push_back( std::max( cols[a], cols[b] ) );
+         }
+      }
+
+      for( std::size_t j = 0; j < N; ++j )
+      {
+         std::sort( pattern[j].begin(), pattern[j].end() );
+         pattern[j].erase( std::unique( pattern[j].begin(), pattern[j].end() ), pattern[j].end() );
+         values[j].resize( pattern[j].size() );
+      }
+
+      chol.analyze( pattern );
+   }
+
+   /**
+    * Evaluate the residuals at the given parameters, compute the gradient g and the sparse
+    * Gram matrix J^T J and return the sum of squared residuals.
+    */
+   REAL evaluate( const REAL *params )
+   {
+      aligned_fill( zero<REAL>(), g.get(), g.get() + CN );
+
+      for( std::vector<REAL> &v : values )
+         std::fill( v.begin(), v.end(), REAL( 0 ) );
+
+      return evaluate( params, HasLocalParameters<Residuals>() );
+   }
+
+   /**
+    * Compute the step s = -(J^T J + sigma I)^-1 g. If the factorization fails the steepest
+    * descent direction -g is used and false is returned.
+    */
+   bool direction( REAL *s )
+   {
+      this->steepest_descent( s );
+
+      //s is still -g if the factorization fails
+      if( chol.factorize( values, sigma ) != 0 )
+         return false;
+
+      chol.solve( s );
+      return true;
+   }
+
+   void report() const
+   {
+      internal::Stream<VERBOSITY>() << "L: " << chol.factor_size();
+   }
+
+   /**
+    * The rows passed to the constructor.
+    */
+   const std::vector<std::vector<std::size_t>> &jacobian_rows() const
+   {
+      return rows;
+   }
+
+private:
+   /**
+    * Evaluate the residuals on all parameters with the directions of the colors of their columns.
+    */
+   REAL evaluate( const REAL *params, std::false_type )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+         ad_params[i].setIndependent( params[i], color[i] );
+
+      auto tp = pt( ad_params.get() );
+      REAL normr2 = 0;
+
+      for( std::size_t i = 0; i < M; ++i )
+      {
+         MD residual = residuals[i]( tp );
+         const REAL rval = residual.getValue();
+         normr2 += rval * rval;
+         const REAL *dr = static_cast<const MD &>( residual ).getDiffValues();
+         const std::vector<std::size_t> &cols = rows[i];
+
+         //decompress the gradient
+         dense.resize( cols.size() );
+
+         for( std::size_t a = 0; a < cols.size(); ++a )
+         {
+            dense[a] = dr[color[cols[a]]];
+            g[cols[a]] += rval * dense[a];
+         }
+
+         for( std::size_t b = 0; b < cols.size(); ++b )
+         {
+            for( std::size_t a = b; a < cols.size(); ++a )
+               add( cols[a], cols[b], dense[a] * dense[b] );
+         }
+      }
+
+      return normr2;
+   }
+
+   /**
+    * Evaluate each residual on its declared parameters only.
+    */
+   REAL evaluate( const REAL *params, std::true_type )
+   {
+      static_assert( std::is_same<ParameterTransform, IdentityTransform>::value, "residuals with declared parameters are evaluated on the untransformed parameters" );
+      REAL normr2 = 0;
+
+      for( std::size_t i = 0; i < M; ++i )
+      {
+         const std::vector<std::size_t> &local_cols = rows[i];
+
+         for( std::size_t a = 0; a < local_cols.size(); ++a )
+            ad_params[a].setIndependent( params[local_cols[a]], a );
+
+         MD residual = residuals[i]( static_cast<const MD *>( ad_params.get() ) );
+         const REAL rval = residual.getValue();
+         normr2 += rval * rval;
+         const REAL *dr = static_cast<const MD &>( residual ).getDiffValues();
+
+         //scatter the gradient and the outer product
+         for( std::size_t a = 0; a < local_cols.size(); ++a )
+         {
+            const std::size_t ja = local_cols[a];
+            g[ja] += rval * dr[a];
+
+            for( std::size_t b = 0; b <= a; ++b )
+               add( std::max( ja, local_cols[b] ), std::min( ja, local_cols[b] ), dr[a] * dr[b] );
+         }
+      }
+
+      return normr2;
+   }
+
+   /**
+    * Add val to entry (i, j), i >= j, of the Gram matrix, which must be in the pattern.
+    */
+   void add( std::size_t i, std::size_t j, REAL val )
+   {
+      const std::vector<std::size_t> &col = pattern[j];
+      auto pos = std::lower_bound( col.begin(), col.end(), i );
+      assert( pos != col.end() && *pos == i );
+      values[j][pos - col.begin()] += val;
+   }
+
+   const std::size_t N;
+   const std::size_t M;
+   Residuals &residuals;
+   ParameterTransform &pt;
+   std::unique_ptr<MD[]> ad_params;
+   std::vector<std::vector<std::size_t>> rows;
+   std::vector<std::size_t> color;
+   std::vector<std::vector<std::size_t>> pattern;
+   std::vector<std::vector<REAL>> values;
+   std::vector<REAL> dense;
+   SparseCholesky<REAL> chol;
+};
+
+template<typename VERBOSITY, int MAXITER, typename REAL, typename Residuals, typename ParameterTransform, typename Monitor>
+void gn_sparse_min_impl( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals &residuals, ParameterTransform &parameterTransform, Monitor &monitor, std::false_type )
+{
+   const std::size_t N = params.size();
+   std::vector<std::vector<std::size_t>> rows;
+   {
+      //the transform may allocate MultiDiff objects in num_parameters
+      typename MultiDiff<REAL>::Context ctx( 1 );
+      ParameterTransform pt = parameterTransform;
+      pt.num_parameters( N );
+      rows = jacobian_pattern( params.data(), N, residuals, pt );
+   }
+
+   std::size_t ncolors;
+   std::vector<std::size_t> color = color_columns( rows, N, ncolors );
+   Stream<VERBOSITY>() << "Jacobian: " << N << " columns in " << ncolors << " colors\n";
+
+   typename MultiDiff<REAL>::Context ctx( ncolors );
+   {
+      //move into scope that gets destroyed before the MultiDiff::Context
+      ParameterTransform pt = std::move( parameterTransform );
+      //now call init function of tranformator
+      pt.num_parameters( N );
+
+      SparseGramModel<VERBOSITY, REAL, Residuals, ParameterTransform> model( N, std::move( rows ), std::move( color ), residuals, pt );
+      line_search_min<VERBOSITY, MAXITER>( tolerance, params, residuals, pt, model, monitor, static_cast<const SbfgsState<REAL> *>( nullptr ) );
+   } //ctx gets destroyed
+}
+
+template<typename VERBOSITY, int MAXITER, typename REAL, typename Residuals, typename ParameterTransform, typename Monitor>
+void gn_sparse_min_impl( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals &residuals, ParameterTransform &parameterTransform, Monitor &monitor, std::true_type )
+{
+   const std::size_t N = params.size();
+   std::vector<std::vector<std::size_t>> rows( residuals.size() );
+   std::size_t K = 1;
+
+   for( std::size_t i = 0; i < rows.size(); ++i )
+   {
+      //the only call of parameters(), the model and the line search use the stored lists
+      for( std::size_t j : residuals[i].parameters() )
+         rows[i].push_back( j );
+
+      K = std::max( K, rows[i].size() );
+   }
+
+   typename MultiDiff<REAL>::Context ctx( K );
+   {
+      ParameterTransform pt = std::move( parameterTransform );
+      pt.num_parameters( N );
+
+      SparseGramModel<VERBOSITY, REAL, Residuals, ParameterTransform> model( N, std::move( rows ), std::vector<std::size_t>(), residuals, pt );
+      GatherResiduals<Residuals> gathered( residuals, model.jacobian_rows(), K );
+      line_search_min<VERBOSITY, MAXITER>( tolerance, params, gathered, pt, model, monitor, static_cast<const SbfgsState<REAL> *>( nullptr ) );
+   } //ctx gets destroyed
+}
+
+} //internal
+
+/**
+ * \brief Compute parameters such that the sum of squares of the (nonlinear) residuals is minimized using
+ *        a Gauß-Newton method with a sparse cholesky decomposition.
+ *
+ * Suitable for problems where every residual only depends on a few parameters, so that J^T J is banded
+ * or otherwise sparse. The Gram matrix is stored sparse and factorized with a supernodal cholesky decomposition
+ * after a fill reducing ordering, so the cost of a step depends on the fill-in instead of N^3. A structured
+ * secant update is not used since the secant matrix is dense in general.
+ *
+ * The pattern of the Jacobian is detected once at the initial parameters by evaluating the residuals with
+ * SparsityDiff, so it must not depend on the parameter values. Parameters that never occur in the same
+ * residual share a direction of the MultiDiff, so the number of directions is the number of colors of the
+ * Jacobian columns, e.g. 2 for the chained rosenbrock function, instead of N. The parameter transform is
+ * copied for this pass and must therefore be copyable.
+ *
+ * Alternatively the residuals can declare the parameters they depend on with a member function parameters()
+ * that returns a range of k distinct parameter indices. They are then called with a pointer to these k
+ * parameters only and evaluated with k MultiDiff directions, so that the cost per residual depends on k instead
+ * of N and no detection is necessary. The parameter transform must be the identity in this case.
+ *
+ * The arguments are the same as for gn_sbfgs_min.
+ */
+template<typename VERBOSITY = Verbose , int MAXITER = 1000, typename REAL, typename Residuals, typename ParameterTransform = internal::IdentityTransform, typename Monitor = internal::NoMonitor>
+void gn_sparse_min( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals residuals, ParameterTransform parameterTransform = ParameterTransform(), Monitor monitor = Monitor() )
+{
+   internal::gn_sparse_min_impl<VERBOSITY, MAXITER>( tolerance, params, residuals, parameterTransform, monitor, internal::HasLocalParameters<Residuals>() );
+} //end of gn_sparse_min
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef _CPPLSQ_LM_SBFGS_MIN_HPP_
+#define _CPPLSQ_LM_SBFGS_MIN_HPP_
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "gn_sbfgs_min.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Minimize the sum of squared residuals with a Levenberg-Marquardt trust region method using
+ * the matrix B of the given model. A step s solves (B + mu D) s = -g where D is the diagonal
+ * of B and is accepted if the decrease of the sum of squares is a sufficient fraction of the
+ * decrease predicted by the quadratic model. For a rejected step only the damping mu is increased
+ * and the damped matrix is factorized again; the residuals are evaluated at the trial point
+ * without derivatives.
+ */
+template<typename VERBOSITY, int MAXITER, typename REAL, typename Residuals, typename ParameterTransform, typename Model, typename Monitor>
+void trust_region_min( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals &residuals, ParameterTransform &pt, Model &model, Monitor &monitor )
+{
+   constexpr static int TRUSTREGION_MAXITER = 64;
+   constexpr static REAL eta = 1e-4;
+
+   internal::Stream<VERBOSITY>() << std::left << std::scientific;
+   using std::size_t;
+   const size_t N = params.size();
+   const size_t CN = simd::next_size<REAL> ( N );
+   const size_t M = residuals.size();
+
+   simd::aligned_array<REAL> s = simd::alloc_aligned_array<REAL>( CN );
+   simd::aligned_vector<REAL> trial( N );
+
+   auto eval_normr2 = [&]( const REAL * x ) -> REAL
+   {
+      auto tp = pt( x );
+      REAL f = 0;
+
+      for( size_t i = 0; i < M; ++i )
+      {
+         REAL residual = residuals[i]( tp );
+         f += residual * residual;
+      }
+
+      return f;
+   };
+
+   REAL normr2 = model.evaluate( params.data() );
+   const REAL *g = model.gradient();
+   model.init( normr2, static_cast<const SbfgsState<REAL> *>( nullptr ) );
+
+   int small_progress = 0;
+   REAL mu = 1e-3;
+   REAL nu = 2;
+
+   for( int k = 0; k < MAXITER; ++k )
+   {
+      bool accepted = false;
+
+      for( int l = 0; l < TRUSTREGION_MAXITER; ++l )
+      {
+         if( model.damped_direction( mu, s.get() ) )
+         {
+            REAL pred = model.predicted_decrease( s.get() );
+
+            for( size_t i = 0; i < N; ++i )
+               trial[i] = params[i] + s[i];
+
+            REAL trial_normr2 = eval_normr2( trial.data() );
+            REAL rho = 0.5 * ( normr2 - trial_normr2 ) / pred;
+
+            if( std::isfinite( trial_normr2 ) && pred > 0 && rho > eta )
+            {
+               //shrink the damping depending on the agreement of model and function
+               REAL t = 2 * rho - 1;
+               mu *= std::max( REAL( 1 ) / 3, 1 - t * t * t );
+               nu = 2;
+               accepted = true;
+               break;
+            }
+         }
+
+         mu *= nu;
+         nu *= 2;
+      }
+
+      if( !accepted )
+      {
+         internal::Stream<VERBOSITY>() << "no step giving sufficient decrease was found\n";
+         break;
+      }
+
+      for( size_t i = 0; i < N; ++i )
+         params[i] = trial[i];
+
+      //evaluate residuals gradient and z = (J1 - J0)^T * r1
+      REAL new_normr2 = model.evaluate( params.data() );
+      auto report_mu = [&]()
+      {
+         internal::Stream<VERBOSITY>() << "mu: " << std::setw( 14 ) << mu;
+      };
+
+      if( finish_iteration<VERBOSITY>( k, tolerance, params.data(), N, g, s.get(), normr2, new_normr2, small_progress, model, monitor, report_mu ) )
+         break;
+   }
+
+   internal::Stream<VERBOSITY>() << std::resetiosflags( std::ios::floatfield | std::ios::adjustfield );
+}
+
+} //internal
+
+/**
+ * \brief Compute parameters such that the sum of squares of the (nonlinear) residuals is minimized using a
+ *        Levenberg-Marquardt trust region method.
+ *
+ * Uses the same Gauß-Newton/structured BFGS matrix B as gn_sbfgs_min but instead of a line search along the
+ * step the step is computed from B plus a multiple of its diagonal, and the multiple is adjusted depending on
+ * the agreement between the predicted and actual decrease. Rejected steps only require a new factorization and
+ * a sweep over the residual values without derivatives, and B does not need to be positive definite.
+ *
+ * The arguments are the same as for gn_sbfgs_min, except that the parameter transform must also accept
+ * a pointer to REAL since the residuals are evaluated without derivatives at trial points.
+ */
+template<typename VERBOSITY = Verbose , int MAXITER = 1000, typename REAL, typename Residuals, typename ParameterTransform = internal::IdentityTransform, typename Monitor = internal::NoMonitor>
+void lm_sbfgs_min( REAL tolerance, simd::aligned_vector<REAL> &params, Residuals residuals, ParameterTransform parameterTransform = ParameterTransform(), Monitor monitor = Monitor() )
+{
+   const std::size_t N = params.size();
+   typename MultiDiff<REAL>::Context ctx( N );
+   {
+      //move into scope that gets destroyed before the MultiDiff::Context
+      ParameterTransform pt = std::move( parameterTransform );
+      //now call init function of tranformator
+      pt.num_parameters( N );
+
+      internal::SbfgsModel<VERBOSITY, REAL, Residuals, ParameterTransform> model( N, residuals, pt );
+      internal::trust_region_min<VERBOSITY, MAXITER>( tolerance, params, residuals, pt, model, monitor );
+   } //ctx gets destroyed
+} //end of lm_sbfgs_min
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef _CPPLSQ_MAPPED_DATASET_HPP_
+#define _CPPLSQ_MAPPED_DATASET_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <initializer_list>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Header of the columnar binary dataset format. The header is followed
+ * by the columns, each column holding num_rows values of the given
+ * element size. Every column starts at an offset that is a multiple of
+ * dataset_alignment() so that the columns can be read with aligned
+ * simd loads directly from the mapped file.
+ */
+struct DatasetHeader
+{
+   char magic[8];
+   std::uint32_t version;
+   std::uint32_t element_size;
+   std::uint64_t num_columns;
+   std::uint64_t num_rows;
+};
+
+constexpr std::size_t dataset_alignment()
+{
+   return 64;
+}
+
+constexpr const char *dataset_magic()
+{
+   return "CPLSQDS";
+}
+
+constexpr std::size_t dataset_align( std::size_t n )
+{
+   return ( ( n + dataset_alignment() - 1 ) / dataset_alignment() ) * dataset_alignment();
+}
+
+/**
+ * Owns a read only shared mapping of a file and unmaps it on destruction.
+ */
+class FileMapping
+{
+public:
+   explicit FileMapping( const std::string &path ) : addr( nullptr ), length( 0 )
+   {
+      int fd = ::open( path.c_str(), O_RDONLY );
+
+      if( fd < 0 )
+         throw std::system_error( errno, std::generic_category(), "cannot open " + path );
+
+      struct stat st;
+
+      if( ::fstat( fd, &st ) != 0 )
+      {
+         int err = errno;
+         ::close( fd );
+         throw std::system_error( err, std::generic_category(), "cannot stat " + path );
+      }
+
+      length = st.st_size;
+
+      if( length != 0 )
+      {
+         //shared mapping so that all processes reading the same file use the same pages of the page cache
+         void *p = ::mmap( nullptr, length, PROT_READ, MAP_SHARED, fd, 0 );
+
+         if( p == MAP_FAILED )
+         {
+            int err = errno;
+            ::close( fd );
+            throw std::system_error( err, std::generic_category(), "cannot map " + path );
+         }
+
+         addr = p;
+         //the solver sweeps over the residuals in order, so tell the kernel to read ahead aggressively
+         ::madvise( addr, length, MADV_SEQUENTIAL );
+      }
+
+      ::close( fd );
+   }
+
+   FileMapping( const FileMapping & ) = delete;
+   FileMapping &operator=( const FileMapping & ) = delete;
+
+   ~FileMapping()
+   {
+      if( addr )
+         ::munmap( addr, length );
+   }
+
+   const char *data() const
+   {
+      return static_cast<const char *>( addr );
+   }
+
+   std::size_t size() const
+   {
+      return length;
+   }
+
+private:
+   void *addr;
+   std::size_t length;
+};
+
+template<std::size_t... I>
+struct index_sequence {};
+
+template<std::size_t N, std::size_t... I>
+struct make_index_sequence_impl : make_index_sequence_impl < N - 1, N - 1, I... > {};
+
+template<std::size_t... I>
+struct make_index_sequence_impl<0, I...>
+{
+   using type = index_sequence<I...>;
+};
+
+template<std::size_t N>
+using make_index_sequence = typename make_index_sequence_impl<N>::type;
+
+} //internal
+
+/**
+ * \brief Read only, memory mapped view of a dataset stored in the columnar binary format.
+ *
+ * The file is mapped shared and read only, so opening a dataset costs neither parsing nor
+ * copying and concurrent processes share the pages in the page cache. Copies of a MappedDataset
+ * refer to the same mapping, which is released when the last copy is destroyed.
+ *
+ * \tparam REAL   type of the values stored in the columns.
+ */
+template<typename REAL>
+class MappedDataset
+{
+public:
+   /**
+    * Map the dataset file at the given path. Throws std::system_error if the
+    * file can not be opened or mapped and std::runtime_error if the file is
+    * not a dataset with elements of type REAL.
+    */
+   explicit MappedDataset( const std::string &path ) : mapping( std::make_shared<const internal::FileMapping>( path ) )
+   {
+      using internal::DatasetHeader;
+
+      if( mapping->size() < sizeof( DatasetHeader ) )
+         throw std::runtime_error( path + " is not a cpplsq dataset" );
+
+      const DatasetHeader *header = reinterpret_cast<const DatasetHeader *>( mapping->data() );
+
+      if( std::strncmp( header->magic, internal::dataset_magic(), sizeof( header->magic ) ) != 0 || header->version != 1 )
+         throw std::runtime_error( path + " is not a cpplsq dataset" );
+
+      if( header->element_size != sizeof( REAL ) )
+         throw std::runtime_error( path + " has a different element type" );
+
+      const std::size_t offset = internal::dataset_align( sizeof( DatasetHeader ) );
+
+      if( mapping->size() < offset )
+         throw std::runtime_error( path + " is truncated" );
+
+      //the sizes come from the file, so check them before computing with them to rule out overflows
+      if( header->num_rows > ( SIZE_MAX - internal::dataset_alignment() ) / sizeof( REAL ) )
+         throw std::runtime_error( path + " is truncated" );
+
+      nrows = header->num_rows;
+      stride = internal::dataset_align( nrows * sizeof( REAL ) );
+
+      if( stride != 0 && header->num_columns > ( mapping->size() - offset ) / stride )
+         throw std::runtime_error( path + " is truncated" );
+
+      ncols = header->num_columns;
+   }
+
+   std::size_t num_rows() const
+   {
+      return nrows;
+   }
+
+   std::size_t num_columns() const
+   {
+      return ncols;
+   }
+
+   /**
+    * Pointer to the values of column j. The pointer stays valid as long as
+    * a copy of this dataset exists.
+    */
+   const REAL *column( std::size_t j ) const
+   {
+      assert( j < ncols );
+      return reinterpret_cast<const REAL *>( mapping->data() + internal::dataset_align( sizeof( internal::DatasetHeader ) ) + j * stride );
+   }
+
+private:
+   std::shared_ptr<const internal::FileMapping> mapping;
+   std::size_t ncols;
+   std::size_t nrows;
+   std::size_t stride;
+};
+
+/**
+ * \brief Write the given columns of equal length to a file in the columnar binary dataset format.
+ *
+ * \param path       Name of the file to write. An existing file is overwritten.
+ * \param num_rows   Number of values in each column.
+ * \param columns    Pointers to the values of each column.
+ *
+ * Throws std::runtime_error if the file can not be written.
+ */
+template<typename REAL>
+void write_dataset( const std::string &path, std::size_t num_rows, const std::vector<const REAL *> &columns )
+{
+   using internal::DatasetHeader;
+
+   DatasetHeader header;
+   std::memset( &header, 0, sizeof( header ) );
+   std::strncpy( header.magic, internal::dataset_magic(), sizeof( header.magic ) );
+   header.version = 1;
+   header.element_size = sizeof( REAL );
+   header.num_columns = columns.size();
+   header.num_rows = num_rows;
+
+   std::ofstream out( path, std::ios::binary | std::ios::trunc );
+   const std::vector<char> padding( internal::dataset_alignment(), 0 );
+   const std::size_t header_pad = internal::dataset_align( sizeof( header ) ) - sizeof( header );
+   const std::size_t column_bytes = num_rows * sizeof( REAL );
+   const std::size_t column_pad = internal::dataset_align( column_bytes ) - column_bytes;
+
+   out.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+   out.write( padding.data(), header_pad );
+
+   for( const REAL *col : columns )
+   {
+      out.write( reinterpret_cast<const char *>( col ), column_bytes );
+      out.write( padding.data(), column_pad );
+   }
+
+   if( !out )
+      throw std::runtime_error( "cannot write dataset " + path );
+}
+
+template<typename REAL>
+void write_dataset( const std::string &path, std::size_t num_rows, std::initializer_list<const REAL *> columns )
+{
+   write_dataset<REAL>( path, num_rows, std::vector<const REAL *>( columns ) );
+}
+
+/**
+ * \brief Random access range of residual functors backed by a MappedDataset.
+ *
+ * The i-th element is the residual functor RESIDUAL constructed from the values
+ * of the first NCOLS columns in row i, e.g. for RESIDUAL(x, y) and NCOLS = 2 the
+ * first column holds the x and the second column the y values. The functors are
+ * created on the fly when the solver accesses them, so the range can be passed to
+ * gn_sbfgs_min in place of a vector of functors without materializing it.
+ */
+template<typename RESIDUAL, std::size_t NCOLS, typename REAL = double>
+class MappedResiduals
+{
+public:
+   explicit MappedResiduals( MappedDataset<REAL> dataset ) : dataset( std::move( dataset ) )
+   {
+      if( this->dataset.num_columns() < NCOLS )
+         throw std::runtime_error( "dataset has too few columns for residual" );
+
+      for( std::size_t j = 0; j < NCOLS; ++j )
+         cols[j] = this->dataset.column( j );
+   }
+
+   std::size_t size() const
+   {
+      return dataset.num_rows();
+   }
+
+   RESIDUAL operator[]( std::size_t i ) const
+   {
+      return make_residual( i, internal::make_index_sequence<NCOLS>() );
+   }
+
+   const MappedDataset<REAL> &data() const
+   {
+      return dataset;
+   }
+
+private:
+   template<std::size_t... J>
+   RESIDUAL make_residual( std::size_t i, internal::index_sequence<J...> ) const
+   {
+      return RESIDUAL( cols[J][i]... );
+   }
+
+   MappedDataset<REAL> dataset;
+   const REAL *cols[NCOLS];
+};
+
+} //cpplsq
+
+#endif
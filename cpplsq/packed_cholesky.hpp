@@ -0,0 +1,271 @@
+#ifndef _CPPLSQ_PACKED_CHOLESKY_HPP_
+#define _CPPLSQ_PACKED_CHOLESKY_HPP_
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include "Blas.hpp"
+
+namespace cpplsq
+{
+
+/**
+ * Number of entries of the lower triangle of a NxN matrix in packed storage.
+ */
+constexpr std::size_t packed_size( std::size_t N )
+{
+   return N * ( N + 1 ) / 2;
+}
+
+/**
+ * Position of the entry (i, j), j <= i, of a lower triangle packed row by row.
+ */
+constexpr std::size_t packed_index( std::size_t i, std::size_t j )
+{
+   return i * ( i + 1 ) / 2 + j;
+}
+
+/**
+ * \brief Compute the cholesky decomposition A = LL^T of a symmetric positive definite matrix A in packed storage.
+ *
+ * Same as cholesky_factor() but the lower triangle of A is packed row by row, i.e. row i starts at i * ( i + 1 ) / 2,
+ * which is the storage used by the blas routines spr, spmv and tpsv for the row major lower triangle. The columns are
+ * computed from left to right and the update of column k consists of dot products of the contiguous first k entries of
+ * the rows.
+ *
+ * \param AP         On input the packed lower triangle of a symmetric positive definite matrix and on output L.
+ * \param N          Size of A, i.e. A is a NxN matrix.
+ *
+ * \return           Same as for cholesky_factor(). If k > 0 is returned the columns before k - 1 contain L and
+ *                   column k - 1 contains the updated entries.
+ */
+template<typename REAL>
+int packed_cholesky_factor( REAL *AP, std::size_t N )
+{
+   using std::size_t;
+
+   for( size_t k = 0; k < N; ++k )
+   {
+      const REAL *rk = AP + packed_index( k, 0 );
+
+      for( size_t i = k; i < N; ++i )
+         AP[packed_index( i, k )] -= blas::dot( k, AP + packed_index( i, 0 ), 1, rk, 1 );
+
+      REAL &akk = AP[packed_index( k, k )];
+
+      if( akk < 0 )
+         return k + 1;
+
+      akk = std::sqrt( akk );
+
+      for( size_t i = k + 1; i < N; ++i )
+         AP[packed_index( i, k )] /= akk;
+   }
+
+   return 0;
+}
+
+/**
+ * \brief Same as packed_cholesky_factor() for a size N that is known at compile time.
+ *
+ * All loops have a fixed trip count and no blas routine is called, so that the compiler can unroll the
+ * decomposition completely for small N.
+ */
+template<std::size_t N, typename REAL>
+int packed_cholesky_factor( REAL *AP )
+{
+   using std::size_t;
+
+   for( size_t k = 0; k < N; ++k )
+   {
+      const REAL *rk = AP + packed_index( k, 0 );
+
+      for( size_t i = k; i < N; ++i )
+      {
+         const REAL *ri = AP + packed_index( i, 0 );
+         REAL s = ri[k];
+
+         for( size_t j = 0; j < k; ++j )
+            s -= ri[j] * rk[j];
+
+         AP[packed_index( i, k )] = s;
+      }
+
+      REAL &akk = AP[packed_index( k, k )];
+
+      if( akk < 0 )
+         return k + 1;
+
+      akk = std::sqrt( akk );
+
+      for( size_t i = k + 1; i < N; ++i )
+         AP[packed_index( i, k )] /= akk;
+   }
+
+   return 0;
+}
+
+/**
+ * \brief Same as cholesky_factor_modified() for a matrix in packed storage.
+ *
+ * \param AP         On input the packed lower triangle of a symmetric matrix, or the partial factor computed by
+ *                   packed_cholesky_factor(), and on output L.
+ * \param N          Size of A, i.e. A is a NxN matrix.
+ * \param start      First column that is not yet factorized. Its entries must already be updated.
+ *
+ * \return           The largest entry of E.
+ */
+template<typename REAL>
+REAL packed_cholesky_factor_modified( REAL *AP, std::size_t N, std::size_t start = 0 )
+{
+   using std::size_t;
+   using std::abs;
+
+   const REAL eps = std::numeric_limits<REAL>::epsilon();
+   REAL gamma = 0;
+   REAL xi = 0;
+
+   for( size_t i = start; i < N; ++i )
+   {
+      for( size_t j = start; j < i; ++j )
+         xi = std::max( xi, abs( AP[packed_index( i, j )] ) );
+
+      gamma = std::max( gamma, abs( AP[packed_index( i, i )] ) );
+   }
+
+   const REAL beta2 = std::max( std::max( gamma, N > 1 ? xi / std::sqrt( REAL( N * N - 1 ) ) : REAL( 0 ) ), eps );
+   const REAL delta = eps * std::max( gamma + xi, REAL( 1 ) );
+   REAL emax = 0;
+
+   for( size_t k = start; k < N; ++k )
+   {
+      const REAL *rk = AP + packed_index( k, 0 );
+      REAL theta = 0;
+
+      for( size_t i = k; i < N; ++i )
+      {
+         REAL &aik = AP[packed_index( i, k )];
+
+         if( k > start )
+            aik -= blas::dot( k, AP + packed_index( i, 0 ), 1, rk, 1 );
+
+         if( i > k )
+            theta = std::max( theta, abs( aik ) );
+      }
+
+      REAL &akk = AP[packed_index( k, k )];
+      const REAL d = std::max( std::max( abs( akk ), theta * theta / beta2 ), delta );
+      emax = std::max( emax, d - akk );
+      akk = std::sqrt( d );
+
+      for( size_t i = k + 1; i < N; ++i )
+         AP[packed_index( i, k )] /= akk;
+   }
+
+   return emax;
+}
+
+/**
+ * \brief Solve Ax = b for symmetric positive definite matrix A in packed storage using cholesky decomposition.
+ *
+ * \param AP         On input the packed lower triangle of a symmetric positive definite matrix and on output L.
+ * \param b          On input the right hand side of linear system on output the solution.
+ * \param N          Size of A and b, i.e. A is a NxN matrix and b is a vector of size N.
+ *
+ * \return           Same as for cholesky_solve().
+ */
+template<typename REAL>
+int packed_cholesky_solve( REAL *AP, REAL *b, std::size_t N )
+{
+   int pos = packed_cholesky_factor( AP, N );
+
+   if( pos )
+      return pos;
+
+   blas::tpsv( CblasNoTrans, CblasNonUnit, N, AP, b, 1 );
+   blas::tpsv( CblasTrans, CblasNonUnit, N, AP, b, 1 );
+   return 0;
+}
+
+/**
+ * \brief Same as cholesky_solve_mixed() for a matrix in packed storage.
+ *
+ * \param AP         The packed lower triangle of a symmetric positive definite matrix. Is not modified.
+ * \param b          On input the right hand side of linear system on output the solution. Is only
+ *                   modified if 0 is returned.
+ * \param N          Size of A and b, i.e. A is a NxN matrix and b is a vector of size N.
+ * \param maxiter    Maximum number of refinement steps.
+ *
+ * \return           Same as for cholesky_solve_mixed().
+ */
+template<typename FACTOR, typename REAL>
+int packed_cholesky_solve_mixed( const REAL *AP, REAL *b, std::size_t N, int maxiter = 30 )
+{
+   using std::size_t;
+   std::vector<FACTOR> L( AP, AP + packed_size( N ) );
+   std::vector<FACTOR> d( N );
+   std::vector<REAL> x( N, REAL( 0 ) );
+   std::vector<REAL> res( b, b + N );
+   //absolute row sums of the symmetric matrix for its infinity norm
+   std::vector<REAL> rowsum( N, REAL( 0 ) );
+
+   for( size_t i = 0; i < N; ++i )
+   {
+      for( size_t j = 0; j <= i; ++j )
+      {
+         rowsum[i] += std::abs( AP[packed_index( i, j )] );
+
+         if( j < i )
+            rowsum[j] += std::abs( AP[packed_index( i, j )] );
+      }
+   }
+
+   const REAL anorm = N ? *std::max_element( rowsum.begin(), rowsum.end() ) : REAL( 0 );
+
+   int pos = packed_cholesky_factor( L.data(), N );
+
+   if( pos )
+      return pos;
+
+   const REAL tol = anorm * std::numeric_limits<REAL>::epsilon() * std::sqrt( REAL( N ) );
+
+   for( int k = 0; k < maxiter; ++k )
+   {
+      //solve for the correction in precision FACTOR
+      std::copy( res.begin(), res.end(), d.begin() );
+      blas::tpsv( CblasNoTrans, CblasNonUnit, N, L.data(), d.data(), 1 );
+      blas::tpsv( CblasTrans, CblasNonUnit, N, L.data(), d.data(), 1 );
+
+      for( size_t i = 0; i < N; ++i )
+         x[i] += d[i];
+
+      //res = b - Ax
+      std::copy( b, b + N, res.begin() );
+      blas::spmv( N, REAL( -1 ), AP, x.data(), 1, REAL( 1 ), res.data(), 1 );
+
+      REAL rmax = 0;
+      REAL xmax = 0;
+
+      for( size_t i = 0; i < N; ++i )
+      {
+         rmax = std::max( rmax, std::abs( res[i] ) );
+         xmax = std::max( xmax, std::abs( x[i] ) );
+      }
+
+      if( !std::isfinite( rmax ) )
+         return -1;
+
+      if( rmax <= xmax * tol )
+      {
+         std::copy( x.begin(), x.end(), b );
+         return 0;
+      }
+   }
+
+   return -1;
+}
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,345 @@
+#ifndef _CPPLSQ_PROBLEM_RECORD_HPP_
+#define _CPPLSQ_PROBLEM_RECORD_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <simd/alloc.hpp>
+#include "gn_sbfgs_min.hpp"
+#include "mapped_dataset.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+constexpr const char *record_magic()
+{
+   return "CPLSQRC";
+}
+
+template<typename T>
+void write_raw( std::ostream &out, const T &val )
+{
+   out.write( reinterpret_cast<const char *>( &val ), sizeof( T ) );
+}
+
+template<typename T>
+void write_raw( std::ostream &out, const T *vals, std::size_t n )
+{
+   out.write( reinterpret_cast<const char *>( vals ), n * sizeof( T ) );
+}
+
+template<typename T>
+bool read_raw( std::istream &in, T &val )
+{
+   return bool( in.read( reinterpret_cast<char *>( &val ), sizeof( T ) ) );
+}
+
+template<typename T>
+bool read_raw( std::istream &in, T *vals, std::size_t n )
+{
+   return bool( in.read( reinterpret_cast<char *>( vals ), n * sizeof( T ) ) );
+}
+
+/**
+ * Whether the stream has at least n more items of the given size, without
+ * reading them. Used to check counts that are read from a file before
+ * allocating memory for them.
+ */
+inline bool has_items( std::istream &in, std::uint64_t n, std::size_t size )
+{
+   const std::istream::pos_type pos = in.tellg();
+
+   if( pos < 0 || !in.seekg( 0, std::ios::end ) )
+      return false;
+
+   const std::uint64_t remaining = std::uint64_t( in.tellg() - pos );
+   in.seekg( pos );
+   return bool( in ) && n <= remaining / size;
+}
+
+template<typename RESIDUAL, typename REAL, std::size_t... J>
+RESIDUAL make_residual( const std::vector<std::vector<REAL>> &columns, std::size_t i, index_sequence<J...> )
+{
+   return RESIDUAL( columns[J][i]... );
+}
+
+/**
+ * Monitor that stores the trajectory of the solver in memory.
+ */
+template<typename REAL>
+struct TrajectoryMonitor
+{
+   struct Entry
+   {
+      int iteration;
+      REAL normr2;
+      std::vector<REAL> params;
+   };
+
+   void operator()( const IterationInfo<REAL> &info )
+   {
+      trace->push_back( Entry { info.iteration, info.normr2, std::vector<REAL>( info.params, info.params + info.N ) } );
+   }
+
+   std::shared_ptr<std::vector<Entry>> trace = std::make_shared<std::vector<Entry>>();
+};
+
+} //internal
+
+/**
+ * \brief Monitor for gn_sbfgs_min that records a problem instance and the trajectory of the solver to a binary file.
+ *
+ * The file starts with the tolerance, the initial parameters, a name identifying the kind of residual
+ * and the residual data as columns like in the dataset format of MappedDataset. When the recorder is used
+ * as the monitor of gn_sbfgs_min the iteration number, the sum of squared residuals and the parameters of
+ * every iteration are appended. The recorded solve can then be rerun on the recorded data with replay_problem()
+ * without access to the code producing the data.
+ *
+ * Copies of a recorder write to the same file, so it can be passed by value to gn_sbfgs_min.
+ */
+template<typename REAL>
+class ProblemRecorder
+{
+public:
+   /**
+    * \param path       Name of the file to write.
+    * \param kind       Name of the residual functor type which must be constructible from
+    *                   one value of each column, e.g. "exp_decay".
+    * \param tolerance  Tolerance passed to gn_sbfgs_min.
+    * \param params     Initial parameters passed to gn_sbfgs_min.
+    * \param num_rows   Number of residuals, i.e. number of values in each column.
+    * \param columns    Pointers to the values of the columns.
+    */
+   ProblemRecorder( const std::string &path, const std::string &kind, REAL tolerance, const simd::aligned_vector<REAL> &params,
+                    std::size_t num_rows, const std::vector<const REAL *> &columns ) :
+      out( std::make_shared<std::ofstream>( path, std::ios::binary | std::ios::trunc ) )
+   {
+      char magic[8] = {};
+      std::strncpy( magic, internal::record_magic(), sizeof( magic ) );
+      out->write( magic, sizeof( magic ) );
+      internal::write_raw( *out, std::uint32_t( 1 ) );
+      internal::write_raw( *out, std::uint32_t( sizeof( REAL ) ) );
+      internal::write_raw( *out, tolerance );
+      internal::write_raw( *out, std::uint64_t( params.size() ) );
+      internal::write_raw( *out, params.data(), params.size() );
+      internal::write_raw( *out, std::uint64_t( kind.size() ) );
+      out->write( kind.data(), kind.size() );
+      internal::write_raw( *out, std::uint64_t( num_rows ) );
+      internal::write_raw( *out, std::uint64_t( columns.size() ) );
+
+      for( const REAL *col : columns )
+         internal::write_raw( *out, col, num_rows );
+
+      if( !*out )
+         throw std::runtime_error( "cannot write problem record " + path );
+   }
+
+   /**
+    * Record the residual data of a mapped residual range.
+    */
+   template<typename RESIDUAL, std::size_t NCOLS>
+   ProblemRecorder( const std::string &path, const std::string &kind, REAL tolerance, const simd::aligned_vector<REAL> &params,
+                    const MappedResiduals<RESIDUAL, NCOLS, REAL> &residuals ) :
+      ProblemRecorder( path, kind, tolerance, params, residuals.size(), columns_of( residuals.data(), NCOLS ) )
+   {
+   }
+
+   void operator()( const IterationInfo<REAL> &info )
+   {
+      internal::write_raw( *out, std::int32_t( info.iteration ) );
+      internal::write_raw( *out, info.normr2 );
+      internal::write_raw( *out, info.params, info.N );
+      out->flush();
+   }
+
+private:
+   static std::vector<const REAL *> columns_of( const MappedDataset<REAL> &data, std::size_t ncols )
+   {
+      std::vector<const REAL *> cols;
+
+      for( std::size_t j = 0; j < ncols; ++j )
+         cols.push_back( data.column( j ) );
+
+      return cols;
+   }
+
+   std::shared_ptr<std::ofstream> out;
+};
+
+/**
+ * \brief Problem instance and solver trajectory read from a file written by ProblemRecorder.
+ */
+template<typename REAL>
+struct ProblemRecord
+{
+   using Entry = typename internal::TrajectoryMonitor<REAL>::Entry;
+
+   /**
+    * Read the record from the given file. Throws std::runtime_error if the file
+    * can not be read or was not written by a ProblemRecorder<REAL>.
+    */
+   explicit ProblemRecord( const std::string &path )
+   {
+      std::ifstream in( path, std::ios::binary );
+      char magic[8];
+      std::uint32_t version, element_size;
+      std::uint64_t n, len, ncols;
+
+      if( !in )
+         throw std::runtime_error( "cannot open " + path );
+
+      if( !in.read( magic, sizeof( magic ) ) || std::strncmp( magic, internal::record_magic(), sizeof( magic ) ) != 0 ||
+            !internal::read_raw( in, version ) || version != 1 || !internal::read_raw( in, element_size ) )
+         throw std::runtime_error( path + " is not a cpplsq problem record" );
+
+      if( element_size != sizeof( REAL ) )
+         throw std::runtime_error( path + " has a different element type" );
+
+      //the sizes are checked against the rest of the file before anything is allocated for them
+      bool ok = internal::read_raw( in, tolerance ) && internal::read_raw( in, n ) && internal::has_items( in, n, sizeof( REAL ) );
+
+      if( ok )
+      {
+         params.resize( n );
+         ok = internal::read_raw( in, params.data(), n ) && internal::read_raw( in, len ) && internal::has_items( in, len, 1 );
+      }
+
+      if( ok )
+      {
+         kind.resize( len );
+         ok = bool( in.read( &kind[0], len ) ) && internal::read_raw( in, num_rows ) && internal::read_raw( in, ncols ) &&
+              internal::has_items( in, num_rows, sizeof( REAL ) ) &&
+              internal::has_items( in, ncols, std::max<std::size_t>( num_rows * sizeof( REAL ), 1 ) );
+      }
+
+      if( ok )
+      {
+         columns.resize( ncols, std::vector<REAL>( num_rows ) );
+
+         for( std::vector<REAL> &col : columns )
+            ok = ok && internal::read_raw( in, col.data(), num_rows );
+      }
+
+      if( !ok )
+         throw std::runtime_error( path + " is truncated" );
+
+      std::int32_t iteration;
+      REAL normr2;
+
+      while( internal::read_raw( in, iteration ) && internal::read_raw( in, normr2 ) )
+      {
+         Entry e { iteration, normr2, std::vector<REAL>( n ) };
+
+         if( !internal::read_raw( in, e.params.data(), n ) )
+            break;
+
+         trace.push_back( std::move( e ) );
+      }
+   }
+
+   REAL tolerance;
+   simd::aligned_vector<REAL> params;
+   std::string kind;
+   std::uint64_t num_rows;
+   std::vector<std::vector<REAL>> columns;
+   std::vector<Entry> trace;
+};
+
+/**
+ * Result of replaying a recorded problem.
+ */
+template<typename REAL>
+struct ReplayReport
+{
+   /// wall clock time of the solve in seconds
+   double seconds;
+   /// number of iterations in the recording
+   int recorded_iterations;
+   /// number of iterations of the replay
+   int replayed_iterations;
+   /// first iteration in which the sum of squares or the parameters differ from the recording, or -1
+   int first_divergence;
+   /// max relative difference in the sum of squares over the common iterations
+   REAL max_normr2_deviation;
+   /// max difference of the parameters relative to max(1, |p|) over the common iterations
+   REAL max_params_deviation;
+};
+
+/**
+ * \brief Rerun gn_sbfgs_min on a recorded problem and compare the trajectory with the recording.
+ *
+ * \param record       The recorded problem.
+ * \param threshold    Relative difference above which an iteration is reported as diverged.
+ * \tparam RESIDUAL    Residual functor type that is constructed from one value of each of the first NCOLS columns.
+ * \tparam NCOLS       Number of columns used to construct a residual.
+ */
+template<typename RESIDUAL, std::size_t NCOLS, int MAXITER = 1000, typename REAL>
+ReplayReport<REAL> replay_problem( const ProblemRecord<REAL> &record, REAL threshold = 0 )
+{
+   if( record.columns.size() < NCOLS )
+      throw std::runtime_error( "problem record has too few columns for residual " + record.kind );
+
+   std::vector<RESIDUAL> residuals;
+   residuals.reserve( record.num_rows );
+
+   for( std::size_t i = 0; i < record.num_rows; ++i )
+      residuals.push_back( internal::make_residual<RESIDUAL>( record.columns, i, internal::make_index_sequence<NCOLS>() ) );
+
+   simd::aligned_vector<REAL> params = record.params;
+   internal::TrajectoryMonitor<REAL> monitor;
+
+   auto start = std::chrono::steady_clock::now();
+   gn_sbfgs_min<Silent, MAXITER>( record.tolerance, params, residuals, internal::IdentityTransform(), monitor );
+   auto end = std::chrono::steady_clock::now();
+
+   ReplayReport<REAL> report;
+   report.seconds = std::chrono::duration<double>( end - start ).count();
+   report.recorded_iterations = record.trace.size();
+   report.replayed_iterations = monitor.trace->size();
+   report.first_divergence = -1;
+   report.max_normr2_deviation = 0;
+   report.max_params_deviation = 0;
+
+   const std::size_t common = std::min( record.trace.size(), monitor.trace->size() );
+
+   for( std::size_t k = 0; k < common; ++k )
+   {
+      const auto &rec = record.trace[k];
+      const auto &rep = ( *monitor.trace ) [k];
+      REAL dr = std::abs( rec.normr2 - rep.normr2 ) / std::max( std::abs( rec.normr2 ), std::numeric_limits<REAL>::min() );
+      REAL dp = 0;
+
+      for( std::size_t j = 0; j < params.size(); ++j )
+         dp = std::max( dp, std::abs( rec.params[j] - rep.params[j] ) / std::max( REAL( 1 ), std::abs( rec.params[j] ) ) );
+
+      report.max_normr2_deviation = std::max( report.max_normr2_deviation, dr );
+      report.max_params_deviation = std::max( report.max_params_deviation, dp );
+
+      if( report.first_divergence < 0 && ( dr > threshold || dp > threshold ) )
+         report.first_divergence = rec.iteration;
+   }
+
+   //otherwise the first iteration that only one of the trajectories has
+   if( report.first_divergence < 0 && record.trace.size() > common )
+      report.first_divergence = record.trace[common].iteration;
+   else if( report.first_divergence < 0 && monitor.trace->size() > common )
+      report.first_divergence = ( *monitor.trace )[common].iteration;
+
+   return report;
+}
+
+} //cpplsq
+
+#endif
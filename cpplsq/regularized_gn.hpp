@@ -0,0 +1,86 @@
+#ifndef _CPPLSQ_REGULARIZED_GN_HPP_
+#define _CPPLSQ_REGULARIZED_GN_HPP_
+
+#include <cmath>
+#include <cassert>
+#include "gn_sbfgs_min.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Common part of the Gauß-Newton models that compute the step s = -(J^T J + sigma I)^-1 g with a
+ * decomposition of their own and have no secant update. Holds the gradient g and the regularization
+ * sigma = 1e-4 |r|, which is recomputed for every new iterate. Like the Gauß-Newton fallback of
+ * gn_sbfgs_min it therefore shrinks with the residual, so it does not dominate the smallest eigenvalues
+ * of J^T J near a small residual solution and the convergence does not slow down to a linear rate.
+ *
+ * Derived is the model and may hide report() to add columns to the line of an iteration.
+ */
+template<typename Derived, typename VERBOSITY, typename REAL>
+class RegularizedGnModel
+{
+public:
+   void init( REAL normr2, const SbfgsState<REAL> *restart )
+   {
+      assert( !restart );
+      regularize( normr2 );
+   }
+
+   const REAL *gradient() const
+   {
+      return g.get();
+   }
+
+   void update( REAL *s, REAL normr2, REAL new_normr2 )
+   {
+      regularize( new_normr2 );
+      internal::Stream<VERBOSITY>() << "H: GN    ";
+      static_cast<const Derived *>( this )->report();
+      internal::Stream<VERBOSITY>() << "\n";
+   }
+
+   void describe( IterationInfo<REAL> &info ) const
+   {
+      info.A = nullptr;
+      info.secant = false;
+   }
+
+   void report() const {}
+
+protected:
+   explicit RegularizedGnModel( std::size_t N ) :
+      CN( simd::next_size<REAL>( N ) ), g( simd::alloc_aligned_array<REAL>( CN ) ), sigma( 0 ) {}
+
+   /**
+    * Set s = -g, which is the direction used if the regularized matrix can not be decomposed,
+    * and return false.
+    */
+   bool steepest_descent( REAL *s ) const
+   {
+      aligned_transform( []( const pack<REAL> &g )
+      {
+         return -g;
+      }, s, s + CN, g.get() );
+      return false;
+   }
+
+   const std::size_t CN;
+   simd::aligned_array<REAL> g;
+   REAL sigma;
+
+private:
+   void regularize( REAL normr2 )
+   {
+      sigma = 1e-4 * std::sqrt( normr2 );
+   }
+};
+
+} //internal
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _CPPLSQ_SIMD_ARCH_HPP_
+#define _CPPLSQ_SIMD_ARCH_HPP_
+
+namespace cpplsq
+{
+
+/**
+ * Name of the instruction set that the library was compiled for, which is selected
+ * with the cmake option CPPLSQ_ARCH. The width of pack<REAL> and thus the padding
+ * of the directions of MultiDiff follow this instruction set.
+ */
+const char *simd_arch();
+
+/**
+ * Whether the cpu supports the instruction set returned by simd_arch(). This is
+ * checked before the static initializers of the program run, so a program built for
+ * a wider instruction set stops with a message on an older cpu. One binary therefore
+ * serves only cpus with at least this instruction set; a fleet with mixed cpus needs
+ * one build per CPPLSQ_ARCH.
+ */
+bool simd_arch_supported();
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,322 @@
+#ifndef _CPPLSQ_SMALL_BLAS_HPP_
+#define _CPPLSQ_SMALL_BLAS_HPP_
+
+#include <cmath>
+#include <cstddef>
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Largest size for which the blas wrappers use the inline kernels below instead of calling
+ * cblas. For such sizes the call into the blas library costs more than the arithmetic.
+ */
+constexpr int small_blas_size = 16;
+
+/**
+ * Whether a vector of size n is handled by the inline kernels.
+ */
+inline bool is_small( int n )
+{
+   return n >= 1 && n <= small_blas_size;
+}
+
+/**
+ * Call Kernel<n>::run( args... ) for a size 1 <= n <= small_blas_size that is only known at runtime,
+ * so that the loops of the kernel have a fixed trip count and can be unrolled and vectorized completely.
+ */
+template<template<int> class Kernel, int N = 1>
+struct SmallDispatch
+{
+   template<typename... Args>
+   static void call( int n, Args... args )
+   {
+      if( n == N )
+         Kernel<N>::run( args... );
+      else
+         SmallDispatch<Kernel, N + 1>::call( n, args... );
+   }
+};
+
+template<template<int> class Kernel>
+struct SmallDispatch<Kernel, small_blas_size>
+{
+   template<typename... Args>
+   static void call( int n, Args... args )
+   {
+      Kernel<small_blas_size>::run( args... );
+   }
+};
+
+/**
+ * y = alpha x + y
+ */
+template<int N>
+struct SmallAxpy
+{
+   template<typename REAL>
+   static void run( REAL alpha, const REAL *x, int incx, REAL *y, int incy )
+   {
+      for( int i = 0; i < N; ++i )
+         y[i * incy] += alpha * x[i * incx];
+   }
+};
+
+/**
+ * result = x^T y
+ */
+template<int N>
+struct SmallDot
+{
+   template<typename REAL>
+   static void run( const REAL *x, int incx, const REAL *y, int incy, REAL *result )
+   {
+      REAL s = 0;
+
+      for( int i = 0; i < N; ++i )
+         s += x[i * incx] * y[i * incy];
+
+      *result = s;
+   }
+};
+
+/**
+ * x = alpha x
+ */
+template<int N>
+struct SmallScal
+{
+   template<typename REAL>
+   static void run( REAL alpha, REAL *x, int incx )
+   {
+      for( int i = 0; i < N; ++i )
+         x[i * incx] *= alpha;
+   }
+};
+
+/**
+ * A = A + alpha x x^T for the lower triangle of the row major matrix A.
+ */
+template<int N>
+struct SmallSyr
+{
+   template<typename REAL>
+   static void run( REAL alpha, const REAL *x, REAL *A, int lda )
+   {
+      for( int i = 0; i < N; ++i )
+      {
+         const REAL axi = alpha * x[i];
+
+         for( int j = 0; j <= i; ++j )
+            A[i * lda + j] += axi * x[j];
+      }
+   }
+};
+
+/**
+ * Same as SmallSyr for the lower triangle packed row by row.
+ */
+template<int N>
+struct SmallSpr
+{
+   template<typename REAL>
+   static void run( REAL alpha, const REAL *x, REAL *Ap )
+   {
+      for( int i = 0; i < N; ++i )
+      {
+         const REAL axi = alpha * x[i];
+         REAL *row = Ap + i * ( i + 1 ) / 2;
+
+         for( int j = 0; j <= i; ++j )
+            row[j] += axi * x[j];
+      }
+   }
+};
+
+/**
+ * y = alpha A x + beta y for the symmetric matrix A given by its row major lower triangle. The rows
+ * are located with the functor row( i ) so that the same kernel works for full and packed storage.
+ * As in blas y is not read if beta is zero.
+ */
+template<int N, typename REAL, typename Row>
+void small_symv( REAL alpha, Row row, const REAL *x, REAL beta, REAL *y )
+{
+   REAL t[N];
+
+   for( int i = 0; i < N; ++i )
+      t[i] = 0;
+
+   for( int i = 0; i < N; ++i )
+   {
+      const REAL *ai = row( i );
+      REAL s = 0;
+
+      for( int j = 0; j < i; ++j )
+      {
+         s += ai[j] * x[j];
+         t[j] += ai[j] * x[i];
+      }
+
+      t[i] += s + ai[i] * x[i];
+   }
+
+   for( int i = 0; i < N; ++i )
+      y[i] = beta == 0 ? alpha * t[i] : alpha * t[i] + beta * y[i];
+}
+
+template<int N>
+struct SmallSymv
+{
+   template<typename REAL>
+   static void run( REAL alpha, const REAL *A, int lda, const REAL *x, REAL beta, REAL *y )
+   {
+      small_symv<N>( alpha, [A, lda]( int i )
+      {
+         return A + i * lda;
+      }, x, beta, y );
+   }
+};
+
+template<int N>
+struct SmallSpmv
+{
+   template<typename REAL>
+   static void run( REAL alpha, const REAL *Ap, const REAL *x, REAL beta, REAL *y )
+   {
+      small_symv<N>( alpha, [Ap]( int i )
+      {
+         return Ap + i * ( i + 1 ) / 2;
+      }, x, beta, y );
+   }
+};
+
+/**
+ * Solve L x = b or L^T x = b in place for the lower triangular matrix L whose rows are located
+ * with the functor row( i ).
+ */
+template<int N, typename REAL, typename Row>
+void small_trsv( bool trans, bool unit, Row row, REAL *x )
+{
+   if( !trans )
+   {
+      for( int i = 0; i < N; ++i )
+      {
+         const REAL *li = row( i );
+         REAL s = x[i];
+
+         for( int j = 0; j < i; ++j )
+            s -= li[j] * x[j];
+
+         x[i] = unit ? s : s / li[i];
+      }
+   }
+   else
+   {
+      for( int i = N - 1; i >= 0; --i )
+      {
+         const REAL *li = row( i );
+
+         if( !unit )
+            x[i] /= li[i];
+
+         for( int j = 0; j < i; ++j )
+            x[j] -= li[j] * x[i];
+      }
+   }
+}
+
+template<int N>
+struct SmallTrsv
+{
+   template<typename REAL>
+   static void run( bool trans, bool unit, const REAL *A, int lda, REAL *x )
+   {
+      small_trsv<N>( trans, unit, [A, lda]( int i )
+      {
+         return A + i * lda;
+      }, x );
+   }
+};
+
+template<int N>
+struct SmallTpsv
+{
+   template<typename REAL>
+   static void run( bool trans, bool unit, const REAL *Ap, REAL *x )
+   {
+      small_trsv<N>( trans, unit, [Ap]( int i )
+      {
+         return Ap + i * ( i + 1 ) / 2;
+      }, x );
+   }
+};
+
+/**
+ * y = alpha op(A) x + beta y for the row major MxN matrix A. Both dimensions are only known at
+ * runtime, so this kernel is not dispatched on the size. As in blas y is not read if beta is zero.
+ */
+template<typename REAL>
+void small_gemv( bool trans, int M, int N, REAL alpha, const REAL *A, int lda, const REAL *x, int incx, REAL beta, REAL *y, int incy )
+{
+   if( !trans )
+   {
+      for( int i = 0; i < M; ++i )
+      {
+         const REAL *ai = A + i * lda;
+         REAL s = 0;
+
+         for( int j = 0; j < N; ++j )
+            s += ai[j] * x[j * incx];
+
+         REAL &yi = y[i * incy];
+         yi = beta == 0 ? alpha * s : alpha * s + beta * yi;
+      }
+   }
+   else
+   {
+      for( int j = 0; j < N; ++j )
+      {
+         REAL &yj = y[j * incy];
+         yj = beta == 0 ? REAL( 0 ) : beta * yj;
+      }
+
+      for( int i = 0; i < M; ++i )
+      {
+         const REAL *ai = A + i * lda;
+         const REAL axi = alpha * x[i * incx];
+
+         for( int j = 0; j < N; ++j )
+            y[j * incy] += axi * ai[j];
+      }
+   }
+}
+
+/**
+ * Index of the first entry of x with the largest absolute value.
+ */
+template<typename REAL>
+std::size_t small_iamax( int N, const REAL *x, int incx )
+{
+   std::size_t k = 0;
+   REAL m = std::abs( x[0] );
+
+   for( int i = 1; i < N; ++i )
+   {
+      if( std::abs( x[i * incx] ) > m )
+      {
+         m = std::abs( x[i * incx] );
+         k = i;
+      }
+   }
+
+   return k;
+}
+
+} //internal
+
+} //cpplsq
+
+#endif
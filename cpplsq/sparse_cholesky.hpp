@@ -0,0 +1,521 @@
+#ifndef _CPPLSQ_SPARSE_CHOLESKY_HPP_
+#define _CPPLSQ_SPARSE_CHOLESKY_HPP_
+
+#include <cstddef>
+#include <vector>
+#include <set>
+#include <utility>
+#include <algorithm>
+#include "Blas.hpp"
+#include "cholesky_solve.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+constexpr std::size_t no_index()
+{
+   return std::size_t( -1 );
+}
+
+/**
+ * Compute a minimum degree ordering of the symmetric matrix with the given lower triangular
+ * pattern by eliminating the nodes of the elimination graph in order of increasing degree.
+ * Returns perm such that column perm[k] is eliminated in step k.
+ */
+inline std::vector<std::size_t> minimum_degree_ordering( const std::vector<std::vector<std::size_t>> &pattern )
+{
+   const std::size_t N = pattern.size();
+   std::vector<std::vector<std::size_t>> adj( N );
+
+   for( std::size_t j = 0; j < N; ++j )
+   {
+      for( std::size_t i : pattern[j] )
+      {
+         if( i != j )
+         {
+            adj[i].push_back( j );
+            adj[j].push_back( i );
+         }
+      }
+   }
+
+   std::set<std::pair<std::size_t, std::size_t>> queue;
+
+   for( std::size_t j = 0; j < N; ++j )
+   {
+      std::sort( adj[j].begin(), adj[j].end() );
+      adj[j].erase( std::unique( adj[j].begin(), adj[j].end() ), adj[j].end() );
+      queue.emplace( adj[j].size(), j );
+   }
+
+   std::vector<std::size_t> perm;
+   perm.reserve( N );
+   std::vector<std::size_t> merged;
+
+   while( !queue.empty() )
+   {
+      const std::size_t v = queue.begin()->second;
+      queue.erase( queue.begin() );
+      perm.push_back( v );
+
+      //the neighbours of v become a clique
+      for( std::size_t u : adj[v] )
+      {
+         queue.erase( std::make_pair( adj[u].size(), u ) );
+         merged.clear();
+         std::set_union( adj[u].begin(), adj[u].end(), adj[v].begin(), adj[v].end(), std::back_inserter( merged ) );
+         merged.erase( std::remove_if( merged.begin(), merged.end(), [u, v]( std::size_t w )
+         {
+            return w == u || w == v;
+         } ), merged.end() );
+         adj[u].swap( merged );
+         queue.emplace( adj[u].size(), u );
+      }
+
+      adj[v].clear();
+      adj[v].shrink_to_fit();
+   }
+
+   return perm;
+}
+
+} //internal
+
+/**
+ * \brief Supernodal cholesky decomposition of sparse symmetric positive definite matrices.
+ *
+ * The symbolic analysis computes a fill reducing ordering, the elimination tree and the
+ * structure of the factor and groups columns with the same structure into supernodes. It only
+ * depends on the pattern of the matrix and is done once by analyze(). Then factorize() computes
+ * the numeric factorization for new values with the same pattern using dense blas calls on the
+ * supernodes, so the cost depends on the fill-in of the factor and not on N^3.
+ *
+ * Matrices are given by the lower triangle column by column: pattern[j] holds the sorted row
+ * indices i >= j of the nonzeros in column j, including the diagonal, and values[j] the
+ * corresponding values.
+ */
+template<typename REAL>
+class SparseCholesky
+{
+public:
+   SparseCholesky() : N( 0 ) {}
+
+   /**
+    * Perform the symbolic analysis for the given pattern.
+    */
+   void analyze( const std::vector<std::vector<std::size_t>> &pattern )
+   {
+      using internal::no_index;
+      N = pattern.size();
+
+      //fill reducing ordering
+      perm = internal::minimum_degree_ordering( pattern );
+      std::vector<std::size_t> iperm = inverse( perm );
+      std::vector<std::vector<std::size_t>> rows = permuted_rows( pattern, iperm );
+      std::vector<std::size_t> parent = elimination_tree( rows );
+
+      //relabel the columns in a postorder of the elimination tree so that the columns
+      //of a supernode are consecutive, this does not change the fill-in
+      {
+         std::vector<std::size_t> post = postorder( parent );
+
+         for( std::size_t k = 0; k < N; ++k )
+            post[k] = perm[post[k]];
+
+         perm.swap( post );
+         iperm = inverse( perm );
+         rows = permuted_rows( pattern, iperm );
+         parent = elimination_tree( rows );
+      }
+
+      //structure of the columns of L: struct(L_j) is the union of the pattern of
+      //column j of the matrix and the structures of the children of j without the child
+      std::vector<std::vector<std::size_t>> columns( N );
+      std::vector<std::size_t> children( N, 0 );
+      std::vector<std::size_t> marker( N, no_index() );
+
+      for( std::size_t j = 0; j < N; ++j )
+      {
+         if( parent[j] != no_index() )
+            ++children[parent[j]];
+      }
+
+      {
+         std::vector<std::vector<std::size_t>> lower( N );
+
+         for( std::size_t j = 0; j < N; ++j )
+            for( std::size_t i : rows[j] )
+               lower[i].push_back( j );
+
+         std::vector<std::vector<std::size_t>> child_lists( N );
+
+         for( std::size_t j = 0; j < N; ++j )
+         {
+            if( parent[j] != no_index() )
+               child_lists[parent[j]].push_back( j );
+         }
+
+         for( std::size_t j = 0; j < N; ++j )
+         {
+            std::vector<std::size_t> &col = columns[j];
+            col.push_back( j );
+            marker[j] = j;
+
+            for( std::size_t i : lower[j] )
+            {
+               if( marker[i] != j )
+               {
+                  marker[i] = j;
+                  col.push_back( i );
+               }
+            }
+
+            for( std::size_t c : child_lists[j] )
+            {
+               for( std::size_t i : columns[c] )
+               {
+                  if( i > j && marker[i] != j )
+                  {
+                     marker[i] = j;
+                     col.push_back( i );
+                  }
+               }
+            }
+
+            std::sort( col.begin(), col.end() );
+         }
+      }
+
+      //fundamental supernodes
+      first.clear();
+      col2sn.assign( N, 0 );
+
+      for( std::size_t j = 0; j < N; ++j )
+      {
+         bool extend = j > 0 && parent[j - 1] == j && children[j] == 1 && columns[j - 1].size() == columns[j].size() + 1;
+
+         if( !extend )
+            first.push_back( j );
+
+         col2sn[j] = first.size() - 1;
+      }
+
+      const std::size_t S = first.size();
+      first.push_back( N );
+      sn_rows.resize( S );
+      offset.resize( S + 1 );
+      offset[0] = 0;
+      std::size_t max_update = 0;
+
+      for( std::size_t s = 0; s < S; ++s )
+      {
+         sn_rows[s].swap( columns[first[s]] );
+         offset[s + 1] = offset[s] + sn_rows[s].size() * ncols( s );
+         std::size_t noff = sn_rows[s].size() - ncols( s );
+         max_update = std::max( max_update, noff * noff );
+      }
+
+      L.assign( offset[S], 0 );
+      update.assign( max_update, 0 );
+      relpos.assign( N, 0 );
+      work.assign( N, 0 );
+
+      //position of the entries of the matrix in the storage of the factor
+      position.resize( N );
+
+      for( std::size_t j = 0; j < N; ++j )
+      {
+         position[j].resize( pattern[j].size() );
+
+         for( std::size_t k = 0; k < pattern[j].size(); ++k )
+         {
+            std::size_t a = iperm[pattern[j][k]];
+            std::size_t b = iperm[j];
+            position[j][k] = index( std::max( a, b ), std::min( a, b ) );
+         }
+      }
+   }
+
+   /**
+    * Compute the numeric factorization of the matrix with the given values plus shift times the identity.
+    * The pattern must be the one given to analyze().
+    *
+    * \return  0 if the matrix is positive definite and otherwise the index k + 1 of the
+    *          column in the fill reducing order for which the factorization failed.
+    */
+   int factorize( const std::vector<std::vector<REAL>> &values, REAL shift = 0 )
+   {
+      std::fill( L.begin(), L.end(), REAL( 0 ) );
+
+      for( std::size_t j = 0; j < N; ++j )
+         for( std::size_t k = 0; k < values[j].size(); ++k )
+            L[position[j][k]] += values[j][k];
+
+      for( std::size_t j = 0; j < N; ++j )
+         L[index( j, j )] += shift;
+
+      const std::size_t S = num_supernodes();
+
+      for( std::size_t s = 0; s < S; ++s )
+      {
+         const std::size_t nc = ncols( s );
+         const std::size_t noff = sn_rows[s].size() - nc;
+         REAL *X = &L[offset[s]];
+
+         int pos = cholesky_factor( X, nc, nc );
+
+         if( pos )
+            return first[s] + pos;
+
+         if( noff == 0 )
+            continue;
+
+         REAL *Xoff = X + nc * nc;
+         //L_off = A_off L_diag^-T
+         blas::trsm( CblasRight, CblasTrans, CblasNonUnit, noff, nc, REAL( 1 ), X, nc, Xoff, nc );
+         //lower triangle of L_off L_off^T
+         blas::syrk( CblasNoTrans, noff, nc, REAL( 1 ), Xoff, nc, REAL( 0 ), update.data(), noff );
+
+         //subtract the update from the supernodes of the columns below the supernode
+         const std::size_t *below = sn_rows[s].data() + nc;
+         std::size_t t = internal::no_index();
+
+         for( std::size_t jj = 0; jj < noff; ++jj )
+         {
+            const std::size_t c = below[jj];
+
+            if( col2sn[c] != t )
+            {
+               t = col2sn[c];
+
+               for( std::size_t q = 0; q < sn_rows[t].size(); ++q )
+                  relpos[sn_rows[t][q]] = q;
+            }
+
+            REAL *Y = &L[offset[t]];
+            const std::size_t nct = ncols( t );
+            const std::size_t lc = c - first[t];
+
+            for( std::size_t ii = jj; ii < noff; ++ii )
+               Y[relpos[below[ii]] * nct + lc] -= update[ii * noff + jj];
+         }
+      }
+
+      return 0;
+   }
+
+   /**
+    * Solve Ax = b with the factorization computed by the last call to factorize().
+    * On input x contains b and on output the solution.
+    */
+   void solve( REAL *x )
+   {
+      const std::size_t S = num_supernodes();
+
+      for( std::size_t j = 0; j < N; ++j )
+         work[j] = x[perm[j]];
+
+      //forward substitution
+      for( std::size_t s = 0; s < S; ++s )
+      {
+         const std::size_t nc = ncols( s );
+         const std::size_t noff = sn_rows[s].size() - nc;
+         const REAL *X = &L[offset[s]];
+         REAL *y = &work[first[s]];
+
+         blas::trsv( CblasNoTrans, CblasNonUnit, nc, X, nc, y, 1 );
+
+         if( noff == 0 )
+            continue;
+
+         blas::gemv( CblasNoTrans, noff, nc, REAL( 1 ), X + nc * nc, nc, y, 1, REAL( 0 ), update.data(), 1 );
+
+         for( std::size_t q = 0; q < noff; ++q )
+            work[sn_rows[s][nc + q]] -= update[q];
+      }
+
+      //backward substitution
+      for( std::size_t s = S; s-- > 0; )
+      {
+         const std::size_t nc = ncols( s );
+         const std::size_t noff = sn_rows[s].size() - nc;
+         const REAL *X = &L[offset[s]];
+         REAL *y = &work[first[s]];
+
+         if( noff != 0 )
+         {
+            for( std::size_t q = 0; q < noff; ++q )
+               update[q] = work[sn_rows[s][nc + q]];
+
+            blas::gemv( CblasTrans, noff, nc, REAL( -1 ), X + nc * nc, nc, update.data(), 1, REAL( 1 ), y, 1 );
+         }
+
+         blas::trsv( CblasTrans, CblasNonUnit, nc, X, nc, y, 1 );
+      }
+
+      for( std::size_t j = 0; j < N; ++j )
+         x[perm[j]] = work[j];
+   }
+
+   std::size_t num_supernodes() const
+   {
+      return first.empty() ? 0 : first.size() - 1;
+   }
+
+   /**
+    * Number of nonzeros stored for the factor.
+    */
+   std::size_t factor_size() const
+   {
+      return L.size();
+   }
+
+private:
+   static std::vector<std::size_t> inverse( const std::vector<std::size_t> &p )
+   {
+      std::vector<std::size_t> ip( p.size() );
+
+      for( std::size_t k = 0; k < p.size(); ++k )
+         ip[p[k]] = k;
+
+      return ip;
+   }
+
+   /**
+    * For each row i of the permuted matrix the columns j < i of its lower triangle.
+    */
+   static std::vector<std::vector<std::size_t>> permuted_rows( const std::vector<std::vector<std::size_t>> &pattern, const std::vector<std::size_t> &iperm )
+   {
+      std::vector<std::vector<std::size_t>> rows( pattern.size() );
+
+      for( std::size_t j = 0; j < pattern.size(); ++j )
+      {
+         for( std::size_t i : pattern[j] )
+         {
+            std::size_t a = iperm[i];
+            std::size_t b = iperm[j];
+
+            if( a != b )
+               rows[std::max( a, b )].push_back( std::min( a, b ) );
+         }
+      }
+
+      return rows;
+   }
+
+   /**
+    * Liu's algorithm with path compression.
+    */
+   static std::vector<std::size_t> elimination_tree( const std::vector<std::vector<std::size_t>> &rows )
+   {
+      using internal::no_index;
+      const std::size_t N = rows.size();
+      std::vector<std::size_t> parent( N, no_index() );
+      std::vector<std::size_t> ancestor( N, no_index() );
+
+      for( std::size_t k = 0; k < N; ++k )
+      {
+         for( std::size_t i : rows[k] )
+         {
+            std::size_t r = i;
+
+            while( ancestor[r] != no_index() && ancestor[r] != k )
+            {
+               std::size_t t = ancestor[r];
+               ancestor[r] = k;
+               r = t;
+            }
+
+            if( ancestor[r] == no_index() )
+            {
+               ancestor[r] = k;
+               parent[r] = k;
+            }
+         }
+      }
+
+      return parent;
+   }
+
+   static std::vector<std::size_t> postorder( const std::vector<std::size_t> &parent )
+   {
+      using internal::no_index;
+      const std::size_t N = parent.size();
+      std::vector<std::vector<std::size_t>> child_lists( N );
+      std::vector<std::size_t> roots;
+
+      for( std::size_t j = 0; j < N; ++j )
+      {
+         if( parent[j] == no_index() )
+            roots.push_back( j );
+         else
+            child_lists[parent[j]].push_back( j );
+      }
+
+      std::vector<std::size_t> post;
+      post.reserve( N );
+      std::vector<std::pair<std::size_t, std::size_t>> stack;
+
+      for( std::size_t root : roots )
+      {
+         stack.emplace_back( root, 0 );
+
+         while( !stack.empty() )
+         {
+            std::pair<std::size_t, std::size_t> &top = stack.back();
+
+            if( top.second < child_lists[top.first].size() )
+            {
+               std::size_t c = child_lists[top.first][top.second++];
+               stack.emplace_back( c, 0 );
+            }
+            else
+            {
+               post.push_back( top.first );
+               stack.pop_back();
+            }
+         }
+      }
+
+      return post;
+   }
+
+   std::size_t ncols( std::size_t s ) const
+   {
+      return first[s + 1] - first[s];
+   }
+
+   /**
+    * Index of entry (i, j), i >= j, of the factor in the column order of the factorization.
+    */
+   std::size_t index( std::size_t i, std::size_t j ) const
+   {
+      const std::size_t s = col2sn[j];
+      const std::vector<std::size_t> &r = sn_rows[s];
+      const std::size_t lr = std::lower_bound( r.begin(), r.end(), i ) - r.begin();
+      return offset[s] + lr * ncols( s ) + ( j - first[s] );
+   }
+
+   std::size_t N;
+   /// column perm[k] of the matrix is column k of the factor
+   std::vector<std::size_t> perm;
+   /// first column of each supernode and N
+   std::vector<std::size_t> first;
+   std::vector<std::size_t> col2sn;
+   /// row indices of each supernode, starting with its own columns
+   std::vector<std::vector<std::size_t>> sn_rows;
+   /// start of the dense row major block of each supernode in L
+   std::vector<std::size_t> offset;
+   std::vector<std::vector<std::size_t>> position;
+   std::vector<REAL> L;
+   std::vector<REAL> update;
+   std::vector<std::size_t> relpos;
+   std::vector<REAL> work;
+};
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,453 @@
+#ifndef _CPPLSQ_SPARSITY_HPP_
+#define _CPPLSQ_SPARSITY_HPP_
+
+#include <vector>
+#include <cmath>
+#include <ostream>
+#include <iterator>
+#include <algorithm>
+#include "AutoDiff.hpp"
+
+namespace cpplsq
+{
+
+/**
+ * Type for detecting on which independent variables a computation depends. Instead of the
+ * derivatives it propagates the sorted set of the indices of the independent variables that
+ * the value depends on, so evaluating a residual with it gives the structure of its gradient.
+ * The values are computed as well, so that residuals can use them in their control flow. The
+ * detected structure is only valid if it does not depend on these values.
+ */
+template<typename REAL>
+class SparsityDiff
+{
+public:
+   SparsityDiff() : val( 0 ) {}
+
+   SparsityDiff( REAL val ) : val( val ) {}
+
+   /**
+    * Set the value and make this the i-th independent variable.
+    */
+   void setIndependent( REAL x, std::size_t i )
+   {
+      val = x;
+      deps.assign( 1, i );
+   }
+
+   REAL getValue() const
+   {
+      return val;
+   }
+
+   /**
+    * Sorted indices of the independent variables this value depends on.
+    */
+   const std::vector<std::size_t> &getDependencies() const
+   {
+      return deps;
+   }
+
+   SparsityDiff<REAL> &operator=( REAL x )
+   {
+      val = x;
+      deps.clear();
+      return *this;
+   }
+
+   SparsityDiff<REAL> &operator +=( const SparsityDiff<REAL> &x )
+   {
+      val += x.val;
+      merge( x );
+      return *this;
+   }
+
+   SparsityDiff<REAL> &operator -=( const SparsityDiff<REAL> &x )
+   {
+      val -= x.val;
+      merge( x );
+      return *this;
+   }
+
+   SparsityDiff<REAL> &operator *=( const SparsityDiff<REAL> &x )
+   {
+      val *= x.val;
+      merge( x );
+      return *this;
+   }
+
+   SparsityDiff<REAL> &operator /=( const SparsityDiff<REAL> &x )
+   {
+      val /= x.val;
+      merge( x );
+      return *this;
+   }
+
+   SparsityDiff<REAL> &operator +=( REAL x )
+   {
+      val += x;
+      return *this;
+   }
+
+   SparsityDiff<REAL> &operator -=( REAL x )
+   {
+      val -= x;
+      return *this;
+   }
+
+   SparsityDiff<REAL> &operator *=( REAL x )
+   {
+      val *= x;
+      return *this;
+   }
+
+   SparsityDiff<REAL> &operator /=( REAL x )
+   {
+      val /= x;
+      return *this;
+   }
+
+   /**
+    * Returns exp( this ).
+    */
+   SparsityDiff<REAL> exp() const
+   {
+      SparsityDiff<REAL> result( *this );
+      result.val = std::exp( val );
+      return result;
+   }
+
+   /**
+    * Returns -this.
+    */
+   SparsityDiff<REAL> neg() const
+   {
+      SparsityDiff<REAL> result( *this );
+      result.val = -val;
+      return result;
+   }
+
+   /**
+    * Returns x / this.
+    */
+   SparsityDiff<REAL> rdiv( REAL x ) const
+   {
+      SparsityDiff<REAL> result( *this );
+      result.val = x / val;
+      return result;
+   }
+
+private:
+   void merge( const SparsityDiff<REAL> &x )
+   {
+      if( x.deps.empty() || x.deps == deps )
+         return;
+
+      std::vector<std::size_t> merged;
+      merged.reserve( deps.size() + x.deps.size() );
+      std::set_union( deps.begin(), deps.end(), x.deps.begin(), x.deps.end(), std::back_inserter( merged ) );
+      deps.swap( merged );
+   }
+
+   REAL val;
+   std::vector<std::size_t> deps;
+};
+
+template<typename REAL>
+struct NumTypeTraits<SparsityDiff<REAL>>
+{
+   using type = REAL;
+};
+
+//Outstream "<<" operator
+template<typename REAL>
+std::ostream &operator<<( std::ostream &os, const SparsityDiff<REAL> &x )
+{
+   os << x.getValue();
+   return os;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> exp( const SparsityDiff<REAL> &x )
+{
+   return x.exp();
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator-( const SparsityDiff<REAL> &x )
+{
+   return x.neg();
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator+( SparsityDiff<REAL> a, const SparsityDiff<REAL> &b )
+{
+   return a += b;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator-( SparsityDiff<REAL> a, const SparsityDiff<REAL> &b )
+{
+   return a -= b;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator*( SparsityDiff<REAL> a, const SparsityDiff<REAL> &b )
+{
+   return a *= b;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator/( SparsityDiff<REAL> a, const SparsityDiff<REAL> &b )
+{
+   return a /= b;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator+( SparsityDiff<REAL> a, NumType<SparsityDiff<REAL>> b )
+{
+   return a += b;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator-( SparsityDiff<REAL> a, NumType<SparsityDiff<REAL>> b )
+{
+   return a -= b;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator*( SparsityDiff<REAL> a, NumType<SparsityDiff<REAL>> b )
+{
+   return a *= b;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator/( SparsityDiff<REAL> a, NumType<SparsityDiff<REAL>> b )
+{
+   return a /= b;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator+( NumType<SparsityDiff<REAL>> a, SparsityDiff<REAL> b )
+{
+   return b += a;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator-( NumType<SparsityDiff<REAL>> a, const SparsityDiff<REAL> &b )
+{
+   return b.neg() += a;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator*( NumType<SparsityDiff<REAL>> a, SparsityDiff<REAL> b )
+{
+   return b *= a;
+}
+
+template<typename REAL>
+SparsityDiff<REAL> operator/( NumType<SparsityDiff<REAL>> a, const SparsityDiff<REAL> &b )
+{
+   return b.rdiv( a );
+}
+
+//RELATIONAL =======================================================
+
+template<typename REAL>
+bool operator<( const SparsityDiff<REAL> &a, const SparsityDiff<REAL> &b )
+{
+   return a.getValue() < b.getValue();
+}
+
+template<typename REAL>
+bool operator>( const SparsityDiff<REAL> &a, const SparsityDiff<REAL> &b )
+{
+   return a.getValue() > b.getValue();
+}
+
+template<typename REAL>
+bool operator<=( const SparsityDiff<REAL> &a, const SparsityDiff<REAL> &b )
+{
+   return a.getValue() <= b.getValue();
+}
+
+template<typename REAL>
+bool operator>=( const SparsityDiff<REAL> &a, const SparsityDiff<REAL> &b )
+{
+   return a.getValue() >= b.getValue();
+}
+
+template<typename REAL>
+bool operator==( const SparsityDiff<REAL> &a, const SparsityDiff<REAL> &b )
+{
+   return a.getValue() == b.getValue();
+}
+
+template<typename REAL>
+bool operator!=( const SparsityDiff<REAL> &a, const SparsityDiff<REAL> &b )
+{
+   return a.getValue() != b.getValue();
+}
+
+template<typename REAL>
+bool operator<( const SparsityDiff<REAL> &a, NumType<SparsityDiff<REAL>> b )
+{
+   return a.getValue() < b;
+}
+
+template<typename REAL>
+bool operator>( const SparsityDiff<REAL> &a, NumType<SparsityDiff<REAL>> b )
+{
+   return a.getValue() > b;
+}
+
+template<typename REAL>
+bool operator<=( const SparsityDiff<REAL> &a, NumType<SparsityDiff<REAL>> b )
+{
+   return a.getValue() <= b;
+}
+
+template<typename REAL>
+bool operator>=( const SparsityDiff<REAL> &a, NumType<SparsityDiff<REAL>> b )
+{
+   return a.getValue() >= b;
+}
+
+template<typename REAL>
+bool operator==( const SparsityDiff<REAL> &a, NumType<SparsityDiff<REAL>> b )
+{
+   return a.getValue() == b;
+}
+
+template<typename REAL>
+bool operator!=( const SparsityDiff<REAL> &a, NumType<SparsityDiff<REAL>> b )
+{
+   return a.getValue() != b;
+}
+
+template<typename REAL>
+bool operator<( NumType<SparsityDiff<REAL>> a, const SparsityDiff<REAL> &b )
+{
+   return a < b.getValue();
+}
+
+template<typename REAL>
+bool operator>( NumType<SparsityDiff<REAL>> a, const SparsityDiff<REAL> &b )
+{
+   return a > b.getValue();
+}
+
+template<typename REAL>
+bool operator<=( NumType<SparsityDiff<REAL>> a, const SparsityDiff<REAL> &b )
+{
+   return a <= b.getValue();
+}
+
+template<typename REAL>
+bool operator>=( NumType<SparsityDiff<REAL>> a, const SparsityDiff<REAL> &b )
+{
+   return a >= b.getValue();
+}
+
+template<typename REAL>
+bool operator==( NumType<SparsityDiff<REAL>> a, const SparsityDiff<REAL> &b )
+{
+   return a == b.getValue();
+}
+
+template<typename REAL>
+bool operator!=( NumType<SparsityDiff<REAL>> a, const SparsityDiff<REAL> &b )
+{
+   return a != b.getValue();
+}
+
+namespace internal
+{
+
+/**
+ * Evaluate the residuals once with SparsityDiff and return for each residual the sorted
+ * indices of the parameters it depends on, i.e. the pattern of the rows of the Jacobian.
+ */
+template<typename REAL, typename Residuals, typename ParameterTransform>
+std::vector<std::vector<std::size_t>> jacobian_pattern( const REAL *params, std::size_t N, Residuals &residuals, ParameterTransform &pt )
+{
+   std::vector<SparsityDiff<REAL>> sd_params( N );
+
+   for( std::size_t j = 0; j < N; ++j )
+      sd_params[j].setIndependent( params[j], j );
+
+   auto tp = pt( sd_params.data() );
+   std::vector<std::vector<std::size_t>> rows( residuals.size() );
+
+   for( std::size_t i = 0; i < rows.size(); ++i )
+   {
+      SparsityDiff<REAL> residual = residuals[i]( tp );
+      rows[i] = residual.getDependencies();
+   }
+
+   return rows;
+}
+
+/**
+ * Color the N columns of a Jacobian with the given row patterns such that columns which
+ * have a nonzero in the same row get different colors. Columns of the same color are
+ * structurally orthogonal and can share one direction of the forward differentiation,
+ * since every row only depends on one of them. The columns are colored greedily in their
+ * natural order, which gives the bandwidth as the number of colors for banded Jacobians.
+ *
+ * \param rows       Sorted column indices of the nonzeros of each row.
+ * \param N          Number of columns.
+ * \param ncolors    On output the number of colors.
+ *
+ * \return           The color of each column.
+ */
+inline std::vector<std::size_t> color_columns( const std::vector<std::vector<std::size_t>> &rows, std::size_t N, std::size_t &ncolors )
+{
+   using std::size_t;
+   const size_t none = size_t( -1 );
+   std::vector<std::vector<size_t>> cols( N );
+
+   for( size_t i = 0; i < rows.size(); ++i )
+   {
+      for( size_t j : rows[i] )
+         cols[j].push_back( i );
+   }
+
+   std::vector<size_t> color( N, none );
+   //column for which the color was last marked as used
+   std::vector<size_t> used;
+   ncolors = 0;
+
+   for( size_t j = 0; j < N; ++j )
+   {
+      for( size_t i : cols[j] )
+      {
+         for( size_t k : rows[i] )
+         {
+            if( color[k] != none )
+               used[color[k]] = j;
+         }
+      }
+
+      size_t c = 0;
+
+      while( c < ncolors && used[c] == j )
+         ++c;
+
+      if( c == ncolors )
+      {
+         used.push_back( none );
+         ++ncolors;
+      }
+
+      color[j] = c;
+   }
+
+   return color;
+}
+
+} //internal
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,325 @@
+#ifndef _CPPLSQ_THREAD_POOL_HPP_
+#define _CPPLSQ_THREAD_POOL_HPP_
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Set of tasks with dependencies between them that is executed by ThreadPool::run().
+ * The dependencies must not contain cycles.
+ */
+class TaskGraph
+{
+public:
+   /**
+    * Add a task and return its index.
+    */
+   std::size_t add( std::function<void()> f )
+   {
+      tasks.push_back( Task { std::move( f ), std::vector<std::size_t>(), 0 } );
+      return tasks.size() - 1;
+   }
+
+   /**
+    * Make task after wait until task before has finished.
+    */
+   void add_dependency( std::size_t before, std::size_t after )
+   {
+      tasks[before].successors.push_back( after );
+      ++tasks[after].num_dependencies;
+   }
+
+   std::size_t size() const
+   {
+      return tasks.size();
+   }
+
+private:
+   friend class ThreadPool;
+
+   struct Task
+   {
+      std::function<void()> run;
+      std::vector<std::size_t> successors;
+      std::size_t num_dependencies;
+   };
+
+   std::vector<Task> tasks;
+};
+
+/**
+ * Fixed set of worker threads that execute the iterations of parallel loops and task graphs. The thread
+ * calling parallel_for or run also executes iterations and returns when all of them are done.
+ * The iterations must not use MultiDiff objects unless the library is compiled with PARALLEL.
+ */
+class ThreadPool
+{
+public:
+   /**
+    * Create a pool that runs loops on num_threads threads including the calling thread.
+    * If num_threads is zero the number of hardware threads is used.
+    */
+   explicit ThreadPool( std::size_t num_threads = 0 ) : job( nullptr ), count( 0 ), next( 0 ), generation( 0 ), busy( 0 ), stop( false )
+   {
+      if( num_threads == 0 )
+         num_threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+      for( std::size_t t = 1; t < num_threads; ++t )
+         workers.emplace_back( [this]()
+      {
+         work();
+      } );
+   }
+
+   ThreadPool( const ThreadPool & ) = delete;
+   ThreadPool &operator=( const ThreadPool & ) = delete;
+
+   ~ThreadPool()
+   {
+      {
+         std::lock_guard<std::mutex> lock( mutex );
+         stop = true;
+      }
+
+      start.notify_all();
+
+      for( std::thread &t : workers )
+         t.join();
+   }
+
+   /**
+    * Number of threads that execute a loop.
+    */
+   std::size_t size() const
+   {
+      return workers.size() + 1;
+   }
+
+   /**
+    * Call f( i ) for i = 0,...,n-1 in parallel and wait until all calls returned.
+    */
+   void parallel_for( std::size_t n, const std::function<void( std::size_t )> &f )
+   {
+      if( workers.empty() || n < 2 )
+      {
+         for( std::size_t i = 0; i < n; ++i )
+            f( i );
+
+         return;
+      }
+
+      {
+         std::lock_guard<std::mutex> lock( mutex );
+         job = &f;
+         count = n;
+         next = 0;
+         busy = workers.size();
+         ++generation;
+      }
+
+      start.notify_all();
+      run();
+
+      std::unique_lock<std::mutex> lock( mutex );
+      finished.wait( lock, [this]()
+      {
+         return busy == 0;
+      } );
+      job = nullptr;
+   }
+
+   /**
+    * Execute the tasks of the graph in parallel and wait until all of them are done. Every thread
+    * has a queue of tasks that are ready. A thread takes the task that became ready last from its
+    * own queue, so that the tiles written by a task are reused while they are in its cache, and
+    * steals the oldest task from the queue of another thread when its own queue is empty. Tasks
+    * become ready in the queue of the thread that finished their last dependency. A thread that finds
+    * no task blocks until another thread makes a task ready, so waiting threads do not occupy a core.
+    */
+   void run( TaskGraph &graph )
+   {
+      const std::size_t T = size();
+      const std::size_t n = graph.tasks.size();
+      std::unique_ptr<std::atomic<std::size_t>[]> pending( new std::atomic<std::size_t>[n] );
+      std::vector<TaskQueue> queues( T );
+      std::atomic<std::size_t> done( 0 );
+      //number of tasks in the queues
+      std::atomic<std::size_t> ready( 0 );
+      std::mutex idle_mutex;
+      std::condition_variable idle;
+      std::size_t q = 0;
+
+      for( std::size_t i = 0; i < n; ++i )
+      {
+         pending[i] = graph.tasks[i].num_dependencies;
+
+         if( pending[i] == 0 )
+         {
+            queues[q++ % T].tasks.push_back( i );
+            ++ready;
+         }
+      }
+
+      //the counters are changed before taking the lock, so a thread that is about to wait sees the change
+      auto wake = [&]( bool all )
+      {
+         {
+            std::lock_guard<std::mutex> lock( idle_mutex );
+         }
+
+         if( all )
+            idle.notify_all();
+         else
+            idle.notify_one();
+      };
+
+      parallel_for( T, [&]( std::size_t t )
+      {
+         std::size_t i;
+
+         while( done < n )
+         {
+            if( !queues[t].pop( i ) )
+            {
+               bool stolen = false;
+
+               for( std::size_t k = 1; !stolen && k < T; ++k )
+                  stolen = queues[( t + k ) % T].steal( i );
+
+               if( !stolen )
+               {
+                  std::unique_lock<std::mutex> lock( idle_mutex );
+                  idle.wait( lock, [&]()
+                  {
+                     return ready > 0 || done == n;
+                  } );
+                  continue;
+               }
+            }
+
+            --ready;
+            graph.tasks[i].run();
+            std::size_t pushed = 0;
+
+            for( std::size_t j : graph.tasks[i].successors )
+            {
+               if( --pending[j] == 0 )
+               {
+                  queues[t].push( j );
+                  ++ready;
+
+                  //this thread takes the first one itself
+                  if( pushed++ > 0 )
+                     wake( false );
+               }
+            }
+
+            if( ++done == n )
+               wake( true );
+         }
+      } );
+   }
+
+private:
+   struct TaskQueue
+   {
+      std::mutex mutex;
+      std::deque<std::size_t> tasks;
+
+      void push( std::size_t i )
+      {
+         std::lock_guard<std::mutex> lock( mutex );
+         tasks.push_back( i );
+      }
+
+      bool pop( std::size_t &i )
+      {
+         std::lock_guard<std::mutex> lock( mutex );
+
+         if( tasks.empty() )
+            return false;
+
+         i = tasks.back();
+         tasks.pop_back();
+         return true;
+      }
+
+      bool steal( std::size_t &i )
+      {
+         std::lock_guard<std::mutex> lock( mutex );
+
+         if( tasks.empty() )
+            return false;
+
+         i = tasks.front();
+         tasks.pop_front();
+         return true;
+      }
+   };
+
+   void run()
+   {
+      std::size_t i;
+
+      while( ( i = next++ ) < count )
+         ( *job )( i );
+   }
+
+   void work()
+   {
+      std::size_t seen = 0;
+
+      while( true )
+      {
+         {
+            std::unique_lock<std::mutex> lock( mutex );
+            start.wait( lock, [this, &seen]()
+            {
+               return stop || generation != seen;
+            } );
+
+            if( stop )
+               return;
+
+            seen = generation;
+         }
+
+         run();
+
+         std::lock_guard<std::mutex> lock( mutex );
+
+         if( --busy == 0 )
+            finished.notify_one();
+      }
+   }
+
+   std::vector<std::thread> workers;
+   std::mutex mutex;
+   std::condition_variable start;
+   std::condition_variable finished;
+   const std::function<void( std::size_t )> *job;
+   std::size_t count;
+   std::atomic<std::size_t> next;
+   std::size_t generation;
+   std::size_t busy;
+   bool stop;
+};
+
+} //internal
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef _CPPLSQ_TILED_CHOLESKY_HPP_
+#define _CPPLSQ_TILED_CHOLESKY_HPP_
+
+#include <atomic>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include "Blas.hpp"
+#include "cholesky_solve.hpp"
+#include "packed_cholesky.hpp"
+#include "thread_pool.hpp"
+
+namespace cpplsq
+{
+
+/**
+ * \brief Compute the cholesky decomposition A = LL^T of a symmetric positive definite matrix A with tasks
+ *        on the threads of a ThreadPool.
+ *
+ * The lower triangle of A is split into square tiles of size NB. For each tile column k the diagonal tile is
+ * factorized (potrf), the tiles below it are solved with the factor (trsm) and the trailing tiles are updated
+ * (syrk for the diagonal and gemm for the other tiles). Every operation on a tile is a task that only waits for
+ * the tasks that write the tiles it uses, so that updates of later columns overlap with the factorization of the
+ * current one. The tasks call the blas routines on single tiles and use the threads of the given pool, so the blas
+ * library should not be threaded itself.
+ *
+ * \param pool       Pool whose threads execute the tasks.
+ * \param A_         On input the lower triangle of a symmetric positive definite matrix and on output L.
+ * \param LDA        leading dimension of A_ must be greater or equal to N.
+ * \param N          Size of A, i.e. A is a NxN matrix.
+ * \param NB         Size of the tiles.
+ *
+ * \return           Same as for cholesky_factor(). If the decomposition fails the content of A is unspecified.
+ */
+template<typename REAL>
+int tiled_cholesky_factor( internal::ThreadPool &pool, REAL *A_, std::size_t LDA, std::size_t N, std::size_t NB = 128 )
+{
+   using std::size_t;
+   const size_t T = ( N + NB - 1 ) / NB;
+
+   if( T <= 1 )
+      return cholesky_factor( A_, LDA, N );
+
+   auto tile = [A_, LDA, NB]( size_t i, size_t j )
+   {
+      return A_ + i * NB * LDA + j * NB;
+   };
+
+   auto rows = [N, NB]( size_t i )
+   {
+      return std::min( NB, N - i * NB );
+   };
+
+   const size_t none = std::numeric_limits<size_t>::max();
+   //the task that writes tile (i, j) last
+   std::vector<size_t> last( T * T, none );
+   internal::TaskGraph graph;
+   std::atomic<int> failed( 0 );
+
+   auto reads = [&graph, &last, T]( size_t task, size_t i, size_t j )
+   {
+      graph.add_dependency( last[i * T + j], task );
+   };
+
+   auto writes = [&graph, &last, T, none]( size_t task, size_t i, size_t j )
+   {
+      if( last[i * T + j] != none )
+         graph.add_dependency( last[i * T + j], task );
+
+      last[i * T + j] = task;
+   };
+
+   for( size_t k = 0; k < T; ++k )
+   {
+      size_t potrf = graph.add( [tile, rows, k, NB, LDA, &failed]()
+      {
+         if( failed )
+            return;
+
+         int pos = cholesky_factor( tile( k, k ), LDA, rows( k ) );
+
+         if( pos )
+            failed = k * NB + pos;
+      } );
+      writes( potrf, k, k );
+
+      for( size_t i = k + 1; i < T; ++i )
+      {
+         size_t trsm = graph.add( [tile, rows, i, k, NB, LDA, &failed]()
+         {
+            if( failed )
+               return;
+
+            blas::trsm( CblasRight, CblasTrans, CblasNonUnit, rows( i ), NB, REAL( 1 ), tile( k, k ), LDA, tile( i, k ), LDA );
+         } );
+         reads( trsm, k, k );
+         writes( trsm, i, k );
+      }
+
+      for( size_t i = k + 1; i < T; ++i )
+      {
+         size_t syrk = graph.add( [tile, rows, i, k, NB, LDA, &failed]()
+         {
+            if( failed )
+               return;
+
+            blas::syrk( CblasNoTrans, rows( i ), NB, REAL( -1 ), tile( i, k ), LDA, REAL( 1 ), tile( i, i ), LDA );
+         } );
+         reads( syrk, i, k );
+         writes( syrk, i, i );
+
+         for( size_t j = k + 1; j < i; ++j )
+         {
+            size_t gemm = graph.add( [tile, rows, i, j, k, NB, LDA, &failed]()
+            {
+               if( failed )
+                  return;
+
+               blas::gemm( CblasNoTrans, CblasTrans, rows( i ), NB, NB, REAL( -1 ), tile( i, k ), LDA, tile( j, k ), LDA, REAL( 1 ), tile( i, j ), LDA );
+            } );
+            reads( gemm, i, k );
+            reads( gemm, j, k );
+            writes( gemm, i, j );
+         }
+      }
+   }
+
+   pool.run( graph );
+   return failed;
+}
+
+/**
+ * \brief Solve Ax = b for symmetric positive definite matrix A using the tiled cholesky decomposition.
+ *
+ * \param pool       Pool whose threads execute the decomposition.
+ * \param A_         On input a symmetric positive definite matrix and on output L.
+ * \param LDA        leading dimension of A_ must be greater or equal to N.
+ * \param b          On input the right hand side of linear system on output the solution.
+ * \param N          Size of A and b, i.e. A is a NxN matrix and b is a vector of size N.
+ * \param NB         Size of the tiles.
+ *
+ * \return           Same as for cholesky_solve().
+ */
+template<typename REAL>
+int tiled_cholesky_solve( internal::ThreadPool &pool, REAL *A_, std::size_t LDA, REAL *b, std::size_t N, std::size_t NB = 128 )
+{
+   int pos = tiled_cholesky_factor( pool, A_, LDA, N, NB );
+
+   if( pos )
+      return pos;
+
+   blas::trsv( CblasNoTrans, CblasNonUnit, N, A_, LDA, b, 1 );
+   blas::trsv( CblasTrans, CblasNonUnit, N, A_, LDA, b, 1 );
+   return 0;
+}
+
+/**
+ * Size from which the dense Gauß-Newton models factorize their packed matrix with the tiled cholesky
+ * decomposition. Below it the tiles are too few to keep several threads busy.
+ */
+constexpr std::size_t tiled_cholesky_min_size()
+{
+   return 1024;
+}
+
+/**
+ * \brief Solve Ax = b for symmetric positive definite matrix A in packed storage using the tiled cholesky decomposition.
+ *
+ * The tiles need the full storage, so the packed lower triangle is copied into the given workspace and the
+ * decomposition is computed there.
+ *
+ * \param pool       Pool whose threads execute the decomposition.
+ * \param AP         The packed lower triangle of a symmetric positive definite matrix. Is not modified.
+ * \param b          On input the right hand side of linear system on output the solution. Is only
+ *                   modified if 0 is returned.
+ * \param N          Size of A and b, i.e. A is a NxN matrix and b is a vector of size N.
+ * \param work       Workspace that is resized to N * N.
+ * \param NB         Size of the tiles.
+ *
+ * \return           Same as for cholesky_solve().
+ */
+template<typename REAL>
+int packed_tiled_cholesky_solve( internal::ThreadPool &pool, const REAL *AP, REAL *b, std::size_t N, std::vector<REAL> &work, std::size_t NB = 128 )
+{
+   work.resize( N * N );
+
+   for( std::size_t i = 0; i < N; ++i )
+      std::copy( AP + packed_index( i, 0 ), AP + packed_index( i, 0 ) + i + 1, work.data() + i * N );
+
+   return tiled_cholesky_solve( pool, work.data(), N, b, N, NB );
+}
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef _CPPLSQ_TSQR_HPP_
+#define _CPPLSQ_TSQR_HPP_
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "Blas.hpp"
+#include "thread_pool.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+/**
+ * Compute the R factor of the QR decomposition of the m x n matrix A stored row major with
+ * Householder reflections. On output the upper triangle of the first min(m, n) rows of A
+ * contains R and all other entries are zero; Q is not stored.
+ */
+template<typename REAL>
+void householder_qr( REAL *A, std::size_t lda, std::size_t m, std::size_t n )
+{
+   std::vector<REAL> w( n );
+   const std::size_t K = std::min( m, n );
+
+   for( std::size_t k = 0; k < K; ++k )
+   {
+      REAL *akk = A + k * lda + k;
+      const REAL alpha = *akk;
+      const REAL norm = blas::nrm2( m - k, akk, lda );
+
+      if( norm == 0 )
+         continue;
+
+      const REAL beta = alpha >= 0 ? -norm : norm;
+      const REAL tau = ( beta - alpha ) / beta;
+
+      //v = ( 1, a(k+1:m,k) / ( alpha - beta ) ) is stored in column k
+      for( std::size_t i = k + 1; i < m; ++i )
+         A[i * lda + k] /= alpha - beta;
+
+      *akk = 1;
+
+      if( k + 1 < n )
+      {
+         //w = A(k:m,k+1:n)^T v and A(k:m,k+1:n) -= tau v w^T
+         blas::gemv( CblasTrans, m - k, n - k - 1, REAL( 1 ), akk + 1, lda, akk, lda, REAL( 0 ), w.data(), 1 );
+
+         for( std::size_t i = k; i < m; ++i )
+            blas::axpy( n - k - 1, -tau * A[i * lda + k], w.data(), 1, A + i * lda + k + 1, 1 );
+      }
+
+      *akk = beta;
+
+      for( std::size_t i = k + 1; i < m; ++i )
+         A[i * lda + k] = 0;
+   }
+
+   for( std::size_t i = K; i < m; ++i )
+      std::fill( A + i * lda, A + i * lda + n, REAL( 0 ) );
+}
+
+/**
+ * \brief Communication avoiding QR decomposition of tall and skinny matrices.
+ *
+ * The rows of the matrix are split into panels that are factorized independently on the threads of a
+ * ThreadPool. The R factors of the panels are then merged pairwise in a binary reduction tree, where
+ * each merge is the QR decomposition of two stacked R factors, until only the R factor of the whole
+ * matrix remains. Since J^T J = R^T R the factor can be used in place of the cholesky decomposition
+ * of the Gram matrix without squaring the condition number.
+ */
+template<typename REAL>
+class Tsqr
+{
+public:
+   explicit Tsqr( ThreadPool &pool ) : pool( pool ), num_panels( 1 ) {}
+
+   /**
+    * Compute the n x n upper triangular factor R of the m x n matrix A stored row major with
+    * leading dimension lda and store it row major in R with leading dimension ldr. A is overwritten.
+    */
+   void factor( REAL *A, std::size_t lda, std::size_t m, std::size_t n, REAL *R, std::size_t ldr )
+   {
+      //panels have at least 2n rows so that the panel factorization dominates the merges
+      num_panels = std::max<std::size_t>( 1, std::min( pool.size(), m / ( 2 * std::max<std::size_t>( n, 1 ) ) ) );
+      const std::size_t P = num_panels;
+
+      //slot p holds the R factor of panel p in its first n rows and receives the one to merge with in the other n
+      work.resize( P * 2 * n * n );
+
+      pool.parallel_for( P, [&]( std::size_t p )
+      {
+         const std::size_t begin = p * m / P;
+         const std::size_t end = ( p + 1 ) * m / P;
+         REAL *panel = A + begin * lda;
+         householder_qr( panel, lda, end - begin, n );
+
+         REAL *Rp = slot( p, n );
+         std::fill( Rp, Rp + n * n, REAL( 0 ) );
+
+         for( std::size_t i = 0; i < std::min( end - begin, n ); ++i )
+            std::copy( panel + i * lda, panel + i * lda + n, Rp + i * n );
+      } );
+
+      for( std::size_t step = 1; step < P; step *= 2 )
+      {
+         const std::size_t pairs = ( P + 2 * step - 1 ) / ( 2 * step );
+
+         pool.parallel_for( pairs, [&]( std::size_t k )
+         {
+            const std::size_t a = 2 * step * k;
+            const std::size_t b = a + step;
+
+            if( b >= P )
+               return;
+
+            REAL *Ra = slot( a, n );
+            const REAL *Rb = slot( b, n );
+            std::copy( Rb, Rb + n * n, Ra + n * n );
+            householder_qr( Ra, n, 2 * n, n );
+         } );
+      }
+
+      const REAL *R0 = slot( 0, n );
+
+      for( std::size_t i = 0; i < n; ++i )
+         std::copy( R0 + i * n, R0 + i * n + n, R + i * ldr );
+   }
+
+   /**
+    * Number of panels used in the last factorization.
+    */
+   std::size_t panels() const
+   {
+      return num_panels;
+   }
+
+private:
+   REAL *slot( std::size_t p, std::size_t n )
+   {
+      return work.data() + p * 2 * n * n;
+   }
+
+   ThreadPool &pool;
+   std::vector<REAL> work;
+   std::size_t num_panels;
+};
+
+} //internal
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef _CPPLSQ_VARPRO_MIN_HPP_
+#define _CPPLSQ_VARPRO_MIN_HPP_
+
+#include <vector>
+#include <limits>
+#include <type_traits>
+#include "gn_sbfgs_min.hpp"
+#include "compact_secant.hpp"
+
+namespace cpplsq
+{
+
+namespace internal
+{
+
+template<typename T>
+typename std::enable_if<is_diff_type<T>(), NumType<T>>::type value_of( const T &x )
+{
+   return x.getValue();
+}
+
+template<typename T>
+typename std::enable_if < !is_diff_type<T>(), T >::type value_of( const T &x )
+{
+   return x;
+}
+
+/**
+ * Transformed parameters of the variable projection: the nonlinear parameters, the values
+ * of the basis functions of all residuals and the optimal linear coefficients for them.
+ */
+template<typename T>
+struct VarProParams
+{
+   const T *nonlinear;
+   /// L basis functions of each residual, residual by residual
+   std::vector<T> basis;
+   std::vector<T> linear;
+};
+
+/**
+ * Parameter transform that eliminates the linear coefficients of separable residuals
+ * r_i = y_i - sum_k c_k phi_ik(b). For the given nonlinear parameters b it evaluates the
+ * basis functions of all residuals and solves the LxL normal equations for the coefficients c.
+ * The derivatives of the coefficients are those of Kaufman's approximation
+ *
+ *    dc = (Phi^T Phi)^-1 Phi^T J_c,
+ *
+ * where J_c is the Jacobian of the residuals for fixed coefficients, so that the derivatives
+ * of the residuals are the rows of the projected Jacobian (I - Phi Phi^+) J_c. Because Phi^T r = 0
+ * for the optimal coefficients the gradient of the sum of squares is exact.
+ */
+template<typename REAL, typename Residuals>
+class VarProTransform
+{
+public:
+   VarProTransform( Residuals &residuals, std::size_t L ) : residuals( &residuals ), L( L ) {}
+
+   void num_parameters( std::size_t ) {}
+
+   template<typename T>
+   VarProParams<T> operator()( const T *params ) const
+   {
+      const std::size_t M = residuals->size();
+      VarProParams<T> p;
+      p.nonlinear = params;
+      p.basis.resize( M * L );
+      p.linear.resize( L );
+
+      std::vector<REAL> G( L * L, 0 );
+      std::vector<REAL> Ginv( L * L );
+      std::vector<REAL> h( L, 0 );
+      std::vector<REAL> c( L, 0 );
+      //P_lk = sum_i phi_il phi_ik with derivatives only in the second factor
+      std::vector<T> P( L * L );
+
+      for( T &x : P )
+         x = 0;
+
+      for( std::size_t i = 0; i < M; ++i )
+      {
+         T *phi = &p.basis[i * L];
+         ( *residuals ) [i]( params, phi );
+         const REAL y = ( *residuals ) [i].observation();
+
+         for( std::size_t l = 0; l < L; ++l )
+         {
+            const REAL v = value_of( phi[l] );
+            h[l] += v * y;
+
+            for( std::size_t k = 0; k < L; ++k )
+            {
+               G[l * L + k] += v * value_of( phi[k] );
+               P[l * L + k] += v * phi[k];
+            }
+         }
+      }
+
+      if( !invert_small( G.data(), Ginv.data(), L ) )
+      {
+         //basis functions are linearly dependent at these parameters
+         for( T &x : p.linear )
+            x = std::numeric_limits<REAL>::quiet_NaN();
+
+         return p;
+      }
+
+      for( std::size_t l = 0; l < L; ++l )
+         for( std::size_t m = 0; m < L; ++m )
+            c[l] += Ginv[l * L + m] * h[m];
+
+      //w_m = (Phi^T J_c)_m up to the sign, without its value which equals h_m
+      std::vector<T> w( L );
+
+      for( std::size_t m = 0; m < L; ++m )
+      {
+         T wm;
+         wm = 0;
+
+         for( std::size_t k = 0; k < L; ++k )
+            wm += c[k] * P[m * L + k];
+
+         w[m] = wm - value_of( wm );
+      }
+
+      for( std::size_t l = 0; l < L; ++l )
+      {
+         T cl;
+         cl = c[l];
+
+         for( std::size_t m = 0; m < L; ++m )
+            cl -= Ginv[l * L + m] * w[m];
+
+         p.linear[l] = cl;
+      }
+
+      return p;
+   }
+
+private:
+   Residuals *residuals;
+   std::size_t L;
+};
+
+/**
+ * Residual functor y_i - sum_k c_k phi_ik(b) on the parameters of a VarProTransform.
+ */
+template<typename Residual>
+class ProjectedResidual
+{
+public:
+   ProjectedResidual( Residual &residual, std::size_t i, std::size_t L ) : residual( &residual ), i( i ), L( L ) {}
+
+   template<typename T>
+   T operator()( const VarProParams<T> &p ) const
+   {
+      T r;
+      r = residual->observation();
+
+      for( std::size_t k = 0; k < L; ++k )
+         r -= p.linear[k] * p.basis[i * L + k];
+
+      return r;
+   }
+
+private:
+   Residual *residual;
+   std::size_t i;
+   std::size_t L;
+};
+
+template<typename Residuals>
+class ProjectedResiduals
+{
+public:
+   using Residual = typename std::decay<decltype( std::declval<Residuals &>()[0] )>::type;
+
+   ProjectedResiduals( Residuals &residuals, std::size_t L ) : residuals( &residuals ), L( L ) {}
+
+   std::size_t size() const
+   {
+      return residuals->size();
+   }
+
+   ProjectedResidual<Residual> operator[]( std::size_t i ) const
+   {
+      return ProjectedResidual<Residual>( ( *residuals ) [i], i, L );
+   }
+
+private:
+   Residuals *residuals;
+   std::size_t L;
+};
+
+} //internal
+
+/**
+ * \brief Compute parameters such that the sum of squares of separable residuals is minimized using variable projection.
+ *
+ * The residuals must be linear in some of the parameters, i.e. r_i = y_i - sum_k c_k phi_ik(b) with linear coefficients c
+ * and nonlinear parameters b. For every value of b the optimal coefficients are computed with a small dense least squares
+ * solve and gn_sbfgs_min is only run over the nonlinear parameters with Kaufman's approximation of the Jacobian of the
+ * reduced problem. Compared to solving for all parameters with gn_sbfgs_min the number of parameters and of MultiDiff
+ * directions drops from L + N to N, no starting values for c are needed and usually fewer iterations are performed.
+ *
+ * \param tolerance             Same as for gn_sbfgs_min.
+ * \param params                On input contains the initial nonlinear parameters and on output the nonlinear parameters that
+ *                              minimize the sum of squares of the residuals.
+ * \param linear                The size is the number L of linear coefficients. On output contains the optimal coefficients
+ *                              for the returned nonlinear parameters. The input values are ignored.
+ * \param residuals             An array or vector of separable residual functors. Each functor must have a templated member
+ *                              operator()( const REAL *params, REAL *basis ) storing the values phi_i0 ... phi_iL-1 of the
+ *                              basis functions for the given nonlinear parameters in basis, and a member observation()
+ *                              returning y_i.
+ * \param monitor               Same as for gn_sbfgs_min. The reported parameters are the nonlinear parameters.
+ */
+template<typename VERBOSITY = Verbose , int MAXITER = 1000, typename REAL, typename Residuals, typename Monitor = internal::NoMonitor>
+void varpro_min( REAL tolerance, simd::aligned_vector<REAL> &params, simd::aligned_vector<REAL> &linear, Residuals residuals, Monitor monitor = Monitor() )
+{
+   const std::size_t L = linear.size();
+   internal::VarProTransform<REAL, Residuals> pt( residuals, L );
+
+   gn_sbfgs_min<VERBOSITY, MAXITER>( tolerance, params, internal::ProjectedResiduals<Residuals>( residuals, L ), pt, monitor );
+
+   internal::VarProParams<REAL> p = pt( params.data() );
+   std::copy( p.linear.begin(), p.linear.end(), linear.begin() );
+} //end of varpro_min
+
+} //cpplsq
+
+#endif
@@ -0,0 +1,84 @@
+#include <catch/catch.hpp>
+#include <cpplsq/checkpoint.hpp>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include "ExpDecay.hpp"
+
+TEST_CASE( "Restoring from a checkpoint continues the same trajectory", "[cpplsq]" )
+{
+   const char *path = "cpplsq_checkpoint_test.bin";
+   std::mt19937 e1( 3256271490 );
+   std::uniform_real_distribution<double> disturb( -0.1, 0.1 );
+   std::vector<ExpDecayResidual> r;
+
+   for( int i = 0; i < 1000; ++i )
+   {
+      double x = 0.02 * i;
+      r.emplace_back( x, disturb( e1 ) + 4.0 * std::exp( -0.7 * x ) + 2.0 );
+   }
+
+   simd::aligned_vector<double> start( 3 );
+   start[0] = 1;
+   start[1] = 5;
+   start[2] = 0;
+
+   //uninterrupted solve
+   simd::aligned_vector<double> full = start;
+   cpplsq::gn_sbfgs_min<cpplsq::Silent>( 1e-10, full, r );
+
+   //solve that is stopped after 4 iterations and writes a checkpoint every 2 iterations
+   simd::aligned_vector<double> interrupted = start;
+   cpplsq::gn_sbfgs_min<cpplsq::Silent, 4>( 1e-10, interrupted, r, cpplsq::internal::IdentityTransform(), cpplsq::Checkpointer<double>( path, 2 ) );
+
+   simd::aligned_vector<double> restored;
+   cpplsq::gn_sbfgs_restore<cpplsq::Silent>( path, 1e-10, restored, r );
+
+   REQUIRE( restored.size() == full.size() );
+
+   for( std::size_t i = 0; i < full.size(); ++i )
+      REQUIRE( restored[i] == full[i] );
+
+   std::remove( path );
+}
+
+TEST_CASE( "A checkpoint with a corrupted size is rejected", "[cpplsq]" )
+{
+   const char *path = "cpplsq_corrupted_checkpoint_test.bin";
+   cpplsq::internal::CheckpointHeader header;
+   std::memset( &header, 0, sizeof( header ) );
+   std::strncpy( header.magic, cpplsq::internal::checkpoint_magic(), sizeof( header.magic ) );
+   header.version = 1;
+   header.element_size = sizeof( double );
+
+   simd::aligned_vector<double> params;
+   cpplsq::internal::SbfgsState<double> state;
+   const double values[9] = {};
+
+   //one parameter more than the file holds, a size whose packed matrix overflows and a huge size
+   for( std::uint64_t N : { std::uint64_t( 3 ), std::uint64_t( 1 ) << 32, ~std::uint64_t( 0 ) } )
+   {
+      header.num_parameters = N;
+      std::FILE *f = std::fopen( path, "wb" );
+      REQUIRE( f );
+      std::fwrite( &header, sizeof( header ), 1, f );
+      std::fwrite( values, sizeof( double ), 2 + 3, f );
+      std::fclose( f );
+
+      REQUIRE_THROWS_AS( cpplsq::internal::read_checkpoint( path, params, state ), std::runtime_error );
+   }
+
+   //two parameters and their packed matrix are read
+   header.num_parameters = 2;
+   std::FILE *f = std::fopen( path, "wb" );
+   REQUIRE( f );
+   std::fwrite( &header, sizeof( header ), 1, f );
+   std::fwrite( values, sizeof( double ), 2 + 3, f );
+   std::fclose( f );
+
+   cpplsq::internal::read_checkpoint( path, params, state );
+   REQUIRE( params.size() == 2 );
+   REQUIRE( state.A.size() == 3 );
+
+   std::remove( path );
+}
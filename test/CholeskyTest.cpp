@@ -1,5 +1,7 @@
 #include <catch/catch.hpp>
 #include <cpplsq/cholesky_solve.hpp>
+#include <cpplsq/packed_cholesky.hpp>
+#include <cpplsq/tiled_cholesky.hpp>
 #include <iostream>
 
 TEST_CASE( "cholesky decomposition works correctly", "[cpplsq]" )
@@ -78,3 +80,327 @@ TEST_CASE( "cholesky decomposition works correctly", "[cpplsq]" )
    }
 
 }
+
+TEST_CASE( "mixed precision cholesky solve refines to double accuracy", "[cpplsq]" )
+{
+   const std::size_t N = 40;
+   std::vector<double> A( N * N, 0 );
+   std::vector<double> x( N );
+
+   //A = M^T M + I for a matrix M with entries in [-1, 1]
+   for( std::size_t k = 0; k < N; ++k )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+         x[i] = std::sin( 1.7 * i * k + 0.3 * i + 0.5 );
+
+      cpplsq::blas::syr( N, 1.0, x.data(), 1, A.data(), N );
+   }
+
+   for( std::size_t i = 0; i < N; ++i )
+   {
+      A[i * N + i] += 1;
+      x[i] = 1. + i;
+   }
+
+   std::vector<double> b( N );
+   cpplsq::blas::symv( N, 1.0, A.data(), N, x.data(), 1, 0.0, b.data(), 1 );
+
+   std::vector<double> u( b );
+   REQUIRE( cpplsq::cholesky_solve_mixed<float>( A.data(), N, u.data(), N ) == 0 );
+
+   for( std::size_t i = 0; i < N; ++i )
+      REQUIRE( u[i] == Approx( x[i] ).epsilon( 1e-11 ) );
+
+   //the hilbert matrix is too badly conditioned for a single precision factorization
+   const std::size_t H = 12;
+   std::vector<double> hilbert( H * H );
+   std::vector<double> c( H, 1. );
+
+   for( std::size_t i = 0; i < H; ++i )
+      for( std::size_t j = 0; j < H; ++j )
+         hilbert[i * H + j] = 1. / ( i + j + 1 );
+
+   REQUIRE( cpplsq::cholesky_solve_mixed<float>( hilbert.data(), H, c.data(), H ) != 0 );
+
+   for( double ci : c )
+      REQUIRE( ci == 1. );
+}
+
+TEST_CASE( "modified cholesky decomposition of indefinite matrix", "[cpplsq]" )
+{
+   const std::size_t N = 6;
+   std::vector<double> A( N * N, 0 );
+
+   for( std::size_t i = 0; i < N; ++i )
+      for( std::size_t j = 0; j <= i; ++j )
+         A[i * N + j] = std::cos( 2. * i + j ) + ( i == j ? 1.5 : 0. );
+
+   //L L^T equals A up to a nonnegative diagonal
+   auto check = [&A, N]( const std::vector<double> &L, double emax )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+      {
+         for( std::size_t j = 0; j <= i; ++j )
+         {
+            double llt = 0;
+
+            for( std::size_t k = 0; k <= j; ++k )
+               llt += L[i * N + k] * L[j * N + k];
+
+            if( i == j )
+            {
+               REQUIRE( llt >= A[i * N + i] - 1e-12 );
+               REQUIRE( llt - A[i * N + i] <= emax + 1e-12 );
+            }
+            else
+            {
+               REQUIRE( llt == Approx( A[i * N + j] ).margin( 1e-12 ) );
+            }
+         }
+      }
+   };
+
+   std::vector<double> L( A );
+   int pos = cpplsq::cholesky_factor( L.data(), N, N );
+   REQUIRE( pos > 1 );
+
+   //continue the failed decomposition
+   double emax = cpplsq::cholesky_factor_modified( L.data(), N, N, pos - 1 );
+   REQUIRE( emax > 0 );
+   check( L, emax );
+
+   //factorize from the start
+   std::vector<double> M( A );
+   emax = cpplsq::cholesky_factor_modified( M.data(), N, N );
+   REQUIRE( emax > 0 );
+   check( M, emax );
+
+   //no modification for a positive definite matrix
+   for( std::size_t i = 0; i < N; ++i )
+      A[i * N + i] += 10;
+
+   std::vector<double> P( A );
+   std::vector<double> Q( A );
+   REQUIRE( cpplsq::cholesky_factor( P.data(), N, N ) == 0 );
+   REQUIRE( cpplsq::cholesky_factor_modified( Q.data(), N, N ) == 0 );
+
+   for( std::size_t i = 0; i < N * N; ++i )
+      REQUIRE( Q[i] == Approx( P[i] ) );
+}
+
+TEST_CASE( "packed cholesky decomposition matches the full one", "[cpplsq]" )
+{
+   const std::size_t N = 7;
+   std::vector<double> A( N * N, 0 );
+   std::vector<double> AP( cpplsq::packed_size( N ) );
+
+   for( std::size_t i = 0; i < N; ++i )
+      for( std::size_t j = 0; j <= i; ++j )
+         A[i * N + j] = AP[cpplsq::packed_index( i, j )] = std::cos( 2. * i + j ) + ( i == j ? 1.5 : 0. );
+
+   //indefinite: both fail at the same column and the modified decompositions agree
+   std::vector<double> L( A );
+   std::vector<double> LP( AP );
+   int pos = cpplsq::cholesky_factor( L.data(), N, N );
+   REQUIRE( pos > 1 );
+   REQUIRE( cpplsq::packed_cholesky_factor( LP.data(), N ) == pos );
+   REQUIRE( cpplsq::packed_cholesky_factor_modified( LP.data(), N, pos - 1 ) ==
+            Approx( cpplsq::cholesky_factor_modified( L.data(), N, N, pos - 1 ) ) );
+
+   for( std::size_t i = 0; i < N; ++i )
+      for( std::size_t j = 0; j <= i; ++j )
+         REQUIRE( LP[cpplsq::packed_index( i, j )] == Approx( L[i * N + j] ) );
+
+   //positive definite: the solutions agree
+   for( std::size_t i = 0; i < N; ++i )
+   {
+      A[i * N + i] += 10;
+      AP[cpplsq::packed_index( i, i )] += 10;
+   }
+
+   std::vector<double> b( N );
+
+   for( std::size_t i = 0; i < N; ++i )
+      b[i] = 1. + i;
+
+   std::vector<double> x( b );
+   std::vector<double> xp( b );
+   std::vector<double> xm( b );
+   REQUIRE( cpplsq::cholesky_solve( A.data(), N, x.data(), N ) == 0 );
+   REQUIRE( cpplsq::packed_cholesky_solve_mixed<float>( AP.data(), xm.data(), N ) == 0 );
+   REQUIRE( cpplsq::packed_cholesky_solve( AP.data(), xp.data(), N ) == 0 );
+
+   for( std::size_t i = 0; i < N; ++i )
+   {
+      REQUIRE( xp[i] == Approx( x[i] ).epsilon( 1e-12 ) );
+      REQUIRE( xm[i] == Approx( x[i] ).epsilon( 1e-12 ) );
+   }
+}
+
+TEST_CASE( "tiled cholesky decomposition matches the unblocked one", "[cpplsq]" )
+{
+   //the last tile is smaller than the others
+   const std::size_t N = 230;
+   const std::size_t NB = 32;
+   std::vector<double> A( N * N, 0 );
+   std::vector<double> x( N );
+
+   for( std::size_t k = 0; k < N; ++k )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+         x[i] = std::sin( 1.3 * i * k + 0.7 * i + 0.2 );
+
+      cpplsq::blas::syr( N, 1.0, x.data(), 1, A.data(), N );
+   }
+
+   for( std::size_t i = 0; i < N; ++i )
+      A[i * N + i] += 1;
+
+   std::vector<double> L( A );
+   REQUIRE( cpplsq::cholesky_factor( L.data(), N, N ) == 0 );
+
+   for( std::size_t threads : { 1, 4 } )
+   {
+      cpplsq::internal::ThreadPool pool( threads );
+      std::vector<double> T( A );
+      REQUIRE( cpplsq::tiled_cholesky_factor( pool, T.data(), N, N, NB ) == 0 );
+
+      for( std::size_t i = 0; i < N; ++i )
+         for( std::size_t j = 0; j <= i; ++j )
+            REQUIRE( T[i * N + j] == Approx( L[i * N + j] ).epsilon( 1e-9 ).margin( 1e-12 ) );
+   }
+
+   //an indefinite trailing block is detected at the same position
+   for( std::size_t i = 150; i < N; ++i )
+      A[i * N + i] -= 1e4;
+
+   cpplsq::internal::ThreadPool pool( 4 );
+   std::vector<double> T( A );
+   L = A;
+   int pos = cpplsq::cholesky_factor( L.data(), N, N );
+   REQUIRE( pos > 0 );
+   REQUIRE( cpplsq::tiled_cholesky_factor( pool, T.data(), N, N, NB ) == pos );
+}
+
+TEST_CASE( "tiled cholesky solve of a packed matrix matches the packed one", "[cpplsq]" )
+{
+   const std::size_t N = 100;
+   std::vector<double> AP( cpplsq::packed_size( N ), 0 );
+   std::vector<double> x( N ), b( N ), work;
+
+   for( std::size_t k = 0; k < N; ++k )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+         x[i] = std::sin( 0.9 * i * k + 0.3 * i + 0.5 );
+
+      cpplsq::blas::spr( N, 1.0, x.data(), 1, AP.data() );
+   }
+
+   for( std::size_t i = 0; i < N; ++i )
+   {
+      AP[cpplsq::packed_index( i, i )] += 1;
+      b[i] = std::cos( 0.4 * i );
+   }
+
+   std::vector<double> L( AP ), xp( b ), xt( b );
+   REQUIRE( cpplsq::packed_cholesky_solve( L.data(), xp.data(), N ) == 0 );
+
+   cpplsq::internal::ThreadPool pool( 4 );
+   REQUIRE( cpplsq::packed_tiled_cholesky_solve( pool, AP.data(), xt.data(), N, work, 16 ) == 0 );
+
+   for( std::size_t i = 0; i < N; ++i )
+      REQUIRE( xt[i] == Approx( xp[i] ).epsilon( 1e-9 ) );
+}
+
+TEST_CASE( "small blas kernels agree with cblas", "[cpplsq]" )
+{
+   using cpplsq::blas;
+
+   for( int n = 1; n <= cpplsq::internal::small_blas_size + 2; ++n )
+   {
+      const int ld = n + 3;
+      std::vector<double> A( n * ld ), AP( cpplsq::packed_size( n ) );
+      std::vector<double> x( n ), y( n );
+
+      for( int i = 0; i < n; ++i )
+      {
+         x[i] = std::sin( 0.9 * i + 0.1 );
+         y[i] = std::cos( 1.1 * i );
+
+         for( int j = 0; j <= i; ++j )
+            A[i * ld + j] = AP[cpplsq::packed_index( i, j )] = std::cos( 0.3 * i + 1.7 * j ) + ( i == j ? 3. : 0. );
+      }
+
+      REQUIRE( blas::dot( n, x.data(), 1, y.data(), 1 ) == Approx( cblas_ddot( n, x.data(), 1, y.data(), 1 ) ) );
+      REQUIRE( blas::iamax( n, y.data(), 1 ) == cblas_idamax( n, y.data(), 1 ) );
+
+      auto check = []( const std::vector<double> &u, const std::vector<double> &v )
+      {
+         for( std::size_t i = 0; i < u.size(); ++i )
+            REQUIRE( u[i] == Approx( v[i] ).margin( 1e-13 ) );
+      };
+
+      std::vector<double> u( y ), v( y );
+      blas::axpy( n, 0.7, x.data(), 1, u.data(), 1 );
+      cblas_daxpy( n, 0.7, x.data(), 1, v.data(), 1 );
+      check( u, v );
+
+      u = y, v = y;
+      blas::symv( n, 0.7, A.data(), ld, x.data(), 1, -0.2, u.data(), 1 );
+      cblas_dsymv( CblasRowMajor, CblasLower, n, 0.7, A.data(), ld, x.data(), 1, -0.2, v.data(), 1 );
+      check( u, v );
+
+      u = y, v = y;
+      blas::spmv( n, 0.7, AP.data(), x.data(), 1, 0., u.data(), 1 );
+      cblas_dspmv( CblasRowMajor, CblasLower, n, 0.7, AP.data(), x.data(), 1, 0., v.data(), 1 );
+      check( u, v );
+
+      for( CBLAS_TRANSPOSE trans : { CblasNoTrans, CblasTrans } )
+      {
+         u = y, v = y;
+         blas::trsv( trans, CblasNonUnit, n, A.data(), ld, u.data(), 1 );
+         cblas_dtrsv( CblasRowMajor, CblasLower, trans, CblasNonUnit, n, A.data(), ld, v.data(), 1 );
+         check( u, v );
+
+         u = y, v = y;
+         blas::tpsv( trans, CblasUnit, n, AP.data(), u.data(), 1 );
+         cblas_dtpsv( CblasRowMajor, CblasLower, trans, CblasUnit, n, AP.data(), v.data(), 1 );
+         check( u, v );
+
+         u.assign( ld, 0.5 ), v.assign( ld, 0.5 );
+         blas::gemv( trans, n, n, 0.7, A.data(), ld, x.data(), 1, 1., u.data(), 1 );
+         cblas_dgemv( CblasRowMajor, trans, n, n, 0.7, A.data(), ld, x.data(), 1, 1., v.data(), 1 );
+         check( u, v );
+      }
+
+      std::vector<double> B( A ), C( A ), BP( AP ), CP( AP );
+      blas::syr( n, -0.3, x.data(), 1, B.data(), ld );
+      cblas_dsyr( CblasRowMajor, CblasLower, n, -0.3, x.data(), 1, C.data(), ld );
+      check( B, C );
+      blas::spr( n, -0.3, x.data(), 1, BP.data() );
+      cblas_dspr( CblasRowMajor, CblasLower, n, -0.3, x.data(), 1, CP.data() );
+      check( BP, CP );
+   }
+}
+
+TEST_CASE( "small vector kernels leave negative increments to cblas", "[cpplsq]" )
+{
+   using cpplsq::blas;
+   const int n = 3;
+   std::vector<double> x { 1., -4., 2. }, y { 3., 5., -7. };
+
+   //a negative increment walks the vector backwards from its last element
+   REQUIRE( blas::dot( n, x.data(), 1, y.data(), -1 ) == Approx( 1. * -7. - 4. * 5. + 2. * 3. ) );
+
+   std::vector<double> u( y );
+   blas::axpy( n, 0.5, x.data(), -1, u.data(), 1 );
+   REQUIRE( u[0] == Approx( 3. + 0.5 * 2. ) );
+   REQUIRE( u[1] == Approx( 5. - 0.5 * 4. ) );
+   REQUIRE( u[2] == Approx( -7. + 0.5 * 1. ) );
+
+   //scal and iamax do nothing for increments that are not positive
+   u = x;
+   blas::scal( n, 2., u.data(), -1 );
+   REQUIRE( u == x );
+   REQUIRE( blas::iamax( n, x.data(), 0 ) == 0 );
+}
@@ -0,0 +1,70 @@
+#ifndef _CPPLSQ_TEST_EXP_DECAY_HPP_
+#define _CPPLSQ_TEST_EXP_DECAY_HPP_
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <simd/alloc.hpp>
+
+/**
+ * Residual of the model p0 * exp( -p1 * x ) + p2 for the sample (x, y).
+ */
+struct ExpDecayResidual
+{
+   ExpDecayResidual( double x, double y ) : x( x ), y( y ) {}
+
+   template<typename REAL >
+   REAL operator()( const REAL *params )
+   {
+      return y - ( params[0] * exp( -params[1] * x ) + params[2] );
+   }
+private:
+   double x;
+   double y;
+};
+
+/**
+ * Samples of the model p0 * exp( -p1 * x ) + p2 with random parameters in [0.1, 10] at 10000
+ * points in [0.1, 20], disturbed by uniform noise in [-0.1, 0.1], and a random start point.
+ */
+struct ExpDecayProblem
+{
+   explicit ExpDecayProblem( unsigned seed = 3256271490 ) : x( 3 )
+   {
+      std::mt19937 e1( seed );
+      std::uniform_real_distribution<double> uniform_dist( 0.1, 10 );
+      std::uniform_real_distribution<double> disturb( -0.1, 0.1 );
+
+      for( double &pi : p )
+         pi = uniform_dist( e1 );
+
+      for( std::size_t i = 0; i < x.size(); ++i )
+         x[i] = uniform_dist( e1 );
+
+      for( int i = 0; i < 10000; ++i )
+      {
+         double xi = 0.1 + ( i * 19.9 ) / 10000;
+         xs.push_back( xi );
+         ys.push_back( disturb( e1 ) + ( p[0] * exp( -p[1] * xi ) + p[2] ) );
+      }
+   }
+
+   std::vector<ExpDecayResidual> residuals() const
+   {
+      std::vector<ExpDecayResidual> r;
+
+      for( std::size_t i = 0; i < xs.size(); ++i )
+         r.emplace_back( xs[i], ys[i] );
+
+      return r;
+   }
+
+   /// parameters of the model that generated the samples
+   double p[3];
+   /// start point
+   simd::aligned_vector<double> x;
+   std::vector<double> xs;
+   std::vector<double> ys;
+};
+
+#endif
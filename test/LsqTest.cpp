@@ -1,6 +1,16 @@
 #include <catch/catch.hpp>
+#include <algorithm>
+#include <type_traits>
 #include <cpplsq/gn_sbfgs_min.hpp>
+#include <cpplsq/lm_sbfgs_min.hpp>
+#include <cpplsq/gn_cg_min.hpp>
+#include <cpplsq/gn_qr_min.hpp>
+#include <cpplsq/gn_lsbfgs_min.hpp>
+#include <cpplsq/varpro_min.hpp>
+#include <cpplsq/gn_schur_min.hpp>
+#include <cpplsq/gn_sbfgs_fixed.hpp>
 #include "Rosenbrock.hpp"
+#include "ExpDecay.hpp"
 
 struct RosenbrockResidual
 {
@@ -31,6 +41,119 @@ private:
    double y;
 };
 
+struct SeparableResidual
+{
+   SeparableResidual( double x, double y ) : x( x ), y( y ) {}
+
+   //y - ( c0 * exp( -params[0] * x ) + c1 )
+   template<typename REAL >
+   void operator()( const REAL *params, REAL *basis )
+   {
+      basis[0] = exp( -params[0] * x );
+      basis[1] = 1.0;
+   }
+
+   double observation() const
+   {
+      return y;
+   }
+private:
+   double x;
+   double y;
+};
+
+struct IterationCounter
+{
+   void operator()( const cpplsq::IterationInfo<double> &info )
+   {
+      *iterations = info.iteration;
+   }
+
+   int *iterations;
+};
+
+struct ExtendedRosenbrockResidual
+{
+   ExtendedRosenbrockResidual( int i ) : i( i ) {}
+
+   template<typename REAL >
+   REAL operator()( const REAL *params )
+   {
+      const int k = i - i % 2;
+
+      if( i % 2 == 0 )
+         return 10 * ( params[k + 1] - params[k] * params[k] );
+
+      return 1 - params[k];
+   }
+private:
+   int i;
+};
+
+/**
+ * Extended rosenbrock function in N parameters with the standard start point.
+ */
+struct ExtendedRosenbrockProblem
+{
+   explicit ExtendedRosenbrockProblem( int N ) : x( N )
+   {
+      for( int i = 0; i < N; ++i )
+      {
+         x[i] = i % 2 == 0 ? -1.2 : 1;
+         r.emplace_back( i );
+      }
+   }
+
+   simd::aligned_vector<double> x;
+   std::vector<ExtendedRosenbrockResidual> r;
+};
+
+
+struct DecayGroup
+{
+   std::size_t num_local() const
+   {
+      return 2;
+   }
+
+   std::size_t size() const
+   {
+      return x.size();
+   }
+
+   //shared rate and offset as global parameters, amplitude and slope as local parameters
+   template<typename REAL >
+   REAL operator()( std::size_t i, const REAL *global, const REAL *local )
+   {
+      return y[i] - ( local[0] * exp( -global[0] * x[i] ) + global[1] + local[1] * x[i] );
+   }
+
+   std::vector<double> x;
+   std::vector<double> y;
+};
+
+
+struct UnderdeterminedResidual
+{
+   UnderdeterminedResidual( int i, int N, double y ) : i( i ), N( N ), y( y ) {}
+
+   template<typename REAL >
+   REAL operator()( const REAL *params )
+   {
+      REAL sum;
+      sum = 0;
+
+      for( int j = 0; j < N; ++j )
+         sum += cos( i * j + 1. ) * params[j];
+
+      return exp( sum / double( N ) ) - y;
+   }
+private:
+   int i;
+   int N;
+   double y;
+};
+
 
 TEST_CASE( "Test of least squares routine with rosenbrock function", "[cpplsq]" )
 {
@@ -118,3 +241,492 @@ TEST_CASE( "Test of least squares routine with exponential decay", "[cpplsq]" )
    REQUIRE( x[2] == Approx( p2 ).epsilon( 0.1 ) );
 
 }
+
+TEST_CASE( "Test of levenberg-marquardt routine with exponential decay", "[cpplsq]" )
+{
+   ExpDecayProblem problem;
+   simd::aligned_vector<double> &x = problem.x;
+
+   cpplsq::lm_sbfgs_min<cpplsq::Silent>( 1e-8, x, problem.residuals() );
+
+   REQUIRE( x[0] == Approx( problem.p[0] ).epsilon( 0.1 ) );
+   REQUIRE( x[1] == Approx( problem.p[1] ).epsilon( 0.1 ) );
+   REQUIRE( x[2] == Approx( problem.p[2] ).epsilon( 0.1 ) );
+}
+
+/**
+ * Wraps a residual and counts the evaluations with derivatives, which are the Jacobian
+ * sweeps, and the evaluations of the values only.
+ */
+template<typename RESIDUAL>
+struct CountingResidual
+{
+   CountingResidual( RESIDUAL residual, int *jacobian_evals, int *value_evals ) :
+      residual( residual ), jacobian_evals( jacobian_evals ), value_evals( value_evals ) {}
+
+   template<typename REAL >
+   REAL operator()( const REAL *params )
+   {
+      ++*( std::is_same<REAL, double>::value ? value_evals : jacobian_evals );
+      return residual( params );
+   }
+private:
+   RESIDUAL residual;
+   int *jacobian_evals;
+   int *value_evals;
+};
+
+TEST_CASE( "Test of levenberg-marquardt routine evaluating the jacobian once per iteration", "[cpplsq]" )
+{
+   //the standard start point of the rosenbrock function makes the first steps too long
+   ExtendedRosenbrockResidual r0( 0 ), r1( 1 );
+   int jacobian_evals = 0;
+   int value_evals = 0;
+   std::vector<CountingResidual<ExtendedRosenbrockResidual>> r
+   {
+      { r0, &jacobian_evals, &value_evals },
+      { r1, &jacobian_evals, &value_evals }
+   };
+
+   simd::aligned_vector<double> x { -1.2, 1 };
+   int iterations = 0;
+   cpplsq::lm_sbfgs_min<cpplsq::Silent>( 1e-12, x, r, cpplsq::internal::IdentityTransform(), IterationCounter { &iterations } );
+
+   REQUIRE( x[0] == Approx( 1 ).epsilon( 1e-6 ) );
+   REQUIRE( x[1] == Approx( 1 ).epsilon( 1e-6 ) );
+
+   //one trial point per accepted step and at least one rejected step
+   const int trials = value_evals / 2;
+   REQUIRE( trials > iterations );
+
+   //the rejected steps did not evaluate the jacobian, only the start point and the accepted steps did
+   REQUIRE( jacobian_evals == 2 * ( iterations + 1 ) );
+}
+
+TEST_CASE( "Test of matrix free gauss-newton routine with exponential decay", "[cpplsq]" )
+{
+   ExpDecayProblem problem;
+   simd::aligned_vector<double> &x = problem.x;
+
+   cpplsq::gn_cg_min<cpplsq::Silent>( 1e-8, x, problem.residuals() );
+
+   REQUIRE( x[0] == Approx( problem.p[0] ).epsilon( 0.1 ) );
+   REQUIRE( x[1] == Approx( problem.p[1] ).epsilon( 0.1 ) );
+   REQUIRE( x[2] == Approx( problem.p[2] ).epsilon( 0.1 ) );
+}
+
+TEST_CASE( "Test of matrix free gauss-newton routine against dense gauss-newton", "[cpplsq]" )
+{
+   ExpDecayProblem problem;
+   simd::aligned_vector<double> dense = problem.x;
+   simd::aligned_vector<double> &x = problem.x;
+
+   cpplsq::gn_qr_min<cpplsq::Silent>( 1e-12, dense, problem.residuals() );
+   cpplsq::gn_cg_min<cpplsq::Silent>( 1e-12, x, problem.residuals() );
+
+   //the inexact steps of CG still converge to the same minimizer
+   for( std::size_t i = 0; i < x.size(); ++i )
+      REQUIRE( x[i] == Approx( dense[i] ).epsilon( 1e-8 ) );
+}
+
+TEST_CASE( "Test of matrix free gauss-newton routine with more parameters than directions", "[cpplsq]" )
+{
+   //more parameters than the chunk size so that J^T u is accumulated over several sweeps
+   ExtendedRosenbrockProblem problem( 70 );
+   cpplsq::gn_cg_min<cpplsq::Silent>( 1e-12, problem.x, problem.r );
+
+   for( double xi : problem.x )
+      REQUIRE( xi == Approx( 1 ).epsilon( 1e-4 ) );
+}
+
+TEST_CASE( "Test of limited memory structured bfgs routine with exponential decay", "[cpplsq]" )
+{
+   ExpDecayProblem problem;
+   simd::aligned_vector<double> &x = problem.x;
+
+   cpplsq::gn_lsbfgs_min<cpplsq::Silent, 1000, 4>( 1e-8, x, problem.residuals() );
+
+   REQUIRE( x[0] == Approx( problem.p[0] ).epsilon( 0.1 ) );
+   REQUIRE( x[1] == Approx( problem.p[1] ).epsilon( 0.1 ) );
+   REQUIRE( x[2] == Approx( problem.p[2] ).epsilon( 0.1 ) );
+}
+
+TEST_CASE( "Test of limited memory structured bfgs routine with more parameters than directions", "[cpplsq]" )
+{
+   ExtendedRosenbrockProblem problem( 70 );
+   cpplsq::gn_lsbfgs_min<cpplsq::Silent>( 1e-12, problem.x, problem.r );
+
+   for( double xi : problem.x )
+      REQUIRE( xi == Approx( 1 ).epsilon( 1e-4 ) );
+}
+
+TEST_CASE( "Test of the compact secant against the dense structured bfgs update", "[cpplsq]" )
+{
+   const std::size_t N = 5;
+   const double sigma = 0.3;
+   std::mt19937 e1( 3256271490 );
+   std::uniform_real_distribution<double> uniform_dist( -1, 1 );
+
+   cpplsq::internal::CompactSecant<double, 4> compact( N );
+   compact.init( sigma );
+
+   //dense A = sigma I updated with the same pairs as in SbfgsModel::update
+   std::vector<double> A( N * N, 0 );
+
+   for( std::size_t i = 0; i < N; ++i )
+      A[i * N + i] = sigma;
+
+   for( int k = 0; k < 4; ++k )
+   {
+      std::vector<double> s( N ), z( N ), As( N, 0 );
+
+      for( std::size_t i = 0; i < N; ++i )
+      {
+         s[i] = uniform_dist( e1 );
+         z[i] = s[i] * ( 1.5 + uniform_dist( e1 ) );
+      }
+
+      double sAs = 0;
+      double zs = 0;
+
+      for( std::size_t i = 0; i < N; ++i )
+      {
+         for( std::size_t j = 0; j < N; ++j )
+            As[i] += A[i * N + j] * s[j];
+
+         sAs += s[i] * As[i];
+         zs += z[i] * s[i];
+      }
+
+      for( std::size_t i = 0; i < N; ++i )
+         for( std::size_t j = 0; j < N; ++j )
+            A[i * N + j] += z[i] * z[j] / zs - As[i] * As[j] / sAs;
+
+      REQUIRE( compact.push( s.data(), z.data() ) );
+   }
+
+   std::vector<double> d( N );
+   compact.diagonal( d.data() );
+
+   for( std::size_t j = 0; j < N; ++j )
+   {
+      std::vector<double> e( N, 0 ), Ae( N, 0 );
+      e[j] = 1;
+      compact.apply( e.data(), Ae.data() );
+
+      for( std::size_t i = 0; i < N; ++i )
+         REQUIRE( Ae[i] == Approx( A[i * N + j] ).margin( 1e-12 ) );
+
+      REQUIRE( d[j] == Approx( A[j * N + j] ).margin( 1e-12 ) );
+   }
+}
+
+TEST_CASE( "Test of the compact secant dropping a pair that makes it singular", "[cpplsq]" )
+{
+   const std::size_t N = 2;
+   cpplsq::internal::CompactSecant<double, 1> compact( N );
+   compact.init( 1 );
+
+   const double s0[N] = { 1, 0 };
+   const double z0[N] = { 2, 0 };
+   REQUIRE( compact.push( s0, z0 ) );
+
+   //z = 0 makes the middle matrix singular
+   const double s1[N] = { 0, 1 };
+   const double z1[N] = { 0, 0 };
+   REQUIRE_FALSE( compact.push( s1, z1 ) );
+   REQUIRE( compact.size() == 1 );
+
+   //A is still the update of I with the first pair, which is diag( 2, 1 )
+   const double v[N] = { 1, 1 };
+   double Av[N] = { 0, 0 };
+   compact.apply( v, Av );
+   REQUIRE( Av[0] == Approx( 2 ) );
+   REQUIRE( Av[1] == Approx( 1 ) );
+}
+
+/**
+ * Residual of the exponential decay model with only the rate as parameter.
+ */
+struct DecayRateResidual
+{
+   DecayRateResidual( double x, double y ) : x( x ), y( y ) {}
+
+   template<typename REAL >
+   REAL operator()( const REAL *params )
+   {
+      return y - ( 4 * exp( -params[0] * x ) + 2 );
+   }
+private:
+   double x;
+   double y;
+};
+
+struct IterateRecorder
+{
+   void operator()( const cpplsq::IterationInfo<double> &info )
+   {
+      iterates->emplace_back( info.params, info.params + info.N );
+   }
+
+   std::vector<std::vector<double>> *iterates;
+};
+
+TEST_CASE( "Test of limited memory structured bfgs routine against the dense iterates", "[cpplsq]" )
+{
+   //with one parameter CG solves for the step exactly and the memory holds every pair,
+   //so the iterates are the ones of gn_sbfgs_min
+   std::mt19937 e1( 3256271490 );
+   std::uniform_real_distribution<double> disturb( -0.1, 0.1 );
+   std::vector<DecayRateResidual> r;
+
+   for( int i = 0; i < 1000; ++i )
+   {
+      double x = 0.02 * i;
+      r.emplace_back( x, disturb( e1 ) + 4 * std::exp( -0.7 * x ) + 2 );
+   }
+
+   std::vector<std::vector<double>> dense_iterates;
+   std::vector<std::vector<double>> iterates;
+   simd::aligned_vector<double> dense { 5 };
+   simd::aligned_vector<double> x { 5 };
+   cpplsq::gn_sbfgs_min<cpplsq::Silent>( 1e-10, dense, r, cpplsq::internal::IdentityTransform(), IterateRecorder { &dense_iterates } );
+   cpplsq::gn_lsbfgs_min<cpplsq::Silent, 1000, 50>( 1e-10, x, r, cpplsq::internal::IdentityTransform(), IterateRecorder { &iterates } );
+
+   REQUIRE( iterates.size() == dense_iterates.size() );
+   REQUIRE( iterates.size() < 50 );
+
+   for( std::size_t k = 0; k < iterates.size(); ++k )
+      REQUIRE( iterates[k][0] == Approx( dense_iterates[k][0] ).epsilon( 1e-12 ) );
+}
+
+TEST_CASE( "Test of variable projection routine with exponential decay", "[cpplsq]" )
+{
+   ExpDecayProblem problem;
+   simd::aligned_vector<double> &x = problem.x;
+   std::vector<SeparableResidual> sr;
+
+   for( std::size_t i = 0; i < problem.xs.size(); ++i )
+      sr.emplace_back( problem.xs[i], problem.ys[i] );
+
+   //only the rate is a nonlinear parameter
+   simd::aligned_vector<double> b { x[1] };
+   simd::aligned_vector<double> c( 2 );
+
+   int full_iterations = 0;
+   int varpro_iterations = 0;
+   cpplsq::gn_sbfgs_min<cpplsq::Silent>( 1e-8, x, problem.residuals(), cpplsq::internal::IdentityTransform(), IterationCounter { &full_iterations } );
+   cpplsq::varpro_min<cpplsq::Silent>( 1e-8, b, c, sr, IterationCounter { &varpro_iterations } );
+
+   REQUIRE( c[0] == Approx( problem.p[0] ).epsilon( 0.1 ) );
+   REQUIRE( b[0] == Approx( problem.p[1] ).epsilon( 0.1 ) );
+   REQUIRE( c[1] == Approx( problem.p[2] ).epsilon( 0.1 ) );
+
+   //same minimizer with fewer iterations
+   REQUIRE( c[0] == Approx( x[0] ).epsilon( 1e-4 ) );
+   REQUIRE( b[0] == Approx( x[1] ).epsilon( 1e-4 ) );
+   REQUIRE( c[1] == Approx( x[2] ).epsilon( 1e-4 ) );
+   REQUIRE( varpro_iterations < full_iterations );
+}
+
+TEST_CASE( "Test of schur complement routine with local and global parameters", "[cpplsq]" )
+{
+   std::default_random_engine e1( 11 );
+   std::uniform_real_distribution<double> uniform_dist( 0.5, 1.5 );
+   std::uniform_real_distribution<double> disturb( -0.01, 0.01 );
+
+   const std::size_t G = 2;
+   const std::size_t groups = 30;
+   const double rate = uniform_dist( e1 );
+   const double offset = uniform_dist( e1 );
+   std::vector<DecayGroup> g( groups );
+
+   for( DecayGroup &group : g )
+   {
+      const double amplitude = uniform_dist( e1 );
+      const double slope = uniform_dist( e1 ) - 1;
+
+      for( int i = 0; i < 40; ++i )
+      {
+         double x = 0.1 + ( i * 4.9 ) / 40;
+         group.x.push_back( x );
+         group.y.push_back( disturb( e1 ) + amplitude * exp( -rate * x ) + offset + slope * x );
+      }
+   }
+
+   simd::aligned_vector<double> x( G + 2 * groups, 1. );
+   simd::aligned_vector<double> ref( x.begin(), x.end() );
+
+   cpplsq::gn_schur_min<cpplsq::Silent>( 1e-10, G, x, g );
+   cpplsq::gn_sbfgs_min<cpplsq::Silent>( 1e-10, ref, cpplsq::internal::GroupResiduals<std::vector<DecayGroup>>( g, G ) );
+
+   REQUIRE( x[0] == Approx( rate ).epsilon( 0.05 ) );
+   REQUIRE( x[1] == Approx( offset ).epsilon( 0.05 ) );
+
+   //same minimizer as with the dense gram matrix
+   for( std::size_t j = 0; j < x.size(); ++j )
+      REQUIRE( x[j] == Approx( ref[j] ).epsilon( 1e-4 ) );
+
+   REQUIRE_THROWS_AS( cpplsq::gn_schur_min<cpplsq::Silent>( 1e-10, G + 1, x, g ), std::invalid_argument );
+}
+
+TEST_CASE( "Test of residual space steps with fewer residuals than parameters", "[cpplsq]" )
+{
+   std::default_random_engine e1( 5 );
+   std::uniform_real_distribution<double> uniform_dist( 0.5, 1.5 );
+
+   const int M = 8;
+   const int N = 40;
+   REQUIRE( cpplsq::internal::use_residual_space( M, N ) );
+
+   std::vector<UnderdeterminedResidual> r;
+
+   for( int i = 0; i < M; ++i )
+      r.emplace_back( i, N, uniform_dist( e1 ) );
+
+   simd::aligned_vector<double> x( N );
+
+   for( double &xi : x )
+      xi = uniform_dist( e1 );
+
+   SECTION( "steps agree with the dense model" )
+   {
+      using Residuals = std::vector<UnderdeterminedResidual>;
+      using Transform = cpplsq::internal::IdentityTransform;
+      const std::size_t CN = simd::next_size<double>( N );
+      simd::aligned_array<double> dense = simd::alloc_aligned_array<double>( CN );
+      simd::aligned_array<double> woodbury = simd::alloc_aligned_array<double>( CN );
+
+      cpplsq::MultiDiff<double>::Context ctx( N );
+      {
+         Transform pt;
+         cpplsq::internal::SbfgsModel<cpplsq::Silent, double, Residuals, Transform> B( N, r, pt );
+         cpplsq::internal::ResidualSpaceModel<cpplsq::Silent, double, Residuals, Transform> W( N, r, pt );
+
+         double normr2 = B.evaluate( x.data() );
+         REQUIRE( W.evaluate( x.data() ) == Approx( normr2 ) );
+         B.init( normr2, nullptr );
+         W.init( normr2, nullptr );
+
+         for( int k = 0; k < 3; ++k )
+         {
+            REQUIRE( B.direction( dense.get() ) );
+            REQUIRE( W.direction( woodbury.get() ) );
+
+            for( int j = 0; j < N; ++j )
+               REQUIRE( woodbury[j] == Approx( dense[j] ).epsilon( 1e-6 ).margin( 1e-10 ) );
+
+            for( int j = 0; j < N; ++j )
+               x[j] += 0.5 * dense[j];
+
+            cpplsq::blas::scal( N, 0.5, dense.get(), 1 );
+            double new_normr2 = B.evaluate( x.data() );
+            W.evaluate( x.data() );
+            B.update( dense.get(), normr2, new_normr2 );
+            W.update( dense.get(), normr2, new_normr2 );
+            normr2 = new_normr2;
+         }
+      }
+   }
+
+   SECTION( "solve with residual space steps" )
+   {
+      cpplsq::gn_sbfgs_min<cpplsq::Silent>( 1e-12, x, r );
+
+      for( UnderdeterminedResidual &ri : r )
+         REQUIRE( ri( x.data() ) == Approx( 0 ).margin( 1e-5 ) );
+   }
+}
+
+TEST_CASE( "Test of mixed precision jacobian with exponential decay", "[cpplsq]" )
+{
+   std::mt19937 e1( 7 );
+   std::uniform_real_distribution<double> uniform_dist( 0.5, 5 );
+   std::uniform_real_distribution<double> disturb( -0.1, 0.1 );
+
+   double p0 = uniform_dist( e1 );
+   double p1 = uniform_dist( e1 );
+   double p2 = uniform_dist( e1 );
+   std::vector<Residual> r;
+
+   for( int i = 0; i < 5000; ++i )
+   {
+      double x = 0.1 + ( i * 9.9 ) / 5000;
+      r.emplace_back( x, disturb( e1 ) + ( p0 * exp( -p1 * x ) + p2 ) );
+   }
+
+   simd::aligned_vector<double> x { 1., 1., 1. };
+   simd::aligned_vector<double> mixed( x.begin(), x.end() );
+
+   cpplsq::gn_sbfgs_min<cpplsq::Silent>( 1e-10, x, r );
+   cpplsq::gn_sbfgs_min_mixed<cpplsq::Silent>( 1e-10, mixed, r );
+
+   //convergence is decided in double precision so both find the same minimizer
+   for( std::size_t j = 0; j < x.size(); ++j )
+      REQUIRE( mixed[j] == Approx( x[j] ).epsilon( 1e-6 ) );
+}
+
+TEST_CASE( "Test of mixed precision factorization with more parameters", "[cpplsq]" )
+{
+   ExtendedRosenbrockProblem problem( 70 );
+   cpplsq::gn_sbfgs_min_mixed < cpplsq::Silent, 1000, cpplsq::MixedJacobian | cpplsq::MixedFactor > ( 1e-12, problem.x, problem.r );
+
+   for( double xi : problem.x )
+      REQUIRE( xi == Approx( 1 ).epsilon( 1e-6 ) );
+}
+
+TEST_CASE( "Test of least squares routine with enough parameters for the tiled cholesky", "[cpplsq]" )
+{
+   //the derivative buffers are larger than a pool block and the steps use the tiled cholesky
+   const int N = int( cpplsq::tiled_cholesky_min_size() );
+   ExtendedRosenbrockProblem problem( N );
+
+   //start close enough to the solution for a few iterations, each one accumulates a NxN gram matrix
+   std::fill( problem.x.begin(), problem.x.end(), 0.5 );
+   cpplsq::gn_sbfgs_min<cpplsq::Silent>( 1e-12, problem.x, problem.r );
+
+   for( double xi : problem.x )
+      REQUIRE( xi == Approx( 1 ).epsilon( 1e-8 ) );
+}
+
+TEST_CASE( "Test of least squares routine with a fixed number of parameters", "[cpplsq]" )
+{
+   std::mt19937 e1( 11 );
+   std::uniform_real_distribution<double> uniform_dist( 0.5, 5 );
+   std::uniform_real_distribution<double> disturb( -0.1, 0.1 );
+
+   double p0 = uniform_dist( e1 );
+   double p1 = uniform_dist( e1 );
+   double p2 = uniform_dist( e1 );
+   std::vector<Residual> r;
+
+   for( int i = 0; i < 2000; ++i )
+   {
+      double x = 0.1 + ( i * 9.9 ) / 2000;
+      r.emplace_back( x, disturb( e1 ) + ( p0 * exp( -p1 * x ) + p2 ) );
+   }
+
+   simd::aligned_vector<double> x { 1., 1., 1. };
+   std::array<double, 3> fixed { { 1., 1., 1. } };
+
+   cpplsq::gn_sbfgs_min<cpplsq::Silent>( 1e-10, x, r );
+   cpplsq::gn_sbfgs_min<3, cpplsq::Silent>( 1e-10, fixed, r );
+
+   //same algorithm with a different derivative type takes the same steps
+   for( std::size_t j = 0; j < x.size(); ++j )
+      REQUIRE( fixed[j] == Approx( x[j] ).epsilon( 1e-8 ) );
+
+   //residuals in a std::array keep the whole state on the stack
+   std::array<Residual, 6> exact { {
+         Residual( 0.5, p0 * exp( -p1 * 0.5 ) + p2 ), Residual( 1., p0 * exp( -p1 ) + p2 ),
+         Residual( 1.5, p0 * exp( -p1 * 1.5 ) + p2 ), Residual( 2., p0 * exp( -p1 * 2. ) + p2 ),
+         Residual( 3., p0 * exp( -p1 * 3. ) + p2 ), Residual( 4., p0 * exp( -p1 * 4. ) + p2 )
+      }
+   };
+   std::array<double, 3> y { { 1., 1., 1. } };
+   cpplsq::gn_sbfgs_min<3, cpplsq::Silent>( 1e-14, y, exact );
+
+   REQUIRE( y[0] == Approx( p0 ).epsilon( 1e-6 ) );
+   REQUIRE( y[1] == Approx( p1 ).epsilon( 1e-6 ) );
+   REQUIRE( y[2] == Approx( p2 ).epsilon( 1e-6 ) );
+}
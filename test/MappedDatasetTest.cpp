@@ -0,0 +1,73 @@
+#include <catch/catch.hpp>
+#include <cpplsq/mapped_dataset.hpp>
+#include <cpplsq/gn_sbfgs_min.hpp>
+#include <cstdio>
+#include "ExpDecay.hpp"
+
+TEST_CASE( "Mapped dataset exposes the written columns", "[cpplsq]" )
+{
+   const char *path = "cpplsq_mapped_dataset_test.bin";
+   std::vector<double> x( 1001 ), y( 1001 );
+
+   for( std::size_t i = 0; i < x.size(); ++i )
+   {
+      x[i] = 0.02 * i;
+      y[i] = 3.0 * std::exp( -0.5 * x[i] ) + 1.0;
+   }
+
+   cpplsq::write_dataset<double>( path, x.size(), { x.data(), y.data() } );
+
+   {
+      cpplsq::MappedDataset<double> data( path );
+
+      REQUIRE( data.num_rows() == x.size() );
+      REQUIRE( data.num_columns() == 2 );
+
+      for( std::size_t i = 0; i < x.size(); ++i )
+      {
+         REQUIRE( data.column( 0 )[i] == x[i] );
+         REQUIRE( data.column( 1 )[i] == y[i] );
+      }
+
+      cpplsq::MappedResiduals<ExpDecayResidual, 2> residuals( data );
+      REQUIRE( residuals.size() == x.size() );
+
+      simd::aligned_vector<double> p( 3 );
+      p[0] = 1;
+      p[1] = 1;
+      p[2] = 0;
+
+      cpplsq::gn_sbfgs_min<cpplsq::Silent>( 1e-10, p, residuals );
+
+      REQUIRE( p[0] == Approx( 3.0 ).epsilon( 1e-4 ) );
+      REQUIRE( p[1] == Approx( 0.5 ).epsilon( 1e-4 ) );
+      REQUIRE( p[2] == Approx( 1.0 ).epsilon( 1e-4 ) );
+   }
+
+   std::remove( path );
+}
+
+TEST_CASE( "Mapped dataset rejects a header whose sizes overflow", "[cpplsq]" )
+{
+   const char *path = "cpplsq_mapped_dataset_overflow.bin";
+   std::vector<double> x( 8, 1.0 );
+
+   for( std::uint64_t nrows : { std::uint64_t( 1 ) << 61, std::uint64_t( 8 ) } )
+   {
+      cpplsq::write_dataset<double>( path, x.size(), { x.data() } );
+
+      //overwrite the sizes in the header with values that wrap around when multiplied
+      cpplsq::internal::DatasetHeader header;
+      std::fstream file( path, std::ios::binary | std::ios::in | std::ios::out );
+      file.read( reinterpret_cast<char *>( &header ), sizeof( header ) );
+      header.num_rows = nrows;
+      header.num_columns = ( std::uint64_t( 1 ) << 58 ) + 1;
+      file.seekp( 0 );
+      file.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+      file.close();
+
+      REQUIRE_THROWS_AS( cpplsq::MappedDataset<double>( path ), std::runtime_error );
+   }
+
+   std::remove( path );
+}
@@ -1,5 +1,6 @@
 #include <catch/catch.hpp>
 #include <cpplsq/MultiDiff.hpp>
+#include <cpplsq/FixedDiff.hpp>
 #include <random>
 #include "Rosenbrock.hpp"
 
@@ -34,3 +35,175 @@ TEST_CASE( "Multivariate differentiation works correctly", "[cpplsq]" )
 
    }
 }
+
+TEST_CASE( "Fixed size differentiation works correctly", "[cpplsq]" )
+{
+   const std::size_t N = 6;
+   std::vector<double> x( N );
+   std::array<cpplsq::FixedDiff<double, N>, N> xad;
+
+   std::mt19937 e1( 802345 );
+   std::uniform_real_distribution<double> uniform_dist( -2, 2 );
+
+   for( int k = 0; k < 100; ++k )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+      {
+         x[i] = uniform_dist( e1 );
+         xad[i].setIndependent( x[i], i );
+      }
+
+      std::vector<double> yd = rosen_brock_deriv( x );
+      cpplsq::FixedDiff<double, N> ady = rosen_brock( xad.data(), N );
+      REQUIRE( rosen_brock( x.data(), N ) == Approx( ady.getValue() ) );
+
+      for( std::size_t i = 0; i < N; ++i )
+         REQUIRE( yd[i] == Approx( ady.getDiffValues()[i] ) );
+
+      //d/dx0 of x0 / ( 2 - exp( x1 ) ) and of 3 / x0
+      cpplsq::FixedDiff<double, N> q = xad[0] / ( 2. - exp( xad[1] ) );
+      cpplsq::FixedDiff<double, N> p = 3. / xad[0];
+      const double d = 2. - std::exp( x[1] );
+      REQUIRE( q.getValue() == Approx( x[0] / d ) );
+      REQUIRE( q.getDiffValues()[0] == Approx( 1 / d ) );
+      REQUIRE( q.getDiffValues()[1] == Approx( x[0] * std::exp( x[1] ) / ( d * d ) ) );
+      REQUIRE( p.getDiffValues()[0] == Approx( -3 / ( x[0] * x[0] ) ) );
+      REQUIRE( p.getDiffValues()[1] == 0 );
+   }
+}
+
+TEST_CASE( "Directions are padded to the simd width of the selected instruction set", "[cpplsq]" )
+{
+   REQUIRE( cpplsq::simd_arch_supported() );
+   REQUIRE( cpplsq::internal::simd_width() == sizeof( simd::pack<double> ) );
+
+   cpplsq::MultiDiff<double>::Context ctx( 5 );
+   REQUIRE( cpplsq::internal::num_directions >= 5 );
+   REQUIRE( cpplsq::internal::num_directions % simd::pack_size<double>() == 0 );
+}
+
+template<typename T>
+T large_expression( const T *x )
+{
+   return ( x[0] * x[1] + x[2] * x[3] ) * ( x[4] * x[5] - x[0] * x[2] ) / ( x[1] * x[3] + x[4] * x[4] + 1. ) * exp( x[5] * x[0] - x[1] * x[2] * x[3] );
+}
+
+TEST_CASE( "Subexpressions stored in temporaries are differentiated correctly", "[cpplsq]" )
+{
+   const std::size_t N = 6;
+   cpplsq::MultiDiff<double>::Context ctx( N );
+   std::array<cpplsq::FixedDiff<double, N>, N> xfd;
+   std::vector<cpplsq::MultiDiff<double>> xad( N );
+
+   std::mt19937 e1( 55821 );
+   std::uniform_real_distribution<double> uniform_dist( -1, 1 );
+
+   for( int k = 0; k < 100; ++k )
+   {
+      for( std::size_t i = 0; i < N; ++i )
+      {
+         double x = uniform_dist( e1 );
+         xad[i].setIndependent( x, i );
+         xfd[i].setIndependent( x, i );
+      }
+
+      cpplsq::FixedDiff<double, N> yfd = large_expression( xfd.data() );
+      cpplsq::FixedDiff<double, N> zfd = yfd * large_expression( xfd.data() );
+      cpplsq::MultiDiff<double> yad = large_expression( xad.data() );
+      //a temporary that is alive across several full expressions
+      cpplsq::MultiDiffTemp<double> tmp = large_expression( xad.data() );
+      cpplsq::MultiDiff<double> zad = tmp * large_expression( xad.data() );
+
+      REQUIRE( yad.getValue() == Approx( yfd.getValue() ) );
+      REQUIRE( zad.getValue() == Approx( zfd.getValue() ) );
+
+      for( std::size_t i = 0; i < N; ++i )
+      {
+         REQUIRE( yad.getDiffValue( i ) == Approx( yfd.getDiffValues()[i] ) );
+         REQUIRE( zad.getDiffValue( i ) == Approx( zfd.getDiffValues()[i] ) );
+      }
+   }
+}
+
+TEST_CASE( "Derivatives are only evaluated in the active range", "[cpplsq]" )
+{
+   const std::size_t N = 24;
+   const std::size_t P = cpplsq::pack_size<double>();
+   cpplsq::MultiDiff<double>::Context ctx( N );
+   std::vector<double> x( N );
+
+   for( std::size_t i = 0; i < N; ++i )
+      x[i] = 0.1 * i - 1;
+
+   std::vector<cpplsq::MultiDiff<double>> xad = cpplsq::Independent( x.begin(), x.end() );
+   REQUIRE( xad[13].activeBegin() == 13 - 13 % P );
+   REQUIRE( xad[13].activeEnd() == 13 - 13 % P + P );
+
+   //a term of the chained rosenbrock function only depends on two neighbouring variables
+   cpplsq::MultiDiff<double> y = 10. * ( xad[12] * xad[12] - xad[13] );
+   REQUIRE( y.activeBegin() == 12 - 12 % P );
+   REQUIRE( y.activeEnd() == 13 - 13 % P + P );
+
+   //assigning an expression with a different range clears the old one
+   cpplsq::MultiDiff<double> z = xad[0] + xad[N - 1];
+   REQUIRE( z.activeBegin() == 0 );
+   REQUIRE( z.activeEnd() == N );
+   z = y;
+   REQUIRE( z.activeBegin() == y.activeBegin() );
+   REQUIRE( z.activeEnd() == y.activeEnd() );
+
+   for( std::size_t i = 0; i < N; ++i )
+   {
+      double d = i == 12 ? 20 * x[12] : i == 13 ? -10 : 0;
+      REQUIRE( y.getDiffValue( i ) == Approx( d ) );
+      REQUIRE( z.getDiffValue( i ) == Approx( d ) );
+   }
+
+   //buffers of destroyed values are reused and must not show their old derivatives
+   z = 2.;
+   REQUIRE( z.activeBegin() >= z.activeEnd() );
+   xad.clear();
+   cpplsq::MultiDiff<double> w( 1. );
+
+   for( std::size_t i = 0; i < N; ++i )
+   {
+      REQUIRE( z.getDiffValue( i ) == 0 );
+      REQUIRE( w.getDiffValue( i ) == 0 );
+   }
+}
+
+TEST_CASE( "Constants and independent variables share their derivatives", "[cpplsq]" )
+{
+   const std::size_t N = 11;
+   cpplsq::MultiDiff<double>::Context ctx( N );
+   std::vector<cpplsq::MultiDiff<double>> x( N );
+
+   for( std::size_t i = 0; i < N; ++i )
+      x[i].setIndependent( i + 1., i );
+
+   for( std::size_t i = 0; i < N; ++i )
+   {
+      for( std::size_t j = 0; j < N; ++j )
+         REQUIRE( x[i].getDiffValue( j ) == ( i == j ? 1 : 0 ) );
+   }
+
+   //assignments that refer to the variable itself
+   cpplsq::MultiDiff<double> y = x[3];
+   y = y * x[7] + y;
+   REQUIRE( y.getValue() == Approx( 4 * 8 + 4 ) );
+   REQUIRE( y.getDiffValue( 3 ) == Approx( 9 ) );
+   REQUIRE( y.getDiffValue( 7 ) == Approx( 4 ) );
+   REQUIRE( x[3].getDiffValue( 7 ) == 0 );
+
+   //writing through the pointer does not change the other variables
+   cpplsq::MultiDiff<double> c = x[5];
+   c.getDiffValues()[5] = 3;
+   REQUIRE( c.getDiffValue( 5 ) == 3 );
+   REQUIRE( x[5].getDiffValue( 5 ) == 1 );
+   REQUIRE( cpplsq::MultiDiff<double>( 1. ).getDiffValue( 5 ) == 0 );
+
+   x[5].setIndependent( 6., 4 );
+   REQUIRE( x[5].getDiffValue( 4 ) == 1 );
+   REQUIRE( x[5].getDiffValue( 5 ) == 0 );
+   REQUIRE( x[4].getDiffValue( 4 ) == 1 );
+}
@@ -0,0 +1,65 @@
+#include <catch/catch.hpp>
+#include <cpplsq/problem_record.hpp>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include "ExpDecay.hpp"
+
+TEST_CASE( "Replay of a recorded problem reproduces the trajectory", "[cpplsq]" )
+{
+   const char *path = "cpplsq_problem_record_test.bin";
+   std::mt19937 e1( 1422822953 );
+   std::uniform_real_distribution<double> disturb( -0.1, 0.1 );
+   std::vector<double> xs, ys;
+   std::vector<ExpDecayResidual> r;
+
+   for( int i = 0; i < 500; ++i )
+   {
+      double x = 0.04 * i;
+      double y = disturb( e1 ) + 2.5 * std::exp( -1.5 * x ) + 0.5;
+      xs.push_back( x );
+      ys.push_back( y );
+      r.emplace_back( x, y );
+   }
+
+   simd::aligned_vector<double> p( 3 );
+   p[0] = 1;
+   p[1] = 1;
+   p[2] = 1;
+
+   cpplsq::ProblemRecorder<double> recorder( path, "exp_decay", 1e-10, p, xs.size(), { xs.data(), ys.data() } );
+   cpplsq::gn_sbfgs_min<cpplsq::Silent>( 1e-10, p, r, cpplsq::internal::IdentityTransform(), recorder );
+
+   cpplsq::ProblemRecord<double> record( path );
+   REQUIRE( record.kind == "exp_decay" );
+   REQUIRE( record.num_rows == xs.size() );
+   REQUIRE( record.params[0] == 1 );
+   REQUIRE( record.trace.size() > 0 );
+   REQUIRE( record.trace.back().params[1] == p[1] );
+
+   cpplsq::ReplayReport<double> report = cpplsq::replay_problem<ExpDecayResidual, 2>( record );
+   REQUIRE( report.recorded_iterations == report.replayed_iterations );
+   REQUIRE( report.first_divergence == -1 );
+   REQUIRE( report.max_params_deviation == 0 );
+
+   //drop the last iteration from the recording, then the replay diverges in that iteration
+   std::ifstream in( path, std::ios::binary );
+   std::string bytes( ( std::istreambuf_iterator<char>( in ) ), std::istreambuf_iterator<char>() );
+   in.close();
+   const std::size_t entry = sizeof( std::int32_t ) + sizeof( double ) + p.size() * sizeof( double );
+   std::ofstream( path, std::ios::binary ).write( bytes.data(), bytes.size() - entry );
+
+   cpplsq::ProblemRecord<double> shortened( path );
+   REQUIRE( shortened.trace.size() == record.trace.size() - 1 );
+   report = cpplsq::replay_problem<ExpDecayResidual, 2>( shortened );
+   REQUIRE( report.first_divergence == record.trace.back().iteration );
+
+   //a corrupt number of parameters is reported instead of being allocated
+   const std::uint64_t n = std::uint64_t( 1 ) << 40;
+   bytes.replace( 8 + 2 * sizeof( std::uint32_t ) + sizeof( double ), sizeof( n ), reinterpret_cast<const char *>( &n ), sizeof( n ) );
+   std::ofstream( path, std::ios::binary ).write( bytes.data(), bytes.size() );
+   REQUIRE_THROWS_AS( cpplsq::ProblemRecord<double>( path ), std::runtime_error );
+
+   std::remove( path );
+}
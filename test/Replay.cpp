@@ -0,0 +1,51 @@
+#include <cpplsq/problem_record.hpp>
+#include <iostream>
+#include "ExpDecay.hpp"
+
+/**
+ * Rerun problems recorded with cpplsq::ProblemRecorder and report the time
+ * and the divergence from the recorded trajectory.
+ * Usage: cpplsq_replay <record file>...
+ */
+int main( int argc, char **argv )
+{
+   if( argc < 2 )
+   {
+      std::cerr << "usage: " << argv[0] << " <record file>...\n";
+      return 1;
+   }
+
+   int status = 0;
+
+   for( int i = 1; i < argc; ++i )
+   {
+      try
+      {
+         cpplsq::ProblemRecord<double> record( argv[i] );
+         cpplsq::ReplayReport<double> report;
+
+         if( record.kind == "exp_decay" )
+            report = cpplsq::replay_problem<ExpDecayResidual, 2>( record, 1e-12 );
+         else
+         {
+            std::cerr << argv[i] << ": unknown residual kind " << record.kind << "\n";
+            status = 1;
+            continue;
+         }
+
+         std::cout << argv[i] << ": " << record.num_rows << " residuals, " << record.params.size() << " parameters\n"
+                   << "  time:                " << report.seconds << " s\n"
+                   << "  iterations:          " << report.replayed_iterations << " (recorded " << report.recorded_iterations << ")\n"
+                   << "  first divergence:    " << report.first_divergence << "\n"
+                   << "  max rel. dev. of |r|^2: " << report.max_normr2_deviation << "\n"
+                   << "  max rel. dev. of params: " << report.max_params_deviation << "\n";
+      }
+      catch( const std::exception &e )
+      {
+         std::cerr << e.what() << "\n";
+         status = 1;
+      }
+   }
+
+   return status;
+}
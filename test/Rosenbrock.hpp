@@ -22,6 +22,21 @@ REAL rosen_brock( const REAL *x, std::size_t N )
    return val;
 }
 
+/**
+ * The chained rosenbrock function is the sum of the squares of the 2(N-1) residuals
+ * 1 - x_k and 10 (x_k+1 - x_k^2), so its Jacobian is banded.
+ */
+template<typename REAL>
+REAL rosen_brock_residual( const REAL *x, std::size_t i )
+{
+   const std::size_t k = i / 2;
+
+   if( i % 2 == 0 )
+      return 1 - x[k];
+
+   return 10 * ( x[k + 1] - x[k] * x[k] );
+}
+
 template<typename REAL>
 std::vector<REAL>  rosen_brock_deriv( const std::vector<REAL> &x )
 {
@@ -0,0 +1,193 @@
+#include <catch/catch.hpp>
+#include <cpplsq/sparse_cholesky.hpp>
+#include <cpplsq/gn_sparse_min.hpp>
+#include <random>
+#include "Rosenbrock.hpp"
+
+struct ChainedRosenbrockResidual
+{
+   ChainedRosenbrockResidual( std::size_t i ) : i( i ) {}
+
+   template<typename REAL>
+   REAL operator()( const REAL *params )
+   {
+      return rosen_brock_residual( params, i );
+   }
+private:
+   std::size_t i;
+};
+
+struct LocalChainedRosenbrockResidual
+{
+   LocalChainedRosenbrockResidual( std::size_t i ) : i( i ) {}
+
+   std::vector<std::size_t> parameters() const
+   {
+      const std::size_t k = i / 2;
+      //not in ascending order on purpose
+      return i % 2 == 0 ? std::vector<std::size_t> { k } : std::vector<std::size_t> { k + 1, k };
+   }
+
+   //the parameters are the declared ones, i.e. x_k or x_k+1 and x_k
+   template<typename REAL>
+   REAL operator()( const REAL *params )
+   {
+      if( i % 2 == 0 )
+         return 1 - params[0];
+
+      return 10 * ( params[0] - params[1] * params[1] );
+   }
+private:
+   std::size_t i;
+};
+
+TEST_CASE( "sparse cholesky decomposition solves grid laplacian", "[cpplsq]" )
+{
+   //5 point laplacian on a 12x12 grid plus identity
+   const std::size_t n = 12;
+   const std::size_t N = n * n;
+   std::vector<std::vector<std::size_t>> pattern( N );
+   std::vector<std::vector<double>> values( N );
+   auto A = simd::alloc_aligned_array<double>( N * N );
+   std::fill( A.get(), A.get() + N * N, 0.0 );
+
+   auto add = [&]( std::size_t i, std::size_t j, double v )
+   {
+      pattern[j].push_back( i );
+      values[j].push_back( v );
+      A[i * N + j] = v;
+   };
+
+   for( std::size_t j = 0; j < N; ++j )
+   {
+      add( j, j, 5 );
+
+      if( j % n + 1 < n )
+         add( j + 1, j, -1 );
+
+      if( j + n < N )
+         add( j + n, j, -1 );
+   }
+
+   std::mt19937 e1( 1234 );
+   std::uniform_real_distribution<double> uniform_dist( -1, 1 );
+   auto b = simd::alloc_aligned_array<double>( N );
+   std::vector<double> x( N );
+
+   for( std::size_t i = 0; i < N; ++i )
+      x[i] = b[i] = uniform_dist( e1 );
+
+   cpplsq::SparseCholesky<double> chol;
+   chol.analyze( pattern );
+   REQUIRE( chol.factorize( values ) == 0 );
+   chol.solve( x.data() );
+
+   REQUIRE( cpplsq::cholesky_solve( A.get(), N, b.get(), N ) == 0 );
+
+   for( std::size_t i = 0; i < N; ++i )
+      REQUIRE( x[i] == Approx( b[i] ) );
+
+   //the fill reducing ordering keeps the factor far below the dense lower triangle
+   REQUIRE( chol.factor_size() < N * ( N + 1 ) / 4 );
+
+   //factorize again with new values and a shift
+   for( std::vector<double> &col : values )
+      for( double &v : col )
+         v *= 2;
+
+   for( std::size_t i = 0; i < N; ++i )
+   {
+      for( std::size_t j = 0; j <= i; ++j )
+         A[i * N + j] = 0;
+
+      x[i] = b[i] = uniform_dist( e1 );
+   }
+
+   for( std::size_t j = 0; j < N; ++j )
+      for( std::size_t k = 0; k < pattern[j].size(); ++k )
+         A[pattern[j][k] * N + j] = values[j][k] + ( pattern[j][k] == j ? 1.0 : 0.0 );
+
+   REQUIRE( chol.factorize( values, 1.0 ) == 0 );
+   chol.solve( x.data() );
+   REQUIRE( cpplsq::cholesky_solve( A.get(), N, b.get(), N ) == 0 );
+
+   for( std::size_t i = 0; i < N; ++i )
+      REQUIRE( x[i] == Approx( b[i] ) );
+}
+
+TEST_CASE( "sparse cholesky decomposition detects indefinite matrix", "[cpplsq]" )
+{
+   std::vector<std::vector<std::size_t>> pattern { {0, 1}, {1} };
+   std::vector<std::vector<double>> values { {1, 2}, {1} };
+
+   cpplsq::SparseCholesky<double> chol;
+   chol.analyze( pattern );
+   REQUIRE( chol.factorize( values ) != 0 );
+   REQUIRE( chol.factorize( values, 2.0 ) == 0 );
+}
+
+TEST_CASE( "Test of sparse gauss-newton routine with chained rosenbrock function", "[cpplsq]" )
+{
+   const std::size_t N = 100;
+   simd::aligned_vector<double> x( N );
+   std::vector<ChainedRosenbrockResidual> r;
+
+   for( std::size_t i = 0; i < N; ++i )
+      x[i] = i % 2 == 0 ? -1.2 : 1;
+
+   for( std::size_t i = 0; i < 2 * ( N - 1 ); ++i )
+      r.emplace_back( i );
+
+   cpplsq::gn_sparse_min<cpplsq::Silent>( 1e-12, x, r );
+
+   for( std::size_t i = 0; i < N; ++i )
+      REQUIRE( x[i] == Approx( 1 ).epsilon( 1e-4 ) );
+}
+
+TEST_CASE( "Test of sparse gauss-newton routine with residuals of declared parameters", "[cpplsq]" )
+{
+   const std::size_t N = 100;
+   simd::aligned_vector<double> x( N );
+   std::vector<LocalChainedRosenbrockResidual> r;
+
+   for( std::size_t i = 0; i < N; ++i )
+      x[i] = i % 2 == 0 ? -1.2 : 1;
+
+   for( std::size_t i = 0; i < 2 * ( N - 1 ); ++i )
+      r.emplace_back( i );
+
+   cpplsq::gn_sparse_min<cpplsq::Silent>( 1e-12, x, r );
+
+   for( std::size_t i = 0; i < N; ++i )
+      REQUIRE( x[i] == Approx( 1 ).epsilon( 1e-4 ) );
+}
+
+TEST_CASE( "jacobian of the chained rosenbrock function is compressed to two colors", "[cpplsq]" )
+{
+   const std::size_t N = 50;
+   std::vector<double> x( N, 0.5 );
+   std::vector<ChainedRosenbrockResidual> r;
+
+   for( std::size_t i = 0; i < 2 * ( N - 1 ); ++i )
+      r.emplace_back( i );
+
+   cpplsq::internal::IdentityTransform pt;
+   std::vector<std::vector<std::size_t>> rows = cpplsq::internal::jacobian_pattern( x.data(), N, r, pt );
+
+   for( std::size_t i = 0; i < rows.size(); ++i )
+   {
+      const std::size_t k = i / 2;
+      REQUIRE( rows[i] == ( i % 2 == 0 ? std::vector<std::size_t> { k } : std::vector<std::size_t> { k, k + 1 } ) );
+   }
+
+   std::size_t ncolors;
+   std::vector<std::size_t> color = cpplsq::internal::color_columns( rows, N, ncolors );
+   REQUIRE( ncolors == 2 );
+
+   for( const std::vector<std::size_t> &cols : rows )
+   {
+      for( std::size_t a = 0; a < cols.size(); ++a )
+         for( std::size_t b = 0; b < a; ++b )
+            REQUIRE( color[cols[a]] != color[cols[b]] );
+   }
+}
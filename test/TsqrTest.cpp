@@ -0,0 +1,146 @@
+#include <catch/catch.hpp>
+#include <cpplsq/tsqr.hpp>
+#include <cpplsq/gn_qr_min.hpp>
+#include <random>
+#include <atomic>
+
+struct ScaledDecayResidual
+{
+   ScaledDecayResidual( double x, double y ) : x( x ), y( y ) {}
+
+   //the offset is scaled so that the columns of the jacobian differ by orders of magnitude
+   template<typename REAL >
+   REAL operator()( const REAL *params )
+   {
+      return y - ( params[0] * exp( -params[1] * x ) + 1e3 * params[2] );
+   }
+private:
+   double x;
+   double y;
+};
+
+TEST_CASE( "thread pool executes every iteration once", "[cpplsq]" )
+{
+   cpplsq::internal::ThreadPool pool( 4 );
+   REQUIRE( pool.size() == 4 );
+
+   for( std::size_t n : { 0, 1, 3, 1000 } )
+   {
+      std::vector<std::atomic<int>> calls( n );
+
+      for( std::atomic<int> &c : calls )
+         c = 0;
+
+      pool.parallel_for( n, [&calls]( std::size_t i )
+      {
+         ++calls[i];
+      } );
+
+      for( std::atomic<int> &c : calls )
+         REQUIRE( c == 1 );
+   }
+}
+
+TEST_CASE( "thread pool executes task graphs in dependency order", "[cpplsq]" )
+{
+   cpplsq::internal::ThreadPool pool( 4 );
+   cpplsq::internal::TaskGraph graph;
+   const std::size_t n = 200;
+   std::vector<std::atomic<int>> finished( n );
+   std::atomic<int> violations( 0 );
+
+   for( std::atomic<int> &f : finished )
+      f = 0;
+
+   //task i depends on the tasks i / 2 and i - 3
+   for( std::size_t i = 0; i < n; ++i )
+   {
+      graph.add( [i, &finished, &violations]()
+      {
+         if( ( i > 0 && !finished[i / 2] ) || ( i >= 3 && !finished[i - 3] ) )
+            ++violations;
+
+         ++finished[i];
+      } );
+
+      if( i > 0 )
+         graph.add_dependency( i / 2, i );
+
+      if( i >= 3 )
+         graph.add_dependency( i - 3, i );
+   }
+
+   pool.run( graph );
+   REQUIRE( violations == 0 );
+
+   for( std::atomic<int> &f : finished )
+      REQUIRE( f == 1 );
+}
+
+TEST_CASE( "tsqr computes the R factor of a tall matrix", "[cpplsq]" )
+{
+   std::mt19937 e1( 3 );
+   std::uniform_real_distribution<double> uniform_dist( -1, 1 );
+
+   const std::size_t m = 1000;
+   const std::size_t n = 9;
+   std::vector<double> A( m * n );
+
+   for( double &a : A )
+      a = uniform_dist( e1 );
+
+   std::vector<double> gram( n * n, 0 );
+
+   for( std::size_t i = 0; i < m; ++i )
+      for( std::size_t j = 0; j < n; ++j )
+         for( std::size_t k = 0; k < n; ++k )
+            gram[j * n + k] += A[i * n + j] * A[i * n + k];
+
+   for( std::size_t threads : { 1, 3, 4 } )
+   {
+      cpplsq::internal::ThreadPool pool( threads );
+      cpplsq::internal::Tsqr<double> tsqr( pool );
+      std::vector<double> work( A );
+      std::vector<double> R( n * n );
+      tsqr.factor( work.data(), n, m, n, R.data(), n );
+      REQUIRE( tsqr.panels() == threads );
+
+      //R is upper triangular and R^T R = A^T A
+      for( std::size_t j = 0; j < n; ++j )
+      {
+         for( std::size_t k = 0; k < n; ++k )
+         {
+            if( j > k )
+               REQUIRE( R[j * n + k] == 0 );
+
+            double rtr = 0;
+
+            for( std::size_t i = 0; i < n; ++i )
+               rtr += R[i * n + j] * R[i * n + k];
+
+            REQUIRE( rtr == Approx( gram[j * n + k] ).epsilon( 1e-10 ).margin( 1e-10 ) );
+         }
+      }
+   }
+}
+
+TEST_CASE( "Test of qr gauss-newton routine with badly scaled parameters", "[cpplsq]" )
+{
+   const double p0 = 2.5;
+   const double p1 = 0.7;
+   const double p2 = 1.3e-3;
+   std::vector<ScaledDecayResidual> r;
+
+   for( int i = 0; i < 2000; ++i )
+   {
+      double x = 0.1 + ( i * 9.9 ) / 2000;
+      r.emplace_back( x, p0 * exp( -p1 * x ) + 1e3 * p2 );
+   }
+
+   simd::aligned_vector<double> x { 1., 1., 0. };
+   cpplsq::gn_qr_min<cpplsq::Silent>( 1e-14, x, r, cpplsq::internal::IdentityTransform(), cpplsq::internal::NoMonitor(), 4 );
+
+   REQUIRE( x[0] == Approx( p0 ).epsilon( 1e-6 ) );
+   REQUIRE( x[1] == Approx( p1 ).epsilon( 1e-6 ) );
+   REQUIRE( x[2] == Approx( p2 ).epsilon( 1e-6 ) );
+}